@@ -0,0 +1,332 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Deterministic synthetic OpenStreetMap XML generator.
+ *
+ * Writes an OSM XML document with the requested number of nodes, ways and
+ * relations to stdout. Everything is derived from a seeded pseudo random
+ * generator and printed with integer arithmetic only, so the same options
+ * always produce the same bytes, on any platform and in any locale. */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* tag keys are drawn from this vocabulary, which includes the keys the
+ * default tag filter of osm2prolog drops */
+static const char * const tagKeys[] = {
+	"highway", "name", "building", "amenity", "landuse", "surface", "oneway",
+	"maxspeed", "addr:street", "addr:housenumber", "addr:city", "addr:postcode",
+	"source", "natural", "waterway", "railway", "shop", "lanes", "ref", "layer",
+	"created_by", "note", "name:nl", "name:fr", "wikipedia", "opening_hours"
+};
+#define NUMTAGKEYS (sizeof(tagKeys) / sizeof(tagKeys[0]))
+
+/* tag values are built from these pieces: plain characters, characters that
+ * need escaping in XML or in prolog atoms, and multi-byte UTF-8 sequences */
+static const char * const valuePieces[] = {
+	"a", "b", "c", "d", "e", "f", "g", "h", "i", "k", "l", "m", "n", "o",
+	"r", "s", "t", "u", "v", "w", "0", "1", "2", "5", "9", " ", "-", ".",
+	"'", "\\", "&amp;", "&lt;", "&gt;", "&quot;", "\xc3\xa9", "\xc3\xbc", "\xe2\x82\xac"
+};
+#define NUMVALUEPIECES (sizeof(valuePieces) / sizeof(valuePieces[0]))
+
+typedef struct {
+	uint_least64_t nodes;
+	uint_least64_t ways;
+	uint_least64_t relations;
+	unsigned long minwaylength;
+	unsigned long maxwaylength;
+	unsigned long tagdensity;
+	unsigned long maxtags;
+	unsigned long minstrlen;
+	unsigned long maxstrlen;
+	uint_least64_t seed;
+} genConfig;
+
+/************************/
+/* forward declarations */
+/************************/
+static void usage(const char * exec);
+static void help(const char * exec, const genConfig * config);
+static bool parseCount(const char * str, uint_least64_t * num);
+static bool parseRange(const char * str, unsigned long * min, unsigned long * max);
+
+static uint_least64_t nextRandom(uint_least64_t * state);
+static uint_least64_t randomBelow(uint_least64_t * state, uint_least64_t bound);
+static unsigned long randomBetween(uint_least64_t * state, unsigned long min, unsigned long max);
+
+static void putFixedPoint(int_least32_t value);
+static unsigned long randomTags(const genConfig * config, uint_least64_t * state);
+static void putTags(const genConfig * config, uint_least64_t * state, unsigned long numtags);
+static void putNodes(const genConfig * config, uint_least64_t * state);
+static void putWays(const genConfig * config, uint_least64_t * state);
+static void putRelations(const genConfig * config, uint_least64_t * state);
+
+/* main */
+int main(int argc, char * argv[]) {
+	static const struct option longopts[] = {
+		{"nodes", required_argument, NULL, 'n'},
+		{"ways", required_argument, NULL, 'w'},
+		{"relations", required_argument, NULL, 'r'},
+		{"waylength", required_argument, NULL, 'l'},
+		{"tagdensity", required_argument, NULL, 'd'},
+		{"maxtags", required_argument, NULL, 't'},
+		{"strlen", required_argument, NULL, 's'},
+		{"seed", required_argument, NULL, 'e'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	genConfig config = {
+		.nodes = 200000,
+		.ways = 25000,
+		.relations = 500,
+		.minwaylength = 2,
+		.maxwaylength = 40,
+		.tagdensity = 30,
+		.maxtags = 6,
+		.minstrlen = 1,
+		.maxstrlen = 24,
+		.seed = 20101120
+	};
+	uint_least64_t state;
+	uint_least64_t density;
+	int opt;
+
+	/* exec [-nodes <n>] [-ways <n>] [-relations <n>] [-waylength <min,max>]
+	 *      [-tagdensity <percent>] [-maxtags <n>] [-strlen <min,max>] [-seed <n>]
+	 * or exec -h for the options and their defaults */
+	while (-1 != (opt = getopt_long_only(argc, argv, "", longopts, NULL))) {
+		switch (opt) {
+			case 'n':
+				if (!parseCount(optarg, &config.nodes) || 0 == config.nodes)
+					usage(argv[0]);
+				break;
+			case 'w':
+				if (!parseCount(optarg, &config.ways))
+					usage(argv[0]);
+				break;
+			case 'r':
+				if (!parseCount(optarg, &config.relations))
+					usage(argv[0]);
+				break;
+			case 'l':
+				if (!parseRange(optarg, &config.minwaylength, &config.maxwaylength) || config.minwaylength < 1)
+					usage(argv[0]);
+				break;
+			case 'd':
+				if (!parseCount(optarg, &density) || density > 100)
+					usage(argv[0]);
+				config.tagdensity = (unsigned long)density;
+				break;
+			case 't':
+				if (!parseCount(optarg, &density) || 0 == density || density > 1000)
+					usage(argv[0]);
+				config.maxtags = (unsigned long)density;
+				break;
+			case 's':
+				if (!parseRange(optarg, &config.minstrlen, &config.maxstrlen)
+						|| config.minstrlen < 1 || config.maxstrlen > 255)
+					usage(argv[0]);
+				break;
+			case 'e':
+				if (!parseCount(optarg, &config.seed))
+					usage(argv[0]);
+				break;
+			case 'h':
+				help(argv[0], &config);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	state = config.seed;
+	printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	printf("<osm version=\"0.6\" generator=\"osmgen\">\n");
+	printf(" <bounds minlat=\"-90.0000000\" minlon=\"-180.0000000\" maxlat=\"90.0000000\" maxlon=\"180.0000000\"/>\n");
+	putNodes(&config, &state);
+	putWays(&config, &state);
+	putRelations(&config, &state);
+	printf("</osm>\n");
+
+	if (0 != fflush(stdout) || ferror(stdout)) {
+		perror("osmgen: failed to write the output");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static void usage(const char * exec) {
+	fprintf(stderr, "usage: %s [-nodes <n>] [-ways <n>] [-relations <n>] [-waylength <min,max>] [-tagdensity <percent>] [-maxtags <n>] [-strlen <min,max>] [-seed <n>] > output.osm\n", exec);
+	exit(EXIT_FAILURE);
+}
+
+/* the options with their defaults, as set in 'config' */
+static void help(const char * exec, const genConfig * config) {
+	printf("usage: %s [options] > output.osm\n"
+			"  -nodes <n>            nodes, at least 1 (%" PRIuLEAST64 ")\n"
+			"  -ways <n>             ways (%" PRIuLEAST64 ")\n"
+			"  -relations <n>        relations (%" PRIuLEAST64 ")\n"
+			"  -waylength <min,max>  nodes per way (%lu,%lu)\n"
+			"  -tagdensity <percent> elements with tags (%lu)\n"
+			"  -maxtags <n>          tags per tagged element, 1 to 1000 (%lu)\n"
+			"  -strlen <min,max>     tag value length, 1 to 255 (%lu,%lu)\n"
+			"  -seed <n>             pseudo random generator seed (%" PRIuLEAST64 ")\n",
+			exec, config->nodes, config->ways, config->relations, config->minwaylength, config->maxwaylength,
+			config->tagdensity, config->maxtags, config->minstrlen, config->maxstrlen, config->seed);
+	exit(EXIT_SUCCESS);
+}
+
+static bool parseCount(const char * str, uint_least64_t * num) {
+	char * endptr;
+
+	if ('-' == *str)
+		return false;
+	errno = 0;
+	*num = strtoumax(str, &endptr, 10);
+	return 0 == errno && endptr != str && '\0' == *endptr;
+}
+
+static bool parseRange(const char * str, unsigned long * min, unsigned long * max) {
+	char * endptr;
+
+	errno = 0;
+	*min = strtoul(str, &endptr, 10);
+	if (0 != errno || endptr == str || ',' != *endptr)
+		return false;
+	str = endptr + 1;
+	*max = strtoul(str, &endptr, 10);
+	return 0 == errno && endptr != str && '\0' == *endptr && *min <= *max;
+}
+
+
+
+/**********/
+/* random */
+/**********/
+
+/* splitmix64, which is fast and good enough for test data */
+static uint_least64_t nextRandom(uint_least64_t * state) {
+	uint_least64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+	z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return z ^ (z >> 31);
+}
+
+static uint_least64_t randomBelow(uint_least64_t * state, uint_least64_t bound) {
+	return nextRandom(state) % bound;
+}
+
+static unsigned long randomBetween(uint_least64_t * state, unsigned long min, unsigned long max) {
+	return min + (unsigned long)randomBelow(state, (uint_least64_t)(max - min) + 1);
+}
+
+
+
+/************/
+/* elements */
+/************/
+
+/* prints a coordinate in units of 1e-7 degrees the way OSM does */
+static void putFixedPoint(int_least32_t value) {
+	uint_least32_t magnitude = value < 0 ? -(uint_least32_t)value : (uint_least32_t)value;
+
+	printf("%s%" PRIuLEAST32 ".%07" PRIuLEAST32, value < 0 ? "-" : "",
+			magnitude / 10000000, magnitude % 10000000);
+}
+
+/* the number of tags of the next element */
+static unsigned long randomTags(const genConfig * config, uint_least64_t * state) {
+	if (randomBelow(state, 100) >= config->tagdensity)
+		return 0;
+	return randomBetween(state, 1, config->maxtags);
+}
+
+static void putTags(const genConfig * config, uint_least64_t * state, unsigned long numtags) {
+	unsigned long length;
+
+	while (numtags--) {
+		printf("  <tag k=\"%s\" v=\"", tagKeys[randomBelow(state, NUMTAGKEYS)]);
+		for (length = randomBetween(state, config->minstrlen, config->maxstrlen); length; --length)
+			fputs(valuePieces[randomBelow(state, NUMVALUEPIECES)], stdout);
+		printf("\"/>\n");
+	}
+}
+
+static void putNodes(const genConfig * config, uint_least64_t * state) {
+	unsigned long numtags;
+	uint_least64_t id;
+
+	for (id = 1; id <= config->nodes; ++id) {
+		printf(" <node id=\"%" PRIuLEAST64 "\" version=\"%u\" changeset=\"%" PRIuLEAST64 "\" user=\"osmgen\" uid=\"1\" timestamp=\"2010-11-20T12:00:00Z\" lat=\"",
+				id, (unsigned)randomBetween(state, 1, 9), 1 + id / 100);
+		putFixedPoint((int_least32_t)randomBelow(state, 1800000001) - 900000000);
+		printf("\" lon=\"");
+		putFixedPoint((int_least32_t)((int_least64_t)randomBelow(state, 3600000001) - 1800000000));
+		/* untagged nodes are empty elements, like in real extracts */
+		numtags = randomTags(config, state);
+		if (0 == numtags)
+			printf("\"/>\n");
+		else {
+			printf("\">\n");
+			putTags(config, state, numtags);
+			printf(" </node>\n");
+		}
+	}
+}
+
+static void putWays(const genConfig * config, uint_least64_t * state) {
+	uint_least64_t id;
+	unsigned long length;
+
+	for (id = 1; id <= config->ways; ++id) {
+		printf(" <way id=\"%" PRIuLEAST64 "\" version=\"1\" changeset=\"%" PRIuLEAST64 "\" user=\"osmgen\" uid=\"1\" timestamp=\"2010-11-20T12:00:00Z\">\n",
+				id, 1 + id / 100);
+		for (length = randomBetween(state, config->minwaylength, config->maxwaylength); length; --length)
+			printf("  <nd ref=\"%" PRIuLEAST64 "\"/>\n", 1 + randomBelow(state, config->nodes));
+		putTags(config, state, randomTags(config, state));
+		printf(" </way>\n");
+	}
+}
+
+/* relations are ignored by osm2prolog, but real extracts have them and the
+ * parser has to skip them */
+static void putRelations(const genConfig * config, uint_least64_t * state) {
+	uint_least64_t id;
+	unsigned long members;
+
+	for (id = 1; id <= config->relations; ++id) {
+		printf(" <relation id=\"%" PRIuLEAST64 "\" version=\"1\" changeset=\"1\" user=\"osmgen\" uid=\"1\" timestamp=\"2010-11-20T12:00:00Z\">\n", id);
+		for (members = randomBetween(state, 1, 8); members; --members) {
+			if (0 == config->ways || randomBelow(state, 2))
+				printf("  <member type=\"node\" ref=\"%" PRIuLEAST64 "\" role=\"\"/>\n", 1 + randomBelow(state, config->nodes));
+			else
+				printf("  <member type=\"way\" ref=\"%" PRIuLEAST64 "\" role=\"outer\"/>\n", 1 + randomBelow(state, config->ways));
+		}
+		printf("  <tag k=\"type\" v=\"multipolygon\"/>\n");
+		printf(" </relation>\n");
+	}
+}
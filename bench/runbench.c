@@ -0,0 +1,373 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Throughput benchmark driver for osm2prolog.
+ *
+ * Runs osm2prolog over one input in every benchmarked output mode and prints
+ * one line of space separated key=value pairs per mode: the input size, the
+ * best wall clock time over all runs, the resulting MB/s and records/s, the
+ * peak resident set size and a checksum of the output. When a golden file is
+ * given, the checksums are compared against it (or written to it with
+ * -update), so an optimisation can't change the output unnoticed. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXARGS 8
+#define MAXOUTPUTS 4
+
+/* a benchmarked mode: the arguments before the input file, with "@" replaced
+ * by the work directory, the file that takes its stderr, the output files
+ * that make up its result and whether they are PostgreSQL binary COPY files,
+ * whose records are rows rather than lines */
+typedef struct {
+	const char * name;
+	const char * log;
+	const char * args[MAXARGS];
+	bool toStdout;
+	const char * outputs[MAXOUTPUTS];
+	bool copyRows;
+} benchMode;
+
+static const benchMode benchModes[] = {
+	{"pl", "pl.log", {NULL}, true, {"pl.out", NULL}, false},
+	{"tbl", "tbl.log", {"-tbl", "@/tbl", NULL}, false, {"tbl_node", "tbl_way", "tbl_nodetag", "tbl_waytag"}, false},
+	{"pgcopy", "pgcopy.log", {"-pgcopy", "@/pgcopy", NULL}, false,
+		{"pgcopy_node.pgcopy", "pgcopy_way.pgcopy", "pgcopy_nodetag.pgcopy", "pgcopy_waytag.pgcopy"}, true},
+};
+#define NUMBENCHMODES (sizeof(benchModes) / sizeof(benchModes[0]))
+
+typedef struct {
+	double seconds;
+	long maxrss;
+	uint_least64_t records;
+	uint_least64_t checksum;
+} benchResult;
+
+/************************/
+/* forward declarations */
+/************************/
+static void usage(const char * exec);
+static char * pathconcat(const char * dir, const char * file);
+static bool runMode(const benchMode * mode, const char * exec, const char * input, const char * workdir, benchResult * result);
+static bool hashOutputs(const benchMode * mode, const char * workdir, benchResult * result);
+static bool countCopyRows(FILE * file, uint_least64_t * rows);
+static bool readGolden(const char * filename, const char * name, uint_least64_t * checksum);
+static bool writeGolden(const char * filename, const benchResult * results);
+
+/* main */
+int main(int argc, char * argv[]) {
+	static const struct option longopts[] = {
+		{"runs", required_argument, NULL, 'r'},
+		{"golden", required_argument, NULL, 'g'},
+		{"update", no_argument, NULL, 'u'},
+		{NULL, 0, NULL, 0}
+	};
+	benchResult results[NUMBENCHMODES];
+	benchResult run;
+	struct stat info;
+	const char * golden = NULL;
+	const char * status;
+	bool update = false;
+	bool failed = false;
+	char * endptr;
+	long runs = 3;
+	long i;
+	size_t m;
+	uint_least64_t expected;
+	double mbytes;
+	int opt;
+
+	/* exec [-runs <n>] [-golden <file> [-update]] <osm2prolog> <input.osm> <work directory> */
+	while (-1 != (opt = getopt_long_only(argc, argv, "", longopts, NULL))) {
+		switch (opt) {
+			case 'r':
+				errno = 0;
+				runs = strtol(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || runs < 1)
+					usage(argv[0]);
+				break;
+			case 'g':
+				golden = optarg;
+				break;
+			case 'u':
+				update = true;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind + 3 != argc || (update && !golden))
+		usage(argv[0]);
+
+	if (0 != stat(argv[optind + 1], &info)) {
+		perror(argv[optind + 1]);
+		return EXIT_FAILURE;
+	}
+	mbytes = (double)info.st_size / (1024.0 * 1024.0);
+
+	for (m = 0; m < NUMBENCHMODES; ++m) {
+		for (i = 0; i < runs; ++i) {
+			if (!runMode(&benchModes[m], argv[optind], argv[optind + 1], argv[optind + 2], &run)) {
+				fprintf(stderr, "runbench: mode '%s' failed\n", benchModes[m].name);
+				return EXIT_FAILURE;
+			}
+			if (0 == i)
+				results[m] = run;
+			else {
+				if (run.checksum != results[m].checksum) {
+					fprintf(stderr, "runbench: mode '%s' is not deterministic\n", benchModes[m].name);
+					failed = true;
+				}
+				results[m].seconds = run.seconds < results[m].seconds ? run.seconds : results[m].seconds;
+				results[m].maxrss = run.maxrss > results[m].maxrss ? run.maxrss : results[m].maxrss;
+			}
+		}
+
+		if (!golden)
+			status = "none";
+		else if (update)
+			status = "updated";
+		else if (!readGolden(golden, benchModes[m].name, &expected))
+			status = "missing";
+		else if (expected != results[m].checksum)
+			status = "mismatch";
+		else
+			status = "ok";
+		if (0 != strcmp(status, "ok") && 0 != strcmp(status, "none") && 0 != strcmp(status, "updated"))
+			failed = true;
+
+		printf("mode=%s input_bytes=%jd runs=%ld seconds=%.6f mb_per_s=%.2f records=%" PRIuLEAST64 " records_per_s=%.0f max_rss_kb=%ld checksum=%016" PRIxLEAST64 " golden=%s\n",
+				benchModes[m].name, (intmax_t)info.st_size, runs, results[m].seconds,
+				mbytes / results[m].seconds, results[m].records, (double)results[m].records / results[m].seconds,
+				results[m].maxrss, results[m].checksum, status);
+		fflush(stdout);
+	}
+
+	if (update && !writeGolden(golden, results))
+		failed = true;
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage(const char * exec) {
+	fprintf(stderr, "usage: %s [-runs <n>] [-golden <file> [-update]] <osm2prolog> <input.osm> <work directory>\n", exec);
+	exit(EXIT_FAILURE);
+}
+
+/* returns dir/file, or exits when out of memory */
+static char * pathconcat(const char * dir, const char * file) {
+	char * path = malloc(strlen(dir) + strlen(file) + 2);
+
+	if (!path) {
+		perror("runbench");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(path, "%s/%s", dir, file);
+	return path;
+}
+
+
+
+/***********/
+/* running */
+/***********/
+static bool runMode(const benchMode * mode, const char * exec, const char * input, const char * workdir, benchResult * result) {
+	char * argv[MAXARGS + 2];
+	char * log = pathconcat(workdir, mode->log);
+	char * out = mode->toStdout ? pathconcat(workdir, mode->outputs[0]) : NULL;
+	struct timespec start;
+	struct timespec stop;
+	struct rusage usage;
+	int status;
+	size_t i;
+	pid_t pid;
+
+	argv[0] = (char *)exec;
+	for (i = 0; mode->args[i]; ++i)
+		argv[i + 1] = ('@' == mode->args[i][0]) ? pathconcat(workdir, mode->args[i] + 2) : (char *)mode->args[i];
+	argv[i + 1] = (char *)input;
+	argv[i + 2] = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid = fork();
+	if (0 == pid) {
+		int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (-1 == fd || -1 == dup2(fd, STDERR_FILENO))
+			_exit(126);
+		if (out) {
+			fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (-1 == fd || -1 == dup2(fd, STDOUT_FILENO))
+				_exit(126);
+		}
+		execv(exec, argv);
+		perror(exec);
+		_exit(127);
+	}
+	if (-1 == pid || -1 == wait4(pid, &status, 0, &usage)) {
+		perror("runbench");
+		status = -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	for (i = 0; mode->args[i]; ++i)
+		if ('@' == mode->args[i][0])
+			free(argv[i + 1]);
+	free(out);
+
+	if (-1 == status || !WIFEXITED(status) || 0 != WEXITSTATUS(status)) {
+		fprintf(stderr, "runbench: osm2prolog failed, see %s\n", log);
+		free(log);
+		return false;
+	}
+	free(log);
+
+	result->seconds = (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_nsec - start.tv_nsec) / 1e9;
+	result->maxrss = usage.ru_maxrss;
+	return hashOutputs(mode, workdir, result);
+}
+
+/* FNV-1a over the concatenated outputs, and a count of their lines that are
+ * records (prolog directives aren't), or of their rows */
+static bool hashOutputs(const benchMode * mode, const char * workdir, benchResult * result) {
+	unsigned char buffer[64 * 1024];
+	uint_least64_t hash = UINT64_C(0xcbf29ce484222325);
+	uint_least64_t records = 0;
+	bool linestart;
+	size_t len;
+	size_t i;
+	size_t o;
+
+	for (o = 0; o < MAXOUTPUTS && mode->outputs[o]; ++o) {
+		char * path = pathconcat(workdir, mode->outputs[o]);
+		FILE * file = fopen(path, "rb");
+
+		if (!file) {
+			perror(path);
+			free(path);
+			return false;
+		}
+		linestart = true;
+		while (0 < (len = fread(buffer, 1, sizeof(buffer), file))) {
+			for (i = 0; i < len; ++i) {
+				hash = (hash ^ buffer[i]) * UINT64_C(0x100000001b3);
+				if (linestart && ':' != buffer[i] && !mode->copyRows)
+					++records;
+				linestart = ('\n' == buffer[i]);
+			}
+		}
+		if (ferror(file)) {
+			perror(path);
+			fclose(file);
+			free(path);
+			return false;
+		}
+		if (mode->copyRows && !countCopyRows(file, &records)) {
+			fprintf(stderr, "runbench: %s is not a binary COPY file\n", path);
+			fclose(file);
+			free(path);
+			return false;
+		}
+		fclose(file);
+		free(path);
+	}
+
+	result->checksum = hash;
+	result->records = records;
+	return true;
+}
+
+/* walks the rows after the 19 byte header: an int16 field count, or -1 at
+ * the end, and per field an int32 length, -1 for NULL, and the value */
+static bool countCopyRows(FILE * file, uint_least64_t * rows) {
+	unsigned char buffer[4];
+	uint_least32_t length;
+	int fields;
+
+	if (0 != fseek(file, 19, SEEK_SET))
+		return false;
+	for (;;) {
+		if (1 != fread(buffer, 2, 1, file))
+			return false;
+		if (0xff == buffer[0] && 0xff == buffer[1])
+			return true;
+		++*rows;
+		for (fields = (buffer[0] << 8) | buffer[1]; fields > 0; --fields) {
+			if (1 != fread(buffer, 4, 1, file))
+				return false;
+			length = ((uint_least32_t)buffer[0] << 24) | ((uint_least32_t)buffer[1] << 16) | ((uint_least32_t)buffer[2] << 8) | buffer[3];
+			if (0xffffffff != length && 0 != fseek(file, (long)length, SEEK_CUR))
+				return false;
+		}
+	}
+}
+
+
+
+/**********/
+/* golden */
+/**********/
+
+/* the golden file has one "<mode> <checksum>" line per mode, lines starting
+ * with '#' are comments */
+static bool readGolden(const char * filename, const char * name, uint_least64_t * checksum) {
+	char line[256];
+	char mode[64];
+	bool found = false;
+	FILE * file = fopen(filename, "r");
+
+	if (!file) {
+		perror(filename);
+		return false;
+	}
+	while (!found && fgets(line, sizeof(line), file))
+		found = ('#' != line[0] && 2 == sscanf(line, "%63s %" SCNxLEAST64, mode, checksum) && 0 == strcmp(mode, name));
+	fclose(file);
+	return found;
+}
+
+static bool writeGolden(const char * filename, const benchResult * results) {
+	size_t m;
+	FILE * file = fopen(filename, "w");
+
+	if (!file) {
+		perror(filename);
+		return false;
+	}
+	fprintf(file, "# osm2prolog output checksums for the default osmgen input, see 'make -C bench golden'\n");
+	for (m = 0; m < NUMBENCHMODES; ++m)
+		fprintf(file, "%s %016" PRIxLEAST64 "\n", benchModes[m].name, results[m].checksum);
+	if (0 != fclose(file)) {
+		perror(filename);
+		return false;
+	}
+	return true;
+}
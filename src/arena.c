@@ -0,0 +1,131 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* the types with the strictest alignment */
+typedef
+union arenaAlign {
+	long double d;
+	int_least64_t i;
+	void * p;
+}
+arenaAlign;
+
+/* allocations are rounded up to this */
+#define ALIGNMENT sizeof(arenaAlign)
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+typedef
+struct arenaBlock {
+	struct arenaBlock * previous;
+	size_t size;
+	size_t used;
+	arenaAlign data[]; /* 'size' bytes */
+}
+arenaBlock;
+
+struct osmArena {
+	arenaBlock * block; /* the current one, the others are chained to it */
+	size_t total; /* of all blocks */
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static arenaBlock * newBlock(arenaBlock * previous, size_t size);
+
+/*********/
+/* arena */
+/*********/
+osmArena * osm2prolog_createArena(size_t size) {
+	osmArena * arena = xmlMalloc(sizeof(osmArena));
+
+	arena->total = ALIGN(size);
+	arena->block = newBlock(NULL, arena->total);
+	return arena;
+}
+
+void osm2prolog_freeArena(osmArena * arena) {
+	arenaBlock * block;
+
+	while ((block = arena->block)) {
+		arena->block = block->previous;
+		xmlFree(block);
+	}
+	xmlFree(arena);
+}
+
+void * osm2prolog_arenaAlloc(osmArena * arena, size_t size) {
+	arenaBlock * block = arena->block;
+	void * ptr;
+
+	size = ALIGN(size);
+	if (block->size - block->used < size) {
+		/* at least double the arena, so the number of blocks stays small */
+		block = arena->block = newBlock(block, (size > arena->total) ? size : arena->total);
+		arena->total += block->size;
+	}
+	ptr = (char *)block->data + block->used;
+	block->used += size;
+	return ptr;
+}
+
+void * osm2prolog_arenaGrow(osmArena * arena, void * ptr, size_t oldsize, size_t newsize) {
+	arenaBlock * block = arena->block;
+	void * moved;
+
+	oldsize = ALIGN(oldsize);
+	newsize = ALIGN(newsize);
+	/* the most recent allocation ends the current block */
+	if ((char *)ptr + oldsize == (char *)block->data + block->used
+			&& block->size - block->used >= newsize - oldsize) {
+		block->used += newsize - oldsize;
+		return ptr;
+	}
+	moved = osm2prolog_arenaAlloc(arena, newsize);
+	memcpy(moved, ptr, oldsize);
+	return moved;
+}
+
+void osm2prolog_resetArena(osmArena * arena) {
+	arenaBlock * block;
+
+	if (arena->block->previous) {
+		while ((block = arena->block)) {
+			arena->block = block->previous;
+			xmlFree(block);
+		}
+		arena->block = newBlock(NULL, arena->total);
+	}
+	arena->block->used = 0;
+}
+
+static arenaBlock * newBlock(arenaBlock * previous, size_t size) {
+	arenaBlock * block = xmlMalloc(offsetof(arenaBlock, data) + size);
+
+	block->previous = previous;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
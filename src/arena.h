@@ -0,0 +1,45 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Bump allocator for memory that lives as long as one top-level element.
+ *
+ * Allocations are carved from a block and are all released at once by
+ * osm2prolog_resetArena. When an element needs more than the block holds,
+ * extra blocks are chained on; the next reset folds them into one block of
+ * the combined size, so that after the largest element has been seen the
+ * parser does not allocate anymore. */
+
+#include <stddef.h>
+
+typedef struct osmArena osmArena;
+
+osmArena * osm2prolog_createArena(size_t size);
+
+void osm2prolog_freeArena(osmArena * arena);
+
+/* returns 'size' bytes, aligned for any type */
+void * osm2prolog_arenaAlloc(osmArena * arena, size_t size);
+
+/* grows the most recent allocation 'ptr' from 'oldsize' to 'newsize' bytes,
+ * in place when the block has room, otherwise by moving it */
+void * osm2prolog_arenaGrow(osmArena * arena, void * ptr, size_t oldsize, size_t newsize);
+
+/* releases all allocations */
+void osm2prolog_resetArena(osmArena * arena);
@@ -0,0 +1,332 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "binary.h"
+#include "dict.h"
+#include "output.h"
+#include "types.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* record layout, as written by osm2prolog_putRecord */
+#define KEY_SIZE sizeof(int_least64_t)
+#define LEN_SIZE sizeof(uint_least32_t)
+#define HEADER_SIZE (KEY_SIZE + LEN_SIZE)
+
+/* maps strings to ids in order of first appearance, and writes them out */
+typedef
+struct binaryDict {
+	osmOutput * offsets;
+	osmOutput * strings;
+	osmDict * dict;
+	uint64_t end; /* size of the strings column so far */
+	unsigned int users; /* references, closed when the last one goes */
+}
+binaryDict;
+
+/* the columns of one table, and the records it got so far */
+typedef
+struct binaryTable {
+	osmElement kind; /* NODE, WAY or TAG */
+	osmOutput * columns[3];
+	uint_least64_t numnodes; /* way_node values written */
+	binaryDict * keys;
+	binaryDict * values;
+	unsigned char * pending; /* incomplete record data */
+	size_t size;
+	size_t cap;
+}
+binaryTable;
+
+/************************/
+/* forward declarations */
+/************************/
+static osmOutput * openColumn(const char * prefix, const char * name, osmBinaryType type, uint32_t width, int64_t scale);
+static binaryDict * openDict(const char * prefix, const char * name);
+static bool closeDict(binaryDict * dict);
+static bool releaseDict(binaryDict * dict);
+static uint_least32_t dictLookup(binaryDict * dict, const unsigned char * str, size_t len);
+static binaryTable * openTable(osmElement kind, const char * prefix, const char * names[3], binaryDict * keys, binaryDict * values);
+static bool closeTable(binaryTable * table);
+static bool tableWrite(void * arg, const char * data, size_t size);
+static bool tableClose(void * arg);
+static void handleRecord(binaryTable * table, int_least64_t key, const unsigned char * payload, size_t len);
+
+/***********/
+/* opening */
+/***********/
+bool osm2prolog_openBinaryTables(const char * prefix, osmOutput ** node, osmOutput ** way, osmOutput ** nodetag, osmOutput ** waytag) {
+	static const char * nodecols[3] = {"node_id", "node_lat", "node_lon"};
+	static const char * waycols[3] = {"way_id", "way_offset", "way_node"};
+	static const char * nodetagcols[3] = {"nodetag_id", "nodetag_key", "nodetag_value"};
+	static const char * waytagcols[3] = {"waytag_id", "waytag_key", "waytag_value"};
+	binaryDict * keys = openDict(prefix, "key");
+	binaryDict * values = openDict(prefix, "value");
+	binaryTable * tables[4] = {NULL, NULL, NULL, NULL};
+	bool ok = keys && values;
+	size_t i;
+
+	if (ok) {
+		tables[0] = openTable(NODE, prefix, nodecols, NULL, NULL);
+		tables[1] = openTable(WAY, prefix, waycols, NULL, NULL);
+		tables[2] = openTable(TAG, prefix, nodetagcols, keys, values);
+		tables[3] = openTable(TAG, prefix, waytagcols, keys, values);
+		for (i = 0; i < 4; ++i)
+			ok = ok && tables[i];
+	}
+
+	if (!ok)
+		for (i = 0; i < 4; ++i)
+			if (tables[i])
+				closeTable(tables[i]);
+	/* from here on, the dictionaries belong to the tag tables */
+	if (keys)
+		releaseDict(keys);
+	if (values)
+		releaseDict(values);
+	if (!ok)
+		return false;
+
+	*node = osm2prolog_openSinkOutput(tableWrite, tableClose, tables[0]);
+	*way = osm2prolog_openSinkOutput(tableWrite, tableClose, tables[1]);
+	*nodetag = osm2prolog_openSinkOutput(tableWrite, tableClose, tables[2]);
+	*waytag = osm2prolog_openSinkOutput(tableWrite, tableClose, tables[3]);
+	return true;
+}
+
+/* creates <prefix>_<name>.bin and writes its header */
+static osmOutput * openColumn(const char * prefix, const char * name, osmBinaryType type, uint32_t width, int64_t scale) {
+	size_t prefixlen = strlen(prefix);
+	size_t namelen = strlen(name);
+	char * filename = xmlMalloc(prefixlen + namelen + 6);
+	osmBinaryHeader header;
+	osmOutput * out;
+
+	memcpy(filename, prefix, prefixlen);
+	filename[prefixlen] = '_';
+	memcpy(filename + prefixlen + 1, name, namelen);
+	memcpy(filename + prefixlen + 1 + namelen, ".bin", 5);
+	out = osm2prolog_openOutput(filename);
+	xmlFree(filename);
+	if (!out)
+		return NULL;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, OSM_BINARY_MAGIC, sizeof(OSM_BINARY_MAGIC));
+	header.version = OSM_BINARY_VERSION;
+	header.byteorder = OSM_BINARY_BYTEORDER;
+	header.type = type;
+	header.width = width;
+	header.scale = scale;
+	osm2prolog_put(out, &header, sizeof(header));
+	return out;
+}
+
+
+
+/****************/
+/* dictionaries */
+/****************/
+static binaryDict * openDict(const char * prefix, const char * name) {
+	binaryDict * dict;
+	char offsetname[32];
+	char stringname[32];
+	uint64_t zero = 0;
+
+	snprintf(offsetname, sizeof(offsetname), "%s_offset", name);
+	snprintf(stringname, sizeof(stringname), "%s_string", name);
+	dict = xmlMalloc(sizeof(binaryDict));
+	memset(dict, 0, sizeof(binaryDict));
+	dict->offsets = openColumn(prefix, offsetname, BINARY_UINT64, sizeof(uint64_t), 1);
+	dict->strings = openColumn(prefix, stringname, BINARY_BYTES, 1, 1);
+	dict->users = 1;
+	if (!dict->offsets || !dict->strings) {
+		closeDict(dict);
+		return NULL;
+	}
+	osm2prolog_put(dict->offsets, &zero, sizeof(zero));
+	dict->dict = osm2prolog_createDict();
+	return dict;
+}
+
+static bool closeDict(binaryDict * dict) {
+	bool ok = true;
+
+	if (dict->offsets)
+		ok = osm2prolog_closeOutput(dict->offsets) && ok;
+	if (dict->strings)
+		ok = osm2prolog_closeOutput(dict->strings) && ok;
+	if (dict->dict)
+		osm2prolog_freeDict(dict->dict);
+	xmlFree(dict);
+	return ok;
+}
+
+static bool releaseDict(binaryDict * dict) {
+	if (0 == --dict->users)
+		return closeDict(dict);
+	return true;
+}
+
+/* returns the id of a string, adding it if it is new */
+static uint_least32_t dictLookup(binaryDict * dict, const unsigned char * str, size_t len) {
+	bool added;
+	uint_least32_t id = osm2prolog_dictIntern(dict->dict, str, len, &added);
+
+	if (added) {
+		dict->end += len;
+		osm2prolog_put(dict->strings, str, len);
+		osm2prolog_put(dict->offsets, &dict->end, sizeof(dict->end));
+	}
+	return id;
+}
+
+
+
+/**********/
+/* tables */
+/**********/
+static binaryTable * openTable(osmElement kind, const char * prefix, const char * names[3], binaryDict * keys, binaryDict * values) {
+	binaryTable * table = xmlMalloc(sizeof(binaryTable));
+	uint64_t zero = 0;
+
+	memset(table, 0, sizeof(binaryTable));
+	table->kind = kind;
+	table->keys = keys;
+	table->values = values;
+	table->columns[0] = openColumn(prefix, names[0], BINARY_INT64, sizeof(int64_t), 1);
+	switch (kind) {
+		case NODE:
+			table->columns[1] = openColumn(prefix, names[1], BINARY_INT32, sizeof(int32_t), OSM_COORD_SCALE);
+			table->columns[2] = openColumn(prefix, names[2], BINARY_INT32, sizeof(int32_t), OSM_COORD_SCALE);
+			break;
+		case WAY:
+			table->columns[1] = openColumn(prefix, names[1], BINARY_UINT64, sizeof(uint64_t), 1);
+			table->columns[2] = openColumn(prefix, names[2], BINARY_INT64, sizeof(int64_t), 1);
+			if (table->columns[1])
+				osm2prolog_put(table->columns[1], &zero, sizeof(zero));
+			break;
+		default:
+			table->columns[1] = openColumn(prefix, names[1], BINARY_UINT32, sizeof(uint32_t), 1);
+			table->columns[2] = openColumn(prefix, names[2], BINARY_UINT32, sizeof(uint32_t), 1);
+	}
+
+	if (!table->columns[0] || !table->columns[1] || !table->columns[2]) {
+		table->keys = table->values = NULL;
+		closeTable(table);
+		return NULL;
+	}
+	if (keys)
+		keys->users++;
+	if (values)
+		values->users++;
+	return table;
+}
+
+static bool closeTable(binaryTable * table) {
+	bool ok = true;
+	size_t i;
+
+	for (i = 0; i < 3; ++i)
+		if (table->columns[i])
+			ok = osm2prolog_closeOutput(table->columns[i]) && ok;
+	if (table->keys)
+		ok = releaseDict(table->keys) && ok;
+	if (table->values)
+		ok = releaseDict(table->values) && ok;
+	xmlFree(table->pending);
+	xmlFree(table);
+	return ok;
+}
+
+/* records may be split over several calls, the rest of one is kept */
+static bool tableWrite(void * arg, const char * data, size_t size) {
+	binaryTable * table = arg;
+	size_t pos = 0;
+	uint_least32_t paylen;
+	int_least64_t key;
+
+	if (table->size + size > table->cap) {
+		table->cap = table->cap ? table->cap : 64 * 1024;
+		while (table->size + size > table->cap)
+			table->cap *= 2;
+		table->pending = xmlRealloc(table->pending, table->cap);
+	}
+	memcpy(table->pending + table->size, data, size);
+	table->size += size;
+
+	while (pos + HEADER_SIZE <= table->size) {
+		memcpy(&paylen, table->pending + pos + KEY_SIZE, LEN_SIZE);
+		if (pos + HEADER_SIZE + paylen > table->size)
+			break;
+		memcpy(&key, table->pending + pos, KEY_SIZE);
+		handleRecord(table, key, table->pending + pos + HEADER_SIZE, paylen);
+		pos += HEADER_SIZE + paylen;
+	}
+	memmove(table->pending, table->pending + pos, table->size - pos);
+	table->size -= pos;
+	return true;
+}
+
+static bool tableClose(void * arg) {
+	binaryTable * table = arg;
+	bool ok = true;
+
+	if (table->size > 0) {
+		fprintf(stderr, "INTERNAL ERROR: incomplete record in binary output.\n");
+		ok = false;
+	}
+	return closeTable(table) && ok;
+}
+
+/* appends one record (see print.c for the payloads) to the columns */
+static void handleRecord(binaryTable * table, int_least64_t key, const unsigned char * payload, size_t len) {
+	int64_t id = key;
+	uint64_t offset;
+	uint32_t keylen;
+	uint32_t dictid;
+
+	osm2prolog_put(table->columns[0], &id, sizeof(id));
+	switch (table->kind) {
+		case NODE:
+			/* the coordinates are fixed point already */
+			osm2prolog_put(table->columns[1], payload, sizeof(int32_t));
+			osm2prolog_put(table->columns[2], payload + sizeof(int32_t), sizeof(int32_t));
+			break;
+		case WAY:
+			/* the node ids are int64 already */
+			osm2prolog_put(table->columns[2], payload, len);
+			table->numnodes += len / sizeof(int64_t);
+			offset = table->numnodes;
+			osm2prolog_put(table->columns[1], &offset, sizeof(offset));
+			break;
+		default:
+			memcpy(&keylen, payload, sizeof(keylen));
+			payload += sizeof(keylen);
+			dictid = dictLookup(table->keys, payload, keylen);
+			osm2prolog_put(table->columns[1], &dictid, sizeof(dictid));
+			dictid = dictLookup(table->values, payload + keylen, len - sizeof(keylen) - keylen);
+			osm2prolog_put(table->columns[2], &dictid, sizeof(dictid));
+	}
+}
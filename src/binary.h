@@ -0,0 +1,79 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Binary columnar tables.
+ *
+ * Every column is a file <prefix>_<column>.bin holding an osmBinaryHeader
+ * followed by fixed-width values in native byte order, so a column can be
+ * mapped and used as an array straight away; the number of values follows
+ * from the file size. Row i of a table is element i of each of its columns.
+ *
+ *   node_id, node_lat, node_lon    int64 id, int32 fixed point coordinates
+ *                                  (degrees * 10^7, INT32_MIN if unusable)
+ *   way_id, way_offset, way_node   way i has the int64 node ids at
+ *                                  way_node[way_offset[i] .. way_offset[i+1]),
+ *                                  way_offset has one value more than way_id
+ *   nodetag_id, nodetag_key,       int64 parent id, uint32 dictionary ids
+ *   nodetag_value, and the same
+ *   for waytag_*
+ *   key_offset, key_string,        string i of a dictionary is
+ *   value_offset, value_string     string[offset[i] .. offset[i+1]), raw
+ *                                  bytes without terminator
+ *
+ * The binary outputs take the records of sort.h, so they work with -j and
+ * -sorted in the same way as the text tables. */
+
+#include "output.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OSM_BINARY_MAGIC "osm2plb"
+#define OSM_BINARY_VERSION 1
+/* written in native byte order, readers compare it to detect a mismatch */
+#define OSM_BINARY_BYTEORDER 0x01020304
+
+typedef
+enum osmBinaryType {
+	_OSM_BINARY_TYPE_UNSET_ = 0,
+	BINARY_INT64,
+	BINARY_INT32,
+	BINARY_UINT64,
+	BINARY_UINT32,
+	BINARY_BYTES,
+	_OSM_BINARY_TYPE_SIZE_
+}
+osmBinaryType;
+
+/* 32 bytes, so the values that follow are aligned */
+typedef
+struct osmBinaryHeader {
+	char magic[8]; /* OSM_BINARY_MAGIC, nul-terminated */
+	uint32_t version;
+	uint32_t byteorder;
+	uint32_t type; /* osmBinaryType */
+	uint32_t width; /* bytes per value */
+	int64_t scale; /* values are fixed point numbers multiplied by this */
+}
+osmBinaryHeader;
+
+/* opens the table outputs of BINARY mode, which create all column files
+ * for the given prefix; returns false on failure, with nothing left open */
+bool osm2prolog_openBinaryTables(const char * prefix, osmOutput ** node, osmOutput ** way, osmOutput ** nodetag, osmOutput ** waytag);
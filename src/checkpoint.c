@@ -0,0 +1,307 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "checkpoint.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "types.h"
+#include "util.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libxml/xmlmemory.h>
+
+#define CHECKPOINT_MAGIC "osm2prolog checkpoint 1"
+/* longest line of a checkpoint file */
+#define CHECKPOINT_LINE 4096
+/* nanoseconds per second */
+#define NS 1000000000
+
+typedef
+struct checkpointOutput {
+	char * filename;
+	osmOutput * out; /* NULL until it is opened */
+	uint_least64_t size; /* at the last checkpoint, or the one resumed from */
+}
+checkpointOutput;
+
+struct osmCheckpoint {
+	char * filename;
+	char * tmpfilename; /* written first, then renamed to filename */
+	uint_least64_t interval; /* in nanoseconds */
+	uint_least64_t last; /* when the last checkpoint was written */
+	uint_least64_t inputsize;
+	int_least64_t inputmtime;
+
+	/* what was read from the checkpoint file when resuming */
+	bool resume;
+	uint_least64_t offset;
+	osmElement action;
+	uint_least64_t counters[_OSM_COUNTER_SIZE_];
+
+	checkpointOutput * outputs;
+	size_t numoutputs;
+	size_t maxoutputs;
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static bool readCheckpoint(osmCheckpoint * checkpoint);
+static bool readLine(osmCheckpoint * checkpoint, FILE * file, char * line);
+static bool writeCheckpoint(osmCheckpoint * checkpoint, const parseState * state, uint_least64_t offset);
+static checkpointOutput * addOutput(osmCheckpoint * checkpoint, const char * filename, size_t len);
+
+/**************/
+/* checkpoint */
+/**************/
+osmCheckpoint * osm2prolog_openCheckpoint(const char * filename, const char * input, unsigned int interval, bool resume) {
+	osmCheckpoint * checkpoint;
+	struct stat info;
+	size_t len = strlen(filename);
+
+	if (0 != stat(input, &info)) {
+		perror(input);
+		return NULL;
+	}
+
+	checkpoint = xmlMalloc(sizeof(osmCheckpoint));
+	memset(checkpoint, 0, sizeof(osmCheckpoint));
+	checkpoint->filename = (char *)xmlCharStrdup(filename);
+	checkpoint->tmpfilename = xmlMalloc(len + 5);
+	memcpy(checkpoint->tmpfilename, filename, len);
+	memcpy(checkpoint->tmpfilename + len, ".tmp", 5);
+	checkpoint->interval = (uint_least64_t)interval * NS;
+	checkpoint->last = osm2prolog_now();
+	checkpoint->inputsize = (uint_least64_t)info.st_size;
+	checkpoint->inputmtime = (int_least64_t)info.st_mtime;
+	checkpoint->resume = resume;
+	checkpoint->action = _OSM_ELEMENT_UNSET_;
+
+	if (resume && !readCheckpoint(checkpoint)) {
+		osm2prolog_closeCheckpoint(checkpoint, false);
+		return NULL;
+	}
+	return checkpoint;
+}
+
+void osm2prolog_closeCheckpoint(osmCheckpoint * checkpoint, bool done) {
+	size_t i;
+
+	if (done && 0 != unlink(checkpoint->filename) && ENOENT != errno)
+		perror(checkpoint->filename);
+	for (i = 0; i < checkpoint->numoutputs; ++i)
+		xmlFree(checkpoint->outputs[i].filename);
+	xmlFree(checkpoint->outputs);
+	xmlFree(checkpoint->tmpfilename);
+	xmlFree(checkpoint->filename);
+	xmlFree(checkpoint);
+}
+
+osmOutput * osm2prolog_openCheckpointOutput(osmCheckpoint * checkpoint, const char * filename) {
+	checkpointOutput * output = NULL;
+	size_t i;
+
+	if (!checkpoint->resume) {
+		output = addOutput(checkpoint, filename, strlen(filename));
+		output->out = osm2prolog_openOutput(filename);
+		return output->out;
+	}
+
+	for (i = 0; i < checkpoint->numoutputs && !output; ++i) {
+		if (0 == strcmp(checkpoint->outputs[i].filename, filename))
+			output = &checkpoint->outputs[i];
+	}
+	if (!output) {
+		fprintf(stderr, "%s: not an output of the checkpointed conversion, resume it with the same options\n", filename);
+		return NULL;
+	}
+	output->out = osm2prolog_reopenOutput(filename, output->size);
+	return output->out;
+}
+
+bool osm2prolog_resumeConversion(parseState * state, uint_least64_t * offset) {
+	osmCheckpoint * checkpoint = state->checkpoint;
+	size_t i;
+
+	*offset = 0;
+	if (!checkpoint->resume)
+		return true;
+
+	for (i = 0; i < checkpoint->numoutputs; ++i) {
+		if (!checkpoint->outputs[i].out) {
+			fprintf(stderr, "%s: this output of the checkpointed conversion is missing, resume it with the same options\n",
+					checkpoint->outputs[i].filename);
+			return false;
+		}
+	}
+	memcpy(state->counters, checkpoint->counters, sizeof(state->counters));
+	state->action = checkpoint->action;
+	*offset = checkpoint->offset;
+	fprintf(stderr, "Resuming at byte %" PRIuLEAST64 " of the input.\n", checkpoint->offset);
+	return true;
+}
+
+void osm2prolog_passCheckpoint(parseState * state, uint_least64_t offset) {
+	osmCheckpoint * checkpoint = state->checkpoint;
+	uint_least64_t now = osm2prolog_now();
+
+	if (now - checkpoint->last < checkpoint->interval)
+		return;
+	/* the outputs have to hold everything up to the offset */
+	if (state->pipeline)
+		osm2prolog_drainPipeline(state);
+	/* a failed checkpoint leaves the previous one in place */
+	if (!writeCheckpoint(checkpoint, state, offset))
+		fprintf(stderr, "Warning: failed to write a checkpoint, a resumed conversion would continue from the previous one.\n");
+	checkpoint->last = now;
+}
+
+
+
+/********/
+/* file */
+/********/
+/* the file has one line per item:
+ *	osm2prolog checkpoint 1
+ *	input <size> <mtime>
+ *	offset <bytes>
+ *	action <osmElement>
+ *	counters <value> ... (in osmCounter order)
+ *	output <size> <filename> (for every output) */
+static bool writeCheckpoint(osmCheckpoint * checkpoint, const parseState * state, uint_least64_t offset) {
+	FILE * file;
+	size_t i;
+	bool ok;
+
+	/* everything up to the offset must be on disk before the checkpoint */
+	for (i = 0; i < checkpoint->numoutputs; ++i) {
+		if (!osm2prolog_syncOutput(checkpoint->outputs[i].out, &checkpoint->outputs[i].size))
+			return false;
+	}
+
+	if (!(file = fopen(checkpoint->tmpfilename, "w"))) {
+		perror(checkpoint->tmpfilename);
+		return false;
+	}
+	fprintf(file, "%s\n", CHECKPOINT_MAGIC);
+	fprintf(file, "input %" PRIuLEAST64 " %" PRIdLEAST64 "\n", checkpoint->inputsize, checkpoint->inputmtime);
+	fprintf(file, "offset %" PRIuLEAST64 "\n", offset);
+	fprintf(file, "action %d\n", (int)state->action);
+	fprintf(file, "counters");
+	for (i = 0; i < _OSM_COUNTER_SIZE_; ++i)
+		fprintf(file, " %" PRIuLEAST64, state->counters[i]);
+	fprintf(file, "\n");
+	for (i = 0; i < checkpoint->numoutputs; ++i)
+		fprintf(file, "output %" PRIuLEAST64 " %s\n", checkpoint->outputs[i].size, checkpoint->outputs[i].filename);
+
+	ok = (0 == fflush(file)) && (0 == fsync(fileno(file)));
+	ok = (0 == fclose(file)) && ok;
+	if (!ok || 0 != rename(checkpoint->tmpfilename, checkpoint->filename)) {
+		perror(checkpoint->tmpfilename);
+		return false;
+	}
+	return true;
+}
+
+static bool readCheckpoint(osmCheckpoint * checkpoint) {
+	FILE * file = fopen(checkpoint->filename, "r");
+	char line[CHECKPOINT_LINE];
+	uint_least64_t inputsize;
+	int_least64_t inputmtime;
+	uint_least64_t size;
+	int action;
+	int pos;
+	char * values;
+	char * end;
+	size_t i;
+	bool ok;
+
+	if (!file) {
+		perror(checkpoint->filename);
+		return false;
+	}
+	ok = readLine(checkpoint, file, line) && 0 == strcmp(line, CHECKPOINT_MAGIC)
+		&& readLine(checkpoint, file, line)
+		&& 2 == sscanf(line, "input %" SCNuLEAST64 " %" SCNdLEAST64, &inputsize, &inputmtime)
+		&& readLine(checkpoint, file, line)
+		&& 1 == sscanf(line, "offset %" SCNuLEAST64, &checkpoint->offset)
+		&& readLine(checkpoint, file, line)
+		&& 1 == sscanf(line, "action %d", &action)
+		&& action >= 0 && action < _OSM_ELEMENT_SIZE_
+		&& readLine(checkpoint, file, line)
+		&& 0 == strncmp(line, "counters", 8);
+	for (i = 0, values = line + 8; ok && i < _OSM_COUNTER_SIZE_; ++i, values = end) {
+		errno = 0;
+		checkpoint->counters[i] = strtoull(values, &end, 10);
+		ok = (0 == errno && end != values);
+	}
+	ok = ok && '\0' == *values;
+	while (ok && readLine(checkpoint, file, line)) {
+		ok = (1 == sscanf(line, "output %" SCNuLEAST64 " %n", &size, &pos) && pos > 0 && '\0' != line[pos]);
+		if (ok)
+			addOutput(checkpoint, line + pos, strlen(line + pos))->size = size;
+	}
+	fclose(file);
+
+	if (!ok || 0 == checkpoint->numoutputs) {
+		fprintf(stderr, "%s: not a valid checkpoint\n", checkpoint->filename);
+		return false;
+	}
+	if (inputsize != checkpoint->inputsize || inputmtime != checkpoint->inputmtime) {
+		fprintf(stderr, "%s: the input changed since the checkpoint was written\n", checkpoint->filename);
+		return false;
+	}
+	checkpoint->action = (osmElement)action;
+	return true;
+}
+
+/* reads a line without its newline, false at the end of the file or for
+ * lines that are too long */
+static bool readLine(osmCheckpoint * checkpoint, FILE * file, char * line) {
+	size_t len;
+
+	if (!fgets(line, CHECKPOINT_LINE, file))
+		return false;
+	len = strlen(line);
+	if (0 == len || '\n' != line[len - 1]) {
+		fprintf(stderr, "%s: line too long or unterminated\n", checkpoint->filename);
+		return false;
+	}
+	line[len - 1] = '\0';
+	return true;
+}
+
+static checkpointOutput * addOutput(osmCheckpoint * checkpoint, const char * filename, size_t len) {
+	checkpointOutput * output;
+
+	if (checkpoint->numoutputs == checkpoint->maxoutputs) {
+		checkpoint->maxoutputs = checkpoint->maxoutputs ? 2 * checkpoint->maxoutputs : 8;
+		checkpoint->outputs = xmlRealloc(checkpoint->outputs, checkpoint->maxoutputs * sizeof(checkpointOutput));
+	}
+	output = &checkpoint->outputs[checkpoint->numoutputs++];
+	output->filename = (char *)xmlCharStrndup(filename, (int)len);
+	output->out = NULL;
+	output->size = 0;
+	return output;
+}
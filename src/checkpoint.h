@@ -0,0 +1,64 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Checkpoints of long conversions.
+ *
+ * Every so often, between two slices of the input (see OSM_PROGRESS_STEP),
+ * a conversion with a checkpoint file gets all its output files on disk and
+ * then records the input offset, the size of every output file, the
+ * counters and the osmChange block it is in. The checkpoint file is
+ * replaced with rename(2), so it always holds a complete checkpoint.
+ *
+ * A resumed conversion opens its outputs without truncating them, cuts them
+ * back to the sizes in the checkpoint and continues at the input offset.
+ * This takes the inputs that are parsed in slices, uncompressed XML with
+ * the tokenizer and PBF, whose blobs are compressed one by one, and outputs
+ * that are plain files written in input order. */
+
+#include "output.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct osmCheckpoint osmCheckpoint;
+
+struct parseState;
+
+/* starts checkpointing the conversion of 'input' to 'filename', at most
+ * every 'interval' seconds; with 'resume', reads the checkpoint in
+ * 'filename' first, which must be of the same input. Returns NULL on
+ * failure. */
+osmCheckpoint * osm2prolog_openCheckpoint(const char * filename, const char * input, unsigned int interval, bool resume);
+
+/* removes the checkpoint file once the conversion is 'done', and frees the
+ * checkpoint */
+void osm2prolog_closeCheckpoint(osmCheckpoint * checkpoint, bool done);
+
+/* opens an output file of the conversion: a new one, or when resuming the
+ * one of the checkpoint at its checkpointed size; returns NULL on failure */
+osmOutput * osm2prolog_openCheckpointOutput(osmCheckpoint * checkpoint, const char * filename);
+
+/* restores the counters and the osmChange block of a resumed conversion,
+ * and stores the input offset to continue at, 0 when not resuming; returns
+ * false when the outputs do not match those of the checkpoint */
+bool osm2prolog_resumeConversion(struct parseState * state, uint_least64_t * offset);
+
+/* called at an element boundary: writes a checkpoint when one is due */
+void osm2prolog_passCheckpoint(struct parseState * state, uint_least64_t offset);
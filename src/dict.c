@@ -0,0 +1,158 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dict.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* the hash table is grown when it gets fuller than 1/2 */
+#define INITIAL_SLOTS 4096
+
+struct osmDict {
+	unsigned char * text; /* all strings, back to back */
+	size_t textsize;
+	size_t textcap;
+	size_t * starts; /* count + 1 offsets into text */
+	size_t maxstarts;
+	uint_least32_t count;
+	uint_least32_t * slots; /* id + 1, or 0 for an empty slot */
+	size_t numslots;
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static size_t findSlot(const osmDict * dict, const unsigned char * str, size_t len);
+static uint_least64_t hashString(const unsigned char * str, size_t len);
+static void growSlots(osmDict * dict);
+
+/**************/
+/* dictionary */
+/**************/
+osmDict * osm2prolog_createDict(void) {
+	osmDict * dict = xmlMalloc(sizeof(osmDict));
+
+	dict->textsize = 0;
+	dict->textcap = 64 * 1024;
+	dict->text = xmlMalloc(dict->textcap);
+	dict->maxstarts = 1024;
+	dict->starts = xmlMalloc(dict->maxstarts * sizeof(size_t));
+	dict->starts[0] = 0;
+	dict->count = 0;
+	dict->numslots = INITIAL_SLOTS;
+	dict->slots = xmlMalloc(dict->numslots * sizeof(uint_least32_t));
+	memset(dict->slots, 0, dict->numslots * sizeof(uint_least32_t));
+	return dict;
+}
+
+void osm2prolog_freeDict(osmDict * dict) {
+	xmlFree(dict->text);
+	xmlFree(dict->starts);
+	xmlFree(dict->slots);
+	xmlFree(dict);
+}
+
+uint_least32_t osm2prolog_dictIntern(osmDict * dict, const unsigned char * str, size_t len, bool * added) {
+	size_t slot = findSlot(dict, str, len);
+	uint_least32_t id;
+
+	if (added)
+		*added = (0 == dict->slots[slot]);
+	if (0 != dict->slots[slot])
+		return dict->slots[slot] - 1;
+
+	id = dict->count++;
+	dict->slots[slot] = id + 1;
+	if (dict->textsize + len > dict->textcap) {
+		while (dict->textsize + len > dict->textcap)
+			dict->textcap *= 2;
+		dict->text = xmlRealloc(dict->text, dict->textcap);
+	}
+	memcpy(dict->text + dict->textsize, str, len);
+	dict->textsize += len;
+	if (dict->count == dict->maxstarts) {
+		dict->maxstarts *= 2;
+		dict->starts = xmlRealloc(dict->starts, dict->maxstarts * sizeof(size_t));
+	}
+	dict->starts[dict->count] = dict->textsize;
+
+	if (2 * (size_t)dict->count > dict->numslots)
+		growSlots(dict);
+	return id;
+}
+
+bool osm2prolog_dictFind(const osmDict * dict, const unsigned char * str, size_t len, uint_least32_t * id) {
+	size_t slot = findSlot(dict, str, len);
+
+	if (0 == dict->slots[slot])
+		return false;
+	*id = dict->slots[slot] - 1;
+	return true;
+}
+
+uint_least32_t osm2prolog_dictSize(const osmDict * dict) {
+	return dict->count;
+}
+
+/* returns the slot holding a string, or the empty slot where it belongs */
+static size_t findSlot(const osmDict * dict, const unsigned char * str, size_t len) {
+	size_t mask = dict->numslots - 1;
+	size_t slot = (size_t)hashString(str, len) & mask;
+	uint_least32_t id;
+
+	while (0 != dict->slots[slot]) {
+		id = dict->slots[slot] - 1;
+		if (dict->starts[id + 1] - dict->starts[id] == len
+				&& 0 == memcmp(dict->text + dict->starts[id], str, len))
+			break;
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/* FNV-1a */
+static uint_least64_t hashString(const unsigned char * str, size_t len) {
+	uint_least64_t hash = 14695981039346656037u;
+
+	while (len-- > 0) {
+		hash ^= *str++;
+		hash *= 1099511628211u;
+	}
+	return hash;
+}
+
+static void growSlots(osmDict * dict) {
+	size_t mask;
+	size_t slot;
+	uint_least32_t id;
+
+	xmlFree(dict->slots);
+	dict->numslots *= 2;
+	dict->slots = xmlMalloc(dict->numslots * sizeof(uint_least32_t));
+	memset(dict->slots, 0, dict->numslots * sizeof(uint_least32_t));
+	mask = dict->numslots - 1;
+	for (id = 0; id < dict->count; ++id) {
+		slot = (size_t)hashString(dict->text + dict->starts[id], dict->starts[id + 1] - dict->starts[id]) & mask;
+		while (0 != dict->slots[slot])
+			slot = (slot + 1) & mask;
+		dict->slots[slot] = id + 1;
+	}
+}
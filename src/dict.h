@@ -0,0 +1,42 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* String interning: maps byte strings to ids 0, 1, 2, ... in order of
+ * first appearance. The strings are copied, so they may be transient. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct osmDict osmDict;
+
+osmDict * osm2prolog_createDict(void);
+
+void osm2prolog_freeDict(osmDict * dict);
+
+/* returns the id of a string, adding it if it is new, in which case 'added'
+ * is set (when not NULL) */
+uint_least32_t osm2prolog_dictIntern(osmDict * dict, const unsigned char * str, size_t len, bool * added);
+
+/* looks up a string without adding it, returns false if it is not there */
+bool osm2prolog_dictFind(const osmDict * dict, const unsigned char * str, size_t len, uint_least32_t * id);
+
+/* the number of strings, which is also the next id */
+uint_least32_t osm2prolog_dictSize(const osmDict * dict);
@@ -0,0 +1,557 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "elements.h"
+#include "binary.h"
+#include "pgcopy.h"
+#include "pipeline.h"
+#include "print.h"
+#include "shard.h"
+#include "stats.h"
+#include "types.h"
+#include "util.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/* one in this many printed nodes, ways and tags is timed for the statistics */
+#define TIMING_SAMPLE 16
+
+/************************/
+/* forward declarations */
+/************************/
+static void parseOSM(const parseState * state, const osmSlice * attrs);
+static void parseOSMChange(const parseState * state, const osmSlice * attrs);
+static bool parseChange(parseState * state, osmElement element, const osmSlice * attrs);
+static bool writeChange(parseState * state, osmElement element, bool hasid);
+static void parseNode(parseState * state, const osmSlice * attrs);
+static void parseWay(parseState * state, const osmSlice * attrs);
+static void parseND(parseState * state, const osmSlice * attrs);
+static void parseTag(parseState * state, const osmSlice * attrs);
+
+static bool keepNode(parseState * state, int32_t lat, int32_t lon);
+static void openWay(parseState * state);
+static void growWayNodes(parseState * state);
+
+static void setCoordinate(const parseState * state, xmlChar * dest, osmSlice text, int32_t fixed, bool plain);
+
+static uint_least64_t startSample(const parseState * state, osmCounter counter);
+static void stopSample(parseState * state, uint_least64_t start);
+
+/* TODO in later versions
+	this parser currently only supports 1 level of element nesting
+		supported parents:
+			node
+			way
+		ignored parents:
+			relation
+*/
+
+/************/
+/* document */
+/************/
+void osm2prolog_startDocument(parseState * state) {
+	/* Technically, these values are probably already set, but that's because
+	 * these are general sane values. We don't wan't to _depend_ on that though. */
+	state->parent = _OSM_ELEMENT_UNSET_;
+	state->action = _OSM_ELEMENT_UNSET_;
+	state->lat[0] = '\0';
+	state->lon[0] = '\0';
+	state->badnode = true;
+	state->parentid = 0;
+	state->numways = 0;
+	state->maxways = 0;
+	state->waynodeids = NULL;
+	osm2prolog_resetArena(state->arena);
+	state->badtag = true;
+	state->tagprefix = NULL;
+	state->tagkey.str = NULL;
+	state->tagvalue.str = NULL;
+	state->numtags = 0;
+
+	/* if printmode is not set to something we support, print warning and default to PL*/
+	state->printMode =
+		((state->printMode != PL) && (state->printMode != TABLE) && (state->printMode != BINARY) && (state->printMode != PGCOPY)
+		 && (state->printMode != CALLBACK))
+		? (void)fprintf(stderr, "Warning: unrecognised print mode, defaulting to PL (prolog terms)\n"), PL
+		: state->printMode;
+
+	/* check outputs and set defaults: table files, or stdout for prolog terms */
+	if (TABLE == state->printMode) {
+		state->node_file    = (state->node_file    ? state->node_file    : osm2prolog_openOutput("table_node"));
+		state->way_file     = (state->way_file     ? state->way_file     : osm2prolog_openOutput("table_way"));
+		state->nodetag_file = (state->nodetag_file ? state->nodetag_file : osm2prolog_openOutput("table_nodetag"));
+		state->waytag_file  = (state->waytag_file  ? state->waytag_file  : osm2prolog_openOutput("table_waytag"));
+		if (state->changes) {
+			state->nodedelete_file = (state->nodedelete_file ? state->nodedelete_file : osm2prolog_openOutput("table_node_delete"));
+			state->waydelete_file  = (state->waydelete_file  ? state->waydelete_file  : osm2prolog_openOutput("table_way_delete"));
+		}
+	}
+	if (BINARY == state->printMode) {
+		state->tableRecords = true;
+		if (!state->node_file && !osm2prolog_openBinaryTables("binary",
+					&state->node_file, &state->way_file, &state->nodetag_file, &state->waytag_file))
+			state->outputfailed = true;
+	}
+	if (PGCOPY == state->printMode) {
+		state->tableRecords = true;
+		if (!state->node_file && !osm2prolog_openCopyTables("pgcopy",
+					&state->node_file, &state->way_file, &state->nodetag_file, &state->waytag_file))
+			state->outputfailed = true;
+	}
+	if (PL == state->printMode)
+		state->prolog_file = (state->prolog_file ? state->prolog_file : osm2prolog_openOutputFd(STDOUT_FILENO));
+
+	/* prevent swipl from complaining about the order of clauses, which only
+	 * interleave when all predicates go to one output; a change has no
+	 * clauses, just directives */
+	if (PL == state->printMode && !state->splitPredicates && !state->changes)
+		osm2prolog_putString(state->prolog_file, ":-style_check(-discontiguous).\n");
+
+	/* from here on, the outputs belong to the format thread */
+	if (state->formatThread)
+		osm2prolog_startPipeline(state);
+
+	if (!state->quiet)
+		fprintf(stderr, "Start Document\n");
+}
+
+void osm2prolog_endDocument(parseState * state) {
+	if (!state->quiet)
+		fprintf(stderr, "End Document\n");
+
+	if (!osm2prolog_closeOutputs(state)) {
+		fprintf(stderr, "Error: failed to write the output.\n");
+		state->outputfailed = true;
+	}
+}
+
+
+
+/************/
+/* elements */
+/************/
+void osm2prolog_startElement(parseState * state, osmElement element, const osmSlice * attrs) {
+	uint_least64_t start;
+
+	switch (element) {
+		/* --- accepted --- */
+		case OSM:
+			/* the xml root node */
+			parseOSM(state, attrs);
+			break;
+		case OSMCHANGE:
+			parseOSMChange(state, attrs);
+			break;
+		case CREATE:
+		case MODIFY:
+		case DELETE:
+			state->action = element;
+			break;
+		case NODE:
+			parseNode(state, attrs);
+			break;
+		case WAY:
+			parseWay(state, attrs);
+			break;
+		case ND:
+			parseND(state, attrs);
+			break;
+		case TAG:
+			/* tags are empty elements, so print them right away */
+			start = startSample(state, COUNT_TAGS);
+			state->counters[COUNT_TAGS]++;
+			parseTag(state, attrs);
+			if (!state->badtag) {
+				printTag(strConstants[TAG], state);
+				state->counters[COUNT_TAGS_WRITTEN]++;
+				state->numtags++;
+			}
+			stopSample(state, start);
+			state->tagkey.str = NULL;
+			state->tagvalue.str = NULL;
+			break;
+
+		/* --- ignored (deliberately and explicitely) --- */
+		case RELATION:
+			state->counters[COUNT_RELATIONS]++;
+			state->parent = RELATION;
+			break;
+		case MEMBER:
+		default:
+			break;
+	}
+}
+
+/* TODO make "parse cleanup" functions that will be called here */
+void osm2prolog_endElement(parseState * state, osmElement element) {
+	uint_least64_t start;
+
+	switch (element) {
+		case NODE:
+			if (state->badnode) {
+				/* BAD OR OUTSIDE THE REGION - counted when parsed */
+			}
+			else if (state->dropUntagged && 0 == state->numtags)
+				state->counters[COUNT_UNTAGGED]++;
+			else {
+				start = startSample(state, COUNT_NODES_WRITTEN);
+				printNode(strConstants[NODE], state);
+				state->counters[COUNT_NODES_WRITTEN]++;
+				stopSample(state, start);
+			}
+			state->parent = _OSM_ELEMENT_UNSET_;
+			state->badnode = true;
+			osm2prolog_resetArena(state->arena);
+			break;
+		case WAY:
+			if (DELETE == state->action) {
+				/* DELETED - written when it started */
+			}
+			else if (0 == state->numways) {
+				fprintf(stderr, "Warning: way element doesn't contain nodes. Ignoring way.");
+				/* ways without a usable id were counted when parsed */
+				if (WAY == state->parent)
+					state->counters[COUNT_BAD_WAYS]++;
+			}
+			else if (state->region && !state->wayinregion)
+				state->counters[COUNT_OUTSIDE_REGION]++;
+			else if (state->dropUntagged && 0 == state->numtags)
+				state->counters[COUNT_UNTAGGED]++;
+			else {
+				start = startSample(state, COUNT_WAYS_WRITTEN);
+				printWay(strConstants[WAY], state);
+				state->counters[COUNT_WAYS_WRITTEN]++;
+				stopSample(state, start);
+			}
+
+			state->parent = _OSM_ELEMENT_UNSET_;
+			state->numways = 0;
+			state->maxways = 0;
+			state->waynodeids = NULL;
+			osm2prolog_resetArena(state->arena);
+			break;
+
+		/* nd - is only handled as a child of way */
+		/* tag - printed when it starts */
+
+		case CREATE:
+		case MODIFY:
+		case DELETE:
+			state->action = _OSM_ELEMENT_UNSET_;
+			break;
+
+		/* --- ignored (deliberately and explicitely) --- */
+		case RELATION:
+			state->parent = _OSM_ELEMENT_UNSET_;
+			osm2prolog_resetArena(state->arena);
+			break;
+		case MEMBER:
+		default:
+			break;
+	}
+}
+
+
+
+/*********************/
+/* parsing functions */
+/*********************/
+static void parseOSM(const parseState * state, const osmSlice * attrs) {
+	if (attrs[VERSION].str && !state->quiet)
+		fprintf(stderr, "Openstreetmap XML, version %.*s\n", (int)attrs[VERSION].len, attrs[VERSION].str);
+}
+
+static void parseOSMChange(const parseState * state, const osmSlice * attrs) {
+	if (attrs[VERSION].str && !state->quiet)
+		fprintf(stderr, "Openstreetmap change XML, version %.*s\n", (int)attrs[VERSION].len, attrs[VERSION].str);
+	if (!state->changes)
+		fprintf(stderr, "Warning: converting an osmChange file without -change, ignoring its deletions.\n");
+}
+
+/* in a modify or delete block, writes the deletion of the earlier version of
+ * a node or way; returns false for deleted elements, which need nothing else */
+static bool parseChange(parseState * state, osmElement element, const osmSlice * attrs) {
+	if (MODIFY != state->action && DELETE != state->action)
+		return true;
+	return writeChange(state, element, attrs[ID].str && osm2prolog_parseId(attrs[ID], &(state->parentid)));
+}
+
+/* parseChange for an id that is already in state->parentid, if hasid */
+static bool writeChange(parseState * state, osmElement element, bool hasid) {
+	if (MODIFY != state->action && DELETE != state->action)
+		return true;
+	if (!state->changes)
+		return MODIFY == state->action;
+
+	if (!hasid) {
+		/* modified elements get their warning when they are parsed */
+		if (DELETE == state->action) {
+			fprintf(stderr, "Warning: Failed to find or convert the ID of a deleted %s record. Ignoring it.\n", strConstants[element]);
+			state->counters[(NODE == element) ? COUNT_BAD_NODES : COUNT_BAD_WAYS]++;
+		}
+	}
+	else {
+		osm2prolog_selectShard(state, state->parentid);
+		printDeletion(element, state);
+		state->counters[COUNT_DELETIONS]++;
+	}
+	return MODIFY == state->action;
+}
+
+static void parseNode(parseState * state, const osmSlice * attrs) {
+	int32_t lat;
+	int32_t lon;
+	bool latplain;
+	bool lonplain;
+
+	state->badnode = true;
+	state->numtags = 0;
+	state->counters[COUNT_NODES]++;
+	if (!parseChange(state, NODE, attrs))
+		return;
+
+	/* save the tuple if it's conform to what we expect */
+	if (!attrs[ID].str || !attrs[LAT].str || !attrs[LON].str) {
+		fprintf(stderr, "Warning: Not all required keys for node record found. Ignoring node record.\n");
+		state->counters[COUNT_BAD_NODES]++;
+	}
+	else {
+		if (!(
+					osm2prolog_parseId(attrs[ID], &(state->parentid))
+					&& attrs[LAT].len <= OSM_COORD_MAXLEN
+					&& attrs[LON].len <= OSM_COORD_MAXLEN
+					&& osm2prolog_parseDegrees(attrs[LAT], &lat, &latplain)
+					&& osm2prolog_parseDegrees(attrs[LON], &lon, &lonplain)
+		     )) {
+			fprintf(stderr, "Warning: Failed to convert node ID, LAT or LON from string to number. Ignoring node record.\n");
+			state->counters[COUNT_BAD_NODES]++;
+		}
+		else if (state->precision > 0 && (OSM_COORD_UNUSABLE == lat || OSM_COORD_UNUSABLE == lon)) {
+			fprintf(stderr, "Warning: Node LAT or LON out of range. Ignoring node record.\n");
+			state->counters[COUNT_BAD_NODES]++;
+		}
+		else if (keepNode(state, lat, lon)) {
+			setCoordinate(state, state->lat, attrs[LAT], lat, latplain);
+			setCoordinate(state, state->lon, attrs[LON], lon, lonplain);
+		}
+	}
+}
+
+static void parseWay(parseState * state, const osmSlice * attrs) {
+	state->numtags = 0;
+	state->wayinregion = false;
+	state->counters[COUNT_WAYS]++;
+	if (!parseChange(state, WAY, attrs))
+		return;
+	if (!attrs[ID].str) {
+		fprintf(stderr, "Warning: Failed to find the ID for the current way record. Ignoring way record.\n");
+		state->counters[COUNT_BAD_WAYS]++;
+	}
+	else {
+		if (!osm2prolog_parseId(attrs[ID], &(state->parentid))) {
+			fprintf(stderr, "Warning: Failed to convert way ID from string to number. Ignoring way record.\n");
+			state->counters[COUNT_BAD_WAYS]++;
+		}
+		else
+			openWay(state);
+	}
+}
+
+static void parseND(parseState * state, const osmSlice * attrs) {
+	state->counters[COUNT_NDS]++;
+	if (!attrs[REF].str) {
+		fprintf(stderr, "Warning: Failed to find the REF (reference node) for the current ND record. Ignoring ND node.\n");
+		state->counters[COUNT_BAD_NDS]++;
+	}
+	else {
+		if (state->parent != WAY) {
+			/* the nodes of deleted ways don't matter */
+			if (DELETE != state->action) {
+				fprintf(stderr, "Warning: Ignoring ND element outside WAY element.\n");
+				state->counters[COUNT_BAD_NDS]++;
+			}
+		}
+		else {
+			growWayNodes(state);
+			if (!osm2prolog_parseId(attrs[REF], &(state->waynodeids[state->numways]))) {
+				fprintf(stderr, "Warning: Failed to convert ND node ID from string to number. Ignoring ND node.\n");
+				state->counters[COUNT_BAD_NDS]++;
+			}
+			else {
+				if (state->region && osm2prolog_hasId(state->regionnodes, state->waynodeids[state->numways]))
+					state->wayinregion = true;
+				state->numways++;
+			}
+			/* ND must not set parent so no further action here */
+		}
+	}
+}
+
+/* the typed counterparts of the NODE, WAY and ND elements */
+void osm2prolog_startNode(parseState * state, int_least64_t id, int32_t lat, int32_t lon) {
+	const osmSlice none = {NULL, 0};
+
+	state->badnode = true;
+	state->numtags = 0;
+	state->counters[COUNT_NODES]++;
+	state->parentid = id;
+	if (!writeChange(state, NODE, true))
+		return;
+
+	if (OSM_COORD_UNUSABLE == lat || OSM_COORD_UNUSABLE == lon) {
+		fprintf(stderr, "Warning: Node LAT or LON out of range. Ignoring node record.\n");
+		state->counters[COUNT_BAD_NODES]++;
+	}
+	else if (keepNode(state, lat, lon)) {
+		setCoordinate(state, state->lat, none, lat, false);
+		setCoordinate(state, state->lon, none, lon, false);
+	}
+}
+
+void osm2prolog_startWay(parseState * state, int_least64_t id) {
+	state->numtags = 0;
+	state->wayinregion = false;
+	state->counters[COUNT_WAYS]++;
+	state->parentid = id;
+	if (writeChange(state, WAY, true))
+		openWay(state);
+}
+
+void osm2prolog_addWayNode(parseState * state, int_least64_t ref) {
+	state->counters[COUNT_NDS]++;
+	if (state->parent != WAY) {
+		if (DELETE != state->action) {
+			fprintf(stderr, "Warning: Ignoring ND element outside WAY element.\n");
+			state->counters[COUNT_BAD_NDS]++;
+		}
+	}
+	else {
+		growWayNodes(state);
+		state->waynodeids[state->numways] = ref;
+		if (state->region && osm2prolog_hasId(state->regionnodes, ref))
+			state->wayinregion = true;
+		state->numways++;
+	}
+}
+
+static void parseTag(parseState * state, const osmSlice * attrs) {
+	state->badtag = true;
+	state->tagprefix = NULL;
+
+	/* known tag prefixes */
+	if (NODE == state->parent)
+		state->tagprefix = strConstants[NODE];
+	/* the nd elements come first, so this is known by now */
+	if (WAY == state->parent && (!state->region || state->wayinregion))
+		state->tagprefix = strConstants[WAY];
+
+	if (!state->tagprefix) {
+		/* IGNORED TAG - do absolutely nothing */
+		state->counters[COUNT_IGNORED_TAGS]++;
+	}
+	else {
+		if (!attrs[K].str || !attrs[V].str) {
+			fprintf(stderr,	"Warning: Not all required keys for record <%s> found. Ignoring %s record in %s record.\n",
+					strConstants[TAG], strConstants[TAG], state->tagprefix);
+			state->counters[COUNT_BAD_TAGS]++;
+		}
+		else {
+			/* if the filter keeps it then print it, else do absolutely nothing */
+			if (osm2prolog_keepTag(state->tagfilter, attrs[K], attrs[V])) {
+				state->badtag = false;
+				state->tagkey = attrs[K];
+				state->tagvalue = attrs[V];
+			}
+			else
+				state->counters[COUNT_FILTERED_TAGS]++;
+		}
+	}
+}
+
+
+
+/********/
+/* UTIL */
+/********/
+
+/* takes a node with a usable id, unless it is outside the region; the caller
+ * sets the coordinate text when this returns true */
+static bool keepNode(parseState * state, int32_t lat, int32_t lon) {
+	if (state->region && (OSM_COORD_UNUSABLE == lat || OSM_COORD_UNUSABLE == lon
+				|| !osm2prolog_inRegion(state->region, (double)lat / OSM_COORD_SCALE, (double)lon / OSM_COORD_SCALE))) {
+		/* OUTSIDE THE REGION - ignore the node and its tags */
+		state->counters[COUNT_OUTSIDE_REGION]++;
+		return false;
+	}
+	if (state->region)
+		osm2prolog_addId(state->regionnodes, state->parentid);
+	if (state->locations && !osm2prolog_setLocation(state->locations, state->parentid, lat, lon))
+		fprintf(stderr, "Warning: Failed to store the location of node %" PRIdLEAST64 ".\n", state->parentid);
+	osm2prolog_selectShard(state, state->parentid);
+	state->parent = NODE;
+	state->latfixed = (state->precision > 0) ? osm2prolog_roundDegrees(lat, state->precision) : lat;
+	state->lonfixed = (state->precision > 0) ? osm2prolog_roundDegrees(lon, state->precision) : lon;
+	state->badnode = false;
+	return true;
+}
+
+static void openWay(parseState * state) {
+	osm2prolog_selectShard(state, state->parentid);
+	state->parent = WAY;
+	/* "way is an ordered interconnection of at least 2 and at most 2,000[1] (API v0.6) nodes"
+	 * from: http://wiki.openstreetmap.org/wiki/Ways
+	 * so this usually suffices, but history and import data have longer ways */
+	state->maxways = 2000;
+	state->waynodeids = osm2prolog_arenaAlloc(state->arena, state->maxways * sizeof(int_least64_t));
+}
+
+/* makes room for one more way node */
+static void growWayNodes(parseState * state) {
+	if (state->numways == state->maxways) {
+		state->waynodeids = osm2prolog_arenaGrow(state->arena, state->waynodeids,
+				state->maxways * sizeof(int_least64_t), 2 * state->maxways * sizeof(int_least64_t));
+		state->maxways *= 2;
+	}
+}
+
+/* keeps a coordinate as it was read, unless -precision asks for a canonical
+ * form or the text is not a valid prolog number as it is (like ".5") */
+static void setCoordinate(const parseState * state, xmlChar * dest, osmSlice text, int32_t fixed, bool plain) {
+	if (OSM_COORD_UNUSABLE != fixed && (state->precision > 0 || !plain))
+		dest[osm2prolog_formatDegrees(fixed, (state->precision > 0) ? state->precision : 7, (char *)dest)] = '\0';
+	else {
+		memcpy(dest, text.str, text.len);
+		dest[text.len] = '\0';
+	}
+}
+
+/* starts timing when this is a sampled element, returns 0 otherwise */
+static uint_least64_t startSample(const parseState * state, osmCounter counter) {
+	if (!state->timePhases || 0 != state->counters[counter] % TIMING_SAMPLE)
+		return 0;
+	return osm2prolog_now();
+}
+
+static void stopSample(parseState * state, uint_least64_t start) {
+	if (start)
+		state->formattime += (osm2prolog_now() - start) * TIMING_SAMPLE;
+}
@@ -0,0 +1,50 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* OSM element handling, independent of the XML parser feeding it.
+ *
+ * Front-ends (the libxml2 SAX callbacks, the mmap tokenizer) map element
+ * and attribute names to osmElements and call these functions. Attributes
+ * are passed as an array indexed by osmElement (ID, LAT, REF, ...), where
+ * attributes that are absent have a NULL str. The slices only need to stay
+ * valid for the duration of the call. */
+
+#include "types.h"
+#include "util.h"
+
+/* sets up output for a new document */
+void osm2prolog_startDocument(parseState * state);
+
+/* finishes and closes output for the current document */
+void osm2prolog_endDocument(parseState * state);
+
+/* element is one of OSM, NODE, WAY, ND, TAG, RELATION or MEMBER */
+void osm2prolog_startElement(parseState * state, osmElement element, const osmSlice * attrs);
+
+/* element is one of OSM, NODE, WAY, ND, TAG, RELATION or MEMBER */
+void osm2prolog_endElement(parseState * state, osmElement element);
+
+/* NODE, WAY and ND starts for front-ends that decode numbers rather than
+ * text (the PBF reader): lat and lon are fixed point (OSM_COORD_SCALE), or
+ * OSM_COORD_UNUSABLE when out of range. End them with osm2prolog_endElement
+ * as usual, except for the way nodes, which need no end. */
+void osm2prolog_startNode(parseState * state, int_least64_t id, int32_t lat, int32_t lon);
+void osm2prolog_startWay(parseState * state, int_least64_t id);
+void osm2prolog_addWayNode(parseState * state, int_least64_t ref);
@@ -0,0 +1,300 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "filter.h"
+#include "dict.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* a rule is stored as its priority (lower wins) times two, plus one for
+ * include rules */
+#define NO_RULE UINT32_MAX
+#define RULE(priority, include) ((uint_least32_t)(priority) * 2 + ((include) ? 1 : 0))
+#define INCLUDES(rule) (1 == ((rule) & 1))
+/* the default rules come after any rules that can be added */
+#define DEFAULT_PRIORITY (UINT32_MAX / 4)
+
+/* one byte of the prefixes, 'rule' is the rule of the prefix ending here */
+typedef
+struct trieNode {
+	uint_least32_t rule;
+	uint_least32_t children[256]; /* node index, 0 for none (the root is never a child) */
+}
+trieNode;
+
+/* a key=value rule */
+typedef
+struct valueRule {
+	xmlChar * value;
+	size_t len;
+	uint_least32_t rule;
+	struct valueRule * next;
+}
+valueRule;
+
+struct osmTagFilter {
+	/* exact keys, also those of key=value rules */
+	osmDict * keys;
+	uint_least32_t * keyrules;
+	valueRule ** valuerules;
+	size_t maxkeys;
+
+	trieNode * trie;
+	size_t trienodes;
+	size_t maxtrienodes;
+
+	size_t numrules;
+	bool includes; /* tags without a matching rule are dropped */
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static bool addRule(osmTagFilter * filter, const char * rule, size_t len, uint_least32_t priority, const char * origin);
+static uint_least32_t keyId(osmTagFilter * filter, const char * key, size_t len);
+static void addPrefix(osmTagFilter * filter, const char * prefix, size_t len, uint_least32_t rule);
+static uint_least32_t newTrieNode(osmTagFilter * filter);
+static void setRule(uint_least32_t * slot, uint_least32_t rule);
+
+/************/
+/* creating */
+/************/
+osmTagFilter * osm2prolog_createTagFilter(void) {
+	osmTagFilter * filter = xmlMalloc(sizeof(osmTagFilter));
+
+	filter->keys = osm2prolog_createDict();
+	filter->maxkeys = 64;
+	filter->keyrules = xmlMalloc(filter->maxkeys * sizeof(uint_least32_t));
+	filter->valuerules = xmlMalloc(filter->maxkeys * sizeof(valueRule *));
+	filter->trie = NULL;
+	filter->trienodes = 0;
+	filter->maxtrienodes = 0;
+	filter->numrules = 0;
+	filter->includes = false;
+	newTrieNode(filter);
+
+	addRule(filter, "-created_by", strlen("-created_by"), DEFAULT_PRIORITY, "default rules");
+	addRule(filter, "-note", strlen("-note"), DEFAULT_PRIORITY + 1, "default rules");
+	return filter;
+}
+
+void osm2prolog_freeTagFilter(osmTagFilter * filter) {
+	valueRule * rule;
+	uint_least32_t i;
+
+	for (i = 0; i < osm2prolog_dictSize(filter->keys); ++i) {
+		while ((rule = filter->valuerules[i])) {
+			filter->valuerules[i] = rule->next;
+			xmlFree(rule->value);
+			xmlFree(rule);
+		}
+	}
+	osm2prolog_freeDict(filter->keys);
+	xmlFree(filter->keyrules);
+	xmlFree(filter->valuerules);
+	xmlFree(filter->trie);
+	xmlFree(filter);
+}
+
+bool osm2prolog_addTagRules(osmTagFilter * filter, const char * rules, char separator, const char * origin) {
+	const char * end;
+	bool ok = true;
+
+	for (; *rules; rules = *end ? end + 1 : end) {
+		end = strchr(rules, separator);
+		if (!end)
+			end = rules + strlen(rules);
+		ok = addRule(filter, rules, (size_t)(end - rules), (uint_least32_t)filter->numrules, origin) && ok;
+	}
+	return ok;
+}
+
+bool osm2prolog_addTagRulesFile(osmTagFilter * filter, const char * filename) {
+	FILE * file = fopen(filename, "r");
+	char * text;
+	long size;
+	bool ok;
+
+	if (!file || 0 != fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || 0 != fseek(file, 0, SEEK_SET)) {
+		perror(filename);
+		if (file)
+			fclose(file);
+		return false;
+	}
+	text = xmlMalloc((size_t)size + 1);
+	ok = ((size_t)size == fread(text, 1, (size_t)size, file));
+	fclose(file);
+	if (!ok)
+		fprintf(stderr, "%s: failed to read the tag rules\n", filename);
+	else {
+		text[size] = '\0';
+		ok = osm2prolog_addTagRules(filter, text, '\n', filename);
+	}
+	xmlFree(text);
+	return ok;
+}
+
+/* adds one unparsed rule, ignoring blank ones and comments */
+static bool addRule(osmTagFilter * filter, const char * rule, size_t len, uint_least32_t priority, const char * origin) {
+	const char * equals;
+	bool include = true;
+	uint_least32_t id;
+	valueRule * value;
+
+	while (len > 0 && (' ' == *rule || '\t' == *rule)) {
+		++rule;
+		--len;
+	}
+	while (len > 0 && (' ' == rule[len - 1] || '\t' == rule[len - 1] || '\r' == rule[len - 1]))
+		--len;
+	if (0 == len || '#' == *rule)
+		return true;
+
+	if ('+' == *rule || '-' == *rule) {
+		include = ('+' == *rule);
+		++rule;
+		--len;
+	}
+	equals = memchr(rule, '=', len);
+	if (0 == len || equals == rule) {
+		fprintf(stderr, "%s: tag rule without a key: '%.*s'\n", origin, (int)len, rule);
+		return false;
+	}
+	if (priority < DEFAULT_PRIORITY) {
+		filter->numrules++;
+		filter->includes = filter->includes || include;
+	}
+
+	if (equals) {
+		id = keyId(filter, rule, (size_t)(equals - rule));
+		value = xmlMalloc(sizeof(valueRule));
+		value->len = len - (size_t)(equals + 1 - rule);
+		value->value = xmlMalloc(value->len + 1);
+		memcpy(value->value, equals + 1, value->len);
+		value->rule = RULE(priority, include);
+		/* keep them in rule order, which is the order of addition */
+		value->next = NULL;
+		if (!filter->valuerules[id])
+			filter->valuerules[id] = value;
+		else {
+			valueRule * last = filter->valuerules[id];
+			while (last->next)
+				last = last->next;
+			last->next = value;
+		}
+	}
+	else if ('*' == rule[len - 1])
+		addPrefix(filter, rule, len - 1, RULE(priority, include));
+	else
+		setRule(&filter->keyrules[keyId(filter, rule, len)], RULE(priority, include));
+	return true;
+}
+
+static uint_least32_t keyId(osmTagFilter * filter, const char * key, size_t len) {
+	bool added;
+	uint_least32_t id = osm2prolog_dictIntern(filter->keys, (const unsigned char *)key, len, &added);
+
+	if (added) {
+		if (id == filter->maxkeys) {
+			filter->maxkeys *= 2;
+			filter->keyrules = xmlRealloc(filter->keyrules, filter->maxkeys * sizeof(uint_least32_t));
+			filter->valuerules = xmlRealloc(filter->valuerules, filter->maxkeys * sizeof(valueRule *));
+		}
+		filter->keyrules[id] = NO_RULE;
+		filter->valuerules[id] = NULL;
+	}
+	return id;
+}
+
+static void addPrefix(osmTagFilter * filter, const char * prefix, size_t len, uint_least32_t rule) {
+	uint_least32_t node = 0;
+	uint_least32_t child;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		child = filter->trie[node].children[(unsigned char)prefix[i]];
+		if (0 == child) {
+			/* may move the trie */
+			child = newTrieNode(filter);
+			filter->trie[node].children[(unsigned char)prefix[i]] = child;
+		}
+		node = child;
+	}
+	setRule(&filter->trie[node].rule, rule);
+}
+
+static uint_least32_t newTrieNode(osmTagFilter * filter) {
+	trieNode * node;
+
+	if (filter->trienodes == filter->maxtrienodes) {
+		filter->maxtrienodes = filter->maxtrienodes ? 2 * filter->maxtrienodes : 16;
+		filter->trie = xmlRealloc(filter->trie, filter->maxtrienodes * sizeof(trieNode));
+	}
+	node = &filter->trie[filter->trienodes];
+	node->rule = NO_RULE;
+	memset(node->children, 0, sizeof(node->children));
+	return (uint_least32_t)filter->trienodes++;
+}
+
+/* an earlier rule for the same pattern wins */
+static void setRule(uint_least32_t * slot, uint_least32_t rule) {
+	if (rule < *slot)
+		*slot = rule;
+}
+
+
+
+/************/
+/* matching */
+/************/
+bool osm2prolog_keepTag(const osmTagFilter * filter, osmSlice key, osmSlice value) {
+	uint_least32_t best = NO_RULE;
+	uint_least32_t node = 0;
+	uint_least32_t id;
+	const valueRule * rule;
+	size_t i;
+
+	if (!filter)
+		return !(key.len == strlen("created_by") && 0 == memcmp(key.str, "created_by", key.len))
+			&& !(key.len == strlen("note") && 0 == memcmp(key.str, "note", key.len));
+
+	/* every prefix of the key along the trie */
+	for (i = 0; ; ++i) {
+		if (filter->trie[node].rule < best)
+			best = filter->trie[node].rule;
+		if (i == key.len || 0 == (node = filter->trie[node].children[key.str[i]]))
+			break;
+	}
+
+	if (osm2prolog_dictFind(filter->keys, key.str, key.len, &id)) {
+		if (filter->keyrules[id] < best)
+			best = filter->keyrules[id];
+		for (rule = filter->valuerules[id]; rule && rule->rule < best; rule = rule->next)
+			if (rule->len == value.len && 0 == memcmp(rule->value, value.str, value.len))
+				best = rule->rule;
+	}
+
+	if (NO_RULE == best)
+		return !filter->includes;
+	return INCLUDES(best);
+}
@@ -0,0 +1,57 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Tag filter rules.
+ *
+ * A rule is an optional '+' (include, the default) or '-' (exclude) followed
+ * by a pattern:
+ *
+ *   key         the key itself
+ *   prefix*     every key starting with prefix, so '*' matches all keys
+ *   key=value   the key with exactly this value
+ *
+ * The first matching rule decides; tags no rule matches are dropped if
+ * there are include rules, and kept otherwise. The rules end with
+ * '-created_by' and '-note', which the tool always dropped. Rules are
+ * compiled into a hash table for exact keys and a trie for prefixes, so a
+ * tag is matched in one pass over its key. */
+
+#include "types.h"
+
+#include <stdbool.h>
+
+typedef struct osmTagFilter osmTagFilter;
+
+/* creates a filter with only the default rules */
+osmTagFilter * osm2prolog_createTagFilter(void);
+
+void osm2prolog_freeTagFilter(osmTagFilter * filter);
+
+/* adds the rules in 'rules', separated by 'separator'; whitespace around a
+ * rule and empty rules are ignored, and so are rules starting with '#';
+ * returns false on invalid rules, with an error mentioning 'origin' */
+bool osm2prolog_addTagRules(osmTagFilter * filter, const char * rules, char separator, const char * origin);
+
+/* adds the rules of a file, one per line */
+bool osm2prolog_addTagRulesFile(osmTagFilter * filter, const char * filename);
+
+/* returns whether a tag passes the filter; a NULL filter has only the
+ * default rules */
+bool osm2prolog_keepTag(const osmTagFilter * filter, osmSlice key, osmSlice value);
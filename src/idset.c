@@ -0,0 +1,104 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "idset.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* 2^16 ids, 8 KiB, per page */
+#define PAGE_BITS 16
+#define PAGE_IDS ((uint_least64_t)1 << PAGE_BITS)
+#define PAGE_WORDS (PAGE_IDS / 64)
+
+/* the pages of the non-negative or the negative ids */
+typedef
+struct idPages {
+	uint_least64_t ** pages; /* NULL for pages without ids */
+	size_t numpages;
+}
+idPages;
+
+struct osmIdSet {
+	idPages positive;
+	idPages negative; /* by -id */
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static void freePages(idPages * pages);
+
+/*******/
+/* set */
+/*******/
+osmIdSet * osm2prolog_createIdSet(void) {
+	osmIdSet * set = xmlMalloc(sizeof(osmIdSet));
+
+	memset(set, 0, sizeof(osmIdSet));
+	return set;
+}
+
+void osm2prolog_freeIdSet(osmIdSet * set) {
+	freePages(&set->positive);
+	freePages(&set->negative);
+	xmlFree(set);
+}
+
+void osm2prolog_addId(osmIdSet * set, int_least64_t id) {
+	idPages * pages = (id < 0) ? &set->negative : &set->positive;
+	uint_least64_t index = (id < 0) ? (uint_least64_t)0 - (uint_least64_t)id : (uint_least64_t)id;
+	size_t page = (size_t)(index >> PAGE_BITS);
+	size_t numpages;
+
+	if (page >= pages->numpages) {
+		numpages = pages->numpages ? pages->numpages : 64;
+		while (page >= numpages)
+			numpages *= 2;
+		pages->pages = xmlRealloc(pages->pages, numpages * sizeof(uint_least64_t *));
+		memset(pages->pages + pages->numpages, 0, (numpages - pages->numpages) * sizeof(uint_least64_t *));
+		pages->numpages = numpages;
+	}
+	if (!pages->pages[page]) {
+		pages->pages[page] = xmlMalloc(PAGE_WORDS * sizeof(uint_least64_t));
+		memset(pages->pages[page], 0, PAGE_WORDS * sizeof(uint_least64_t));
+	}
+	index &= PAGE_IDS - 1;
+	pages->pages[page][index / 64] |= (uint_least64_t)1 << (index % 64);
+}
+
+bool osm2prolog_hasId(const osmIdSet * set, int_least64_t id) {
+	const idPages * pages = (id < 0) ? &set->negative : &set->positive;
+	uint_least64_t index = (id < 0) ? (uint_least64_t)0 - (uint_least64_t)id : (uint_least64_t)id;
+	size_t page = (size_t)(index >> PAGE_BITS);
+
+	if (page >= pages->numpages || !pages->pages[page])
+		return false;
+	index &= PAGE_IDS - 1;
+	return 0 != (pages->pages[page][index / 64] & ((uint_least64_t)1 << (index % 64)));
+}
+
+static void freePages(idPages * pages) {
+	size_t i;
+
+	for (i = 0; i < pages->numpages; ++i)
+		xmlFree(pages->pages[i]);
+	xmlFree(pages->pages);
+}
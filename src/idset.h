@@ -0,0 +1,40 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Sets of element ids, as bitmaps indexed by id.
+ *
+ * The bitmap is split in pages that are only allocated once an id in their
+ * range is added, so a set of ids from one region of the world takes memory
+ * in proportion to the id ranges it spans rather than to the largest id.
+ * Negative ids, as used for new elements in editors, get pages of their
+ * own. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct osmIdSet osmIdSet;
+
+osmIdSet * osm2prolog_createIdSet(void);
+
+void osm2prolog_freeIdSet(osmIdSet * set);
+
+void osm2prolog_addId(osmIdSet * set, int_least64_t id);
+
+bool osm2prolog_hasId(const osmIdSet * set, int_least64_t id);
@@ -0,0 +1,544 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input.h"
+#include "elements.h"
+#include "pbf.h"
+#include "sax_callbacks.h"
+#include "stats.h"
+#include "tokenizer.h"
+#include "types.h"
+#include "util.h"
+
+#include <bzlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <libxml/parser.h>
+#include <libxml/xmlmemory.h>
+
+/* decompressed input is handed to the parser in blocks of this size */
+#define BLOCK_SIZE ((size_t)4 * 1024 * 1024)
+/* number of blocks the reader may run ahead of the parser */
+#define NUM_BLOCKS 4
+/* size of the reads from the input file */
+#define RAW_SIZE ((size_t)1024 * 1024)
+/* enough to recognise the compression formats */
+#define MAGIC_SIZE 3
+
+typedef
+enum inputCompression {
+	UNCOMPRESSED,
+	GZIP,
+	BZIP2
+}
+inputCompression;
+
+struct inputStream {
+	const char * filename;
+	int fd;
+	inputCompression compression;
+
+	/* only used by the reader thread (and by openInput before it starts) */
+	char * raw;
+	size_t rawpos;
+	size_t rawlen;
+	bool midstream; /* the decompressor is in the middle of a stream */
+	z_stream zstream;
+	bz_stream bzstream;
+
+	pthread_t reader;
+	bool threaded; /* blocks are read ahead by a reader thread */
+	bool reading; /* the reader thread was started */
+	char * blocks[NUM_BLOCKS];
+	size_t sizes[NUM_BLOCKS];
+	bool holding; /* the parser is using the block at 'consumed' */
+
+	/* protected by lock */
+	size_t filled; /* number of blocks produced by the reader */
+	size_t consumed; /* number of blocks the parser is done with */
+	bool eof;
+	bool failed;
+	bool stopped;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static inputCompression detectCompression(const char * data, size_t size);
+static bool readRaw(inputStream * input, size_t min);
+static bool startDecompression(inputStream * input);
+static ssize_t decompress(inputStream * input, char * dest, size_t cap);
+static ssize_t copyRaw(inputStream * input, char * dest, size_t cap);
+static ssize_t inflateSome(inputStream * input, char * dest, size_t cap);
+static ssize_t bunzipSome(inputStream * input, char * dest, size_t cap);
+static ssize_t fillBlock(inputStream * input, char * block, size_t * size);
+static void * reader(void * arg);
+
+static bool feedTokenizer(parseState * state, inputStream * input, const char * data, size_t size);
+static bool feedXML(parseState * state, inputStream * input, const char * data, size_t size);
+
+/*****************/
+/* the interface */
+/*****************/
+bool osm2prolog_isStreamInput(const char * filename) {
+	char magic[MAGIC_SIZE];
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	if (0 == strcmp(filename, "-"))
+		return true;
+	/* let the regular parsers report files we can't open */
+	if (0 != stat(filename, &st))
+		return false;
+	if (!S_ISREG(st.st_mode))
+		return true;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	len = read(fd, magic, sizeof(magic));
+	close(fd);
+	return len > 0 && UNCOMPRESSED != detectCompression(magic, (size_t)len);
+}
+
+inputStream * osm2prolog_openInput(const char * filename, bool threaded) {
+	inputStream * input = xmlMalloc(sizeof(inputStream));
+	size_t i;
+
+	memset(input, 0, sizeof(inputStream));
+	input->filename = filename;
+	input->fd = (0 == strcmp(filename, "-")) ? STDIN_FILENO : open(filename, O_RDONLY);
+	if (input->fd < 0) {
+		perror(filename);
+		xmlFree(input);
+		return NULL;
+	}
+
+	input->raw = xmlMalloc(RAW_SIZE);
+	if (!readRaw(input, MAGIC_SIZE)) {
+		if (STDIN_FILENO != input->fd)
+			close(input->fd);
+		xmlFree(input->raw);
+		xmlFree(input);
+		return NULL;
+	}
+	input->compression = detectCompression(input->raw, input->rawlen);
+	if (!startDecompression(input)) {
+		fprintf(stderr, "Error: %s: failed to set up decompression.\n", filename);
+		osm2prolog_closeInput(input);
+		return NULL;
+	}
+
+	for (i = 0; i < NUM_BLOCKS; ++i)
+		input->blocks[i] = xmlMalloc(BLOCK_SIZE);
+	pthread_mutex_init(&input->lock, NULL);
+	pthread_cond_init(&input->changed, NULL);
+	input->threaded = threaded;
+	if (!threaded)
+		return input;
+	input->reading = (0 == pthread_create(&input->reader, NULL, reader, input));
+	if (!input->reading) {
+		fprintf(stderr, "Failed to start input reader thread.\n");
+		input->failed = true;
+		input->eof = true;
+	}
+	return input;
+}
+
+int osm2prolog_readInput(inputStream * input, const char ** data, size_t * size) {
+	ssize_t len;
+	int ret;
+
+	/* without a reader thread, the parser reads every block itself */
+	if (!input->threaded) {
+		if (input->eof)
+			return input->failed ? -1 : 0;
+		len = fillBlock(input, input->blocks[0], size);
+		input->failed = len < 0;
+		input->eof = len <= 0;
+		*data = input->blocks[0];
+		if (*size > 0)
+			return 1;
+		return input->failed ? -1 : 0;
+	}
+
+	pthread_mutex_lock(&input->lock);
+	if (input->holding) {
+		++input->consumed;
+		input->holding = false;
+		pthread_cond_broadcast(&input->changed);
+	}
+	while (input->filled == input->consumed && !input->eof)
+		pthread_cond_wait(&input->changed, &input->lock);
+
+	if (input->filled > input->consumed) {
+		*data = input->blocks[input->consumed % NUM_BLOCKS];
+		*size = input->sizes[input->consumed % NUM_BLOCKS];
+		input->holding = true;
+		ret = 1;
+	}
+	else
+		ret = input->failed ? -1 : 0;
+	pthread_mutex_unlock(&input->lock);
+
+	return ret;
+}
+
+void osm2prolog_closeInput(inputStream * input) {
+	size_t i;
+
+	/* the reader thread only exists once the blocks do */
+	if (input->blocks[0]) {
+		pthread_mutex_lock(&input->lock);
+		input->stopped = true;
+		pthread_cond_broadcast(&input->changed);
+		pthread_mutex_unlock(&input->lock);
+		if (input->reading)
+			pthread_join(input->reader, NULL);
+
+		pthread_cond_destroy(&input->changed);
+		pthread_mutex_destroy(&input->lock);
+		for (i = 0; i < NUM_BLOCKS; ++i)
+			xmlFree(input->blocks[i]);
+	}
+
+	if (GZIP == input->compression)
+		inflateEnd(&input->zstream);
+	if (BZIP2 == input->compression)
+		BZ2_bzDecompressEnd(&input->bzstream);
+	if (STDIN_FILENO != input->fd)
+		close(input->fd);
+	xmlFree(input->raw);
+	xmlFree(input);
+}
+
+int osm2prolog_parseStream(parseState * state, const char * filename, osmParser parser) {
+	inputStream * input = osm2prolog_openInput(filename, state->readThread);
+	const char * data = NULL;
+	size_t size = 0;
+	int ret;
+	bool ok;
+
+	if (!input)
+		return -1;
+
+	ret = osm2prolog_readInput(input, &data, &size);
+	if (ret <= 0) {
+		if (0 == ret)
+			fprintf(stderr, "Error: %s: empty input.\n", filename);
+		osm2prolog_closeInput(input);
+		return -1;
+	}
+	if (osm2prolog_isPBF(data, size)) {
+		fprintf(stderr, "Error: %s: PBF input has to be a regular file.\n", filename);
+		osm2prolog_closeInput(input);
+		return -1;
+	}
+	if (MMAP == parser && !osm2prolog_tokenizerSupports(data, size)) {
+		if (!state->quiet)
+			fprintf(stderr, "Note: %s uses XML features the fast tokenizer does not support, using libxml2.\n", filename);
+		parser = LIBXML;
+	}
+
+	if (LIBXML == parser)
+		ok = feedXML(state, input, data, size);
+	else
+		ok = feedTokenizer(state, input, data, size);
+
+	osm2prolog_closeInput(input);
+	return ok ? 0 : -1;
+}
+
+
+
+/***********/
+/* reading */
+/***********/
+static inputCompression detectCompression(const char * data, size_t size) {
+	if (size >= 2 && '\x1f' == data[0] && '\x8b' == data[1])
+		return GZIP;
+	if (size >= 3 && 0 == memcmp(data, "BZh", 3))
+		return BZIP2;
+	return UNCOMPRESSED;
+}
+
+/* refills the raw buffer with at least 'min' bytes, unless the input ends
+ * first; rawlen is 0 at the end of the input */
+static bool readRaw(inputStream * input, size_t min) {
+	ssize_t len;
+
+	input->rawpos = 0;
+	input->rawlen = 0;
+	while (input->rawlen < min) {
+		len = read(input->fd, input->raw + input->rawlen, RAW_SIZE - input->rawlen);
+		if (len < 0 && EINTR == errno)
+			continue;
+		if (len < 0) {
+			perror(input->filename);
+			return false;
+		}
+		if (0 == len)
+			break;
+		input->rawlen += (size_t)len;
+	}
+	/* the progress of a stream is the part of the (compressed) input read */
+	osm2prolog_addProgress(input->rawlen, 0);
+	return true;
+}
+
+/* the decompressors start on the bytes openInput already read */
+static bool startDecompression(inputStream * input) {
+	switch (input->compression) {
+		case GZIP:
+			input->zstream.next_in = (Bytef *)input->raw;
+			input->zstream.avail_in = (uInt)input->rawlen;
+			/* 16: expect a gzip header */
+			return Z_OK == inflateInit2(&input->zstream, 15 + 16);
+		case BZIP2:
+			input->bzstream.next_in = input->raw;
+			input->bzstream.avail_in = (unsigned int)input->rawlen;
+			return BZ_OK == BZ2_bzDecompressInit(&input->bzstream, 0, 0);
+		case UNCOMPRESSED:
+		default:
+			return true;
+	}
+}
+
+/* returns the number of bytes written to dest, 0 at the end of the input or
+ * -1 on errors */
+static ssize_t decompress(inputStream * input, char * dest, size_t cap) {
+	switch (input->compression) {
+		case GZIP:
+			return inflateSome(input, dest, cap);
+		case BZIP2:
+			return bunzipSome(input, dest, cap);
+		case UNCOMPRESSED:
+		default:
+			return copyRaw(input, dest, cap);
+	}
+}
+
+static ssize_t copyRaw(inputStream * input, char * dest, size_t cap) {
+	size_t len;
+	ssize_t ret;
+
+	/* the bytes read to detect the compression */
+	if (input->rawpos < input->rawlen) {
+		len = input->rawlen - input->rawpos;
+		len = (len < cap) ? len : cap;
+		memcpy(dest, input->raw + input->rawpos, len);
+		input->rawpos += len;
+		return (ssize_t)len;
+	}
+
+	do
+		ret = read(input->fd, dest, cap);
+	while (ret < 0 && EINTR == errno);
+	if (ret < 0)
+		perror(input->filename);
+	else
+		osm2prolog_addProgress((uint_least64_t)ret, 0);
+	return ret;
+}
+
+static ssize_t inflateSome(inputStream * input, char * dest, size_t cap) {
+	z_stream * const z = &input->zstream;
+	int ret;
+
+	z->next_out = (Bytef *)dest;
+	z->avail_out = (uInt)cap;
+	while (cap == z->avail_out) {
+		if (0 == z->avail_in) {
+			if (!readRaw(input, 1))
+				return -1;
+			if (0 == input->rawlen) {
+				if (input->midstream)
+					fprintf(stderr, "Error: %s: unexpected end of compressed data.\n", input->filename);
+				return input->midstream ? -1 : 0;
+			}
+			z->next_in = (Bytef *)input->raw;
+			z->avail_in = (uInt)input->rawlen;
+		}
+
+		input->midstream = true;
+		ret = inflate(z, Z_NO_FLUSH);
+		if (Z_STREAM_END == ret) {
+			/* a gzip file may consist of several members */
+			input->midstream = false;
+			if (Z_OK != inflateReset(z))
+				return -1;
+		}
+		else if (Z_OK != ret && Z_BUF_ERROR != ret) {
+			fprintf(stderr, "Error: %s: gzip decompression failed (%s).\n", input->filename, z->msg ? z->msg : "unknown error");
+			return -1;
+		}
+	}
+	return (ssize_t)(cap - z->avail_out);
+}
+
+static ssize_t bunzipSome(inputStream * input, char * dest, size_t cap) {
+	bz_stream * const bz = &input->bzstream;
+	bz_stream saved;
+	int ret;
+
+	bz->next_out = dest;
+	bz->avail_out = (unsigned int)cap;
+	while (cap == bz->avail_out) {
+		if (0 == bz->avail_in) {
+			if (!readRaw(input, 1))
+				return -1;
+			if (0 == input->rawlen) {
+				if (input->midstream)
+					fprintf(stderr, "Error: %s: unexpected end of compressed data.\n", input->filename);
+				return input->midstream ? -1 : 0;
+			}
+			bz->next_in = input->raw;
+			bz->avail_in = (unsigned int)input->rawlen;
+		}
+
+		input->midstream = true;
+		ret = BZ2_bzDecompress(bz);
+		if (BZ_STREAM_END == ret) {
+			/* parallel bzip2 implementations write several streams */
+			input->midstream = false;
+			saved = *bz;
+			BZ2_bzDecompressEnd(bz);
+			if (BZ_OK != BZ2_bzDecompressInit(bz, 0, 0))
+				return -1;
+			bz->next_in = saved.next_in;
+			bz->avail_in = saved.avail_in;
+			bz->next_out = saved.next_out;
+			bz->avail_out = saved.avail_out;
+		}
+		else if (BZ_OK != ret) {
+			fprintf(stderr, "Error: %s: bzip2 decompression failed (error %d).\n", input->filename, ret);
+			return -1;
+		}
+	}
+	return (ssize_t)(cap - bz->avail_out);
+}
+
+/* fills a block as far as the input goes, returns the length of the last
+ * read: 0 at the end of the input, or -1 on errors */
+static ssize_t fillBlock(inputStream * input, char * block, size_t * size) {
+	ssize_t len = 1;
+
+	for (*size = 0; *size < BLOCK_SIZE; *size += (size_t)len) {
+		len = decompress(input, block + *size, BLOCK_SIZE - *size);
+		if (len <= 0)
+			break;
+	}
+	return len;
+}
+
+/* fills blocks until the input ends, waiting whenever all blocks are full */
+static void * reader(void * arg) {
+	inputStream * input = arg;
+	char * block;
+	size_t size;
+	ssize_t len = 1;
+
+	while (len > 0) {
+		pthread_mutex_lock(&input->lock);
+		while (!input->stopped && input->filled - input->consumed >= NUM_BLOCKS)
+			pthread_cond_wait(&input->changed, &input->lock);
+		if (input->stopped) {
+			pthread_mutex_unlock(&input->lock);
+			break;
+		}
+		block = input->blocks[input->filled % NUM_BLOCKS];
+		pthread_mutex_unlock(&input->lock);
+
+		len = fillBlock(input, block, &size);
+
+		pthread_mutex_lock(&input->lock);
+		input->sizes[input->filled % NUM_BLOCKS] = size;
+		if (size > 0)
+			++input->filled;
+		input->failed = len < 0;
+		input->eof = len <= 0;
+		pthread_cond_broadcast(&input->changed);
+		pthread_mutex_unlock(&input->lock);
+	}
+	return NULL;
+}
+
+
+
+/***********/
+/* parsing */
+/***********/
+/* The tokenizer needs complete elements, so every block is tokenized up to
+ * its last top level element, and the rest is kept until the next block
+ * completes it (see osm2prolog_feedTokens). */
+static bool feedTokenizer(parseState * state, inputStream * input, const char * data, size_t size) {
+	osmTokenFeed * feed = osm2prolog_openTokenFeed(state);
+	uint_least64_t elements = 0;
+	int ret = 1;
+	bool ok = true;
+
+	osm2prolog_startDocument(state);
+
+	while (ok && 1 == ret) {
+		ok = osm2prolog_feedTokens(feed, data, size);
+		osm2prolog_addProgress(0, osm2prolog_elementCount(state) - elements);
+		elements = osm2prolog_elementCount(state);
+		if (ok)
+			ret = osm2prolog_readInput(input, &data, &size);
+	}
+
+	ok = osm2prolog_closeTokenFeed(feed, ok && ret >= 0);
+	osm2prolog_endDocument(state);
+	return ok;
+}
+
+static bool feedXML(parseState * state, inputStream * input, const char * data, size_t size) {
+	xmlParserCtxtPtr ctxt;
+	uint_least64_t elements = 0;
+	int ret = 1;
+	bool ok;
+
+	ctxt = osm2prolog_createParser(state, true, input->filename);
+	if (!ctxt) {
+		fprintf(stderr, "Failed to set up a parser for %s.\n", input->filename);
+		return false;
+	}
+
+	while (1 == ret && ctxt->wellFormed) {
+		xmlParseChunk(ctxt, data, (int)size, 0);
+		osm2prolog_addProgress(0, osm2prolog_elementCount(state) - elements);
+		elements = osm2prolog_elementCount(state);
+		ret = osm2prolog_readInput(input, &data, &size);
+	}
+	xmlParseChunk(ctxt, NULL, 0, 1);
+	ok = ctxt->wellFormed && ret >= 0;
+	osm2prolog_freeParser(ctxt);
+
+	return ok;
+}
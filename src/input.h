@@ -0,0 +1,58 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Streaming input: plain, gzip or bzip2 compressed files, and stdin.
+ *
+ * A reader thread reads and decompresses the input with large reads into a
+ * small ring of blocks, so decompression overlaps with parsing while memory
+ * use stays bounded. Without the thread (see -stages), the parser reads
+ * and decompresses every block itself. The compression is detected from
+ * the data itself. */
+
+#include "types.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct inputStream inputStream;
+
+/* checks whether a file has to be read as a stream: stdin ("-"), pipes and
+ * other non regular files, and compressed files */
+bool osm2prolog_isStreamInput(const char * filename);
+
+/* opens a file ("-" for stdin) and starts its reader thread, unless
+ * 'threaded' is false and every osm2prolog_readInput reads the next block
+ * itself; returns NULL on failure */
+inputStream * osm2prolog_openInput(const char * filename, bool threaded);
+
+/* returns the next block of (decompressed) input in data and size, which
+ * stay valid until the next call. Returns 1 if there is a block, 0 at the
+ * end of the input, or -1 on a read or decompression error. */
+int osm2prolog_readInput(inputStream * input, const char ** data, size_t * size);
+
+/* stops the reader thread, if any, and closes the file */
+void osm2prolog_closeInput(inputStream * input);
+
+/* parses a stream with the tokenizer, or with the libxml2 push parser if
+ * 'parser' says so or if the tokenizer can't handle the input, including
+ * the document callbacks; with a reader thread if state->readThread is
+ * set. Returns 0 on success, -1 on failure. */
+int osm2prolog_parseStream(parseState * state, const char * filename, osmParser parser);
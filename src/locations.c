@@ -0,0 +1,156 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "locations.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <libxml/xmlmemory.h>
+
+/* room for the ids below 2^24 at first */
+#define INITIAL_CAPACITY ((size_t)1 << 24)
+
+/* the lat is stored with its sign bit flipped, so that the zeroes of
+ * untouched memory, which would be a valid location, read as
+ * OSM_COORD_UNUSABLE */
+#define ENCODE_LAT(lat) ((uint32_t)(lat) ^ UINT32_C(0x80000000))
+#define DECODE_LAT(word) ((int32_t)((word) ^ UINT32_C(0x80000000)))
+
+typedef
+struct storedLocation {
+	uint32_t lat;
+	int32_t lon;
+}
+storedLocation;
+
+struct osmLocationStore {
+	storedLocation * locations;
+	size_t capacity; /* ids */
+	int fd; /* -1 for anonymous memory */
+	char * filename;
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static bool growStore(osmLocationStore * store, size_t capacity);
+
+/*********/
+/* store */
+/*********/
+osmLocationStore * osm2prolog_openLocationStore(const char * filename) {
+	osmLocationStore * store = xmlMalloc(sizeof(osmLocationStore));
+	size_t size = INITIAL_CAPACITY * sizeof(storedLocation);
+
+	store->capacity = INITIAL_CAPACITY;
+	store->fd = -1;
+	store->filename = NULL;
+	if (filename) {
+		/* never an existing file, which this would overwrite; the name is
+		 * removed right away, so that nothing is left behind on a crash */
+		store->fd = open(filename, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (store->fd < 0) {
+			if (EEXIST == errno)
+				fprintf(stderr, "Error: location store '%s' already exists, refusing to overwrite it.\n", filename);
+			else
+				perror(filename);
+			xmlFree(store);
+			return NULL;
+		}
+		unlink(filename);
+		if (0 != ftruncate(store->fd, (off_t)size)) {
+			perror(filename);
+			close(store->fd);
+			xmlFree(store);
+			return NULL;
+		}
+		store->filename = (char *)xmlCharStrdup(filename);
+		store->locations = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+	}
+	else
+		store->locations = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (MAP_FAILED == store->locations) {
+		perror("location store");
+		store->locations = NULL;
+		osm2prolog_closeLocationStore(store);
+		return NULL;
+	}
+	return store;
+}
+
+void osm2prolog_closeLocationStore(osmLocationStore * store) {
+	if (store->locations)
+		munmap(store->locations, store->capacity * sizeof(storedLocation));
+	if (store->fd >= 0)
+		close(store->fd);
+	xmlFree(store->filename);
+	xmlFree(store);
+}
+
+bool osm2prolog_setLocation(osmLocationStore * store, int_least64_t id, int32_t lat, int32_t lon) {
+	size_t capacity = store->capacity;
+
+	if (id < 0)
+		return true;
+	if ((uint_least64_t)id >= SIZE_MAX / 2 / sizeof(storedLocation))
+		return false;
+	if ((size_t)id >= capacity) {
+		while ((size_t)id >= capacity)
+			capacity *= 2;
+		if (!growStore(store, capacity))
+			return false;
+	}
+	store->locations[id].lat = ENCODE_LAT(lat);
+	store->locations[id].lon = lon;
+	return true;
+}
+
+bool osm2prolog_getLocation(const osmLocationStore * store, int_least64_t id, int32_t * lat, int32_t * lon) {
+	if (id < 0 || (uint_least64_t)id >= store->capacity)
+		return false;
+	*lat = DECODE_LAT(store->locations[id].lat);
+	*lon = store->locations[id].lon;
+	return OSM_COORD_UNUSABLE != *lat && OSM_COORD_UNUSABLE != *lon;
+}
+
+static bool growStore(osmLocationStore * store, size_t capacity) {
+	size_t oldsize = store->capacity * sizeof(storedLocation);
+	size_t newsize = capacity * sizeof(storedLocation);
+	void * locations;
+
+	if (store->fd >= 0 && 0 != ftruncate(store->fd, (off_t)newsize)) {
+		perror(store->filename);
+		return false;
+	}
+	locations = mremap(store->locations, oldsize, newsize, MREMAP_MAYMOVE);
+	if (MAP_FAILED == locations) {
+		perror("location store");
+		return false;
+	}
+	store->locations = locations;
+	store->capacity = capacity;
+	return true;
+}
@@ -0,0 +1,48 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Node locations by id, for writing way geometries in one pass.
+ *
+ * The store is a flat array of fixed point (lat, lon) int32 pairs indexed
+ * by node id, which is grown with mremap as larger ids come along. It is
+ * either anonymous memory or a file, which is extended with ftruncate so
+ * that the ranges without nodes stay holes; a file lets the kernel write
+ * the store out at planet scale instead of keeping it in memory. Either way
+ * only the pages holding locations take up space. Negative ids have no
+ * location. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct osmLocationStore osmLocationStore;
+
+/* opens a store in memory, or in a new file with that name when it is not
+ * NULL; an existing file is refused, and the new one is unlinked as soon as
+ * it is open. Returns NULL on failure. */
+osmLocationStore * osm2prolog_openLocationStore(const char * filename);
+
+void osm2prolog_closeLocationStore(osmLocationStore * store);
+
+/* stores a location in fixed point (see OSM_COORD_SCALE), returns false if
+ * the store could not grow; negative ids are ignored */
+bool osm2prolog_setLocation(osmLocationStore * store, int_least64_t id, int32_t lat, int32_t lon);
+
+/* returns false for nodes without a usable location */
+bool osm2prolog_getLocation(const osmLocationStore * store, int_least64_t id, int32_t * lat, int32_t * lon);
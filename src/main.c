@@ -16,73 +16,621 @@
  * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "binary.h"
+#include "filter.h"
+#include "input.h"
+#include "locations.h"
+#include "output.h"
+#include "parallel.h"
+#include "pbf.h"
+#include "pgcopy.h"
+#include "print.h"
+#include "region.h"
 #include "sax_callbacks.h"
+#include "shard.h"
+#include "sort.h"
+#include "stats.h"
+#include "tagdict.h"
+#include "tokenizer.h"
 #include "types.h"
 #include "util.h"
 
-#include <assert.h>
 #include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-/* TODO decent option parsing (libpopt or so) */
-
-void setPrintConfig(char * argv[], parseState * state);
+void usage(const char * exec);
+void setPrintConfig(const char * prefix, osmPrintMode mode, parseState * state, size_t sortmemory, long dictvalues, osmTagDict ** dict);
 char * strconcat(const char * prefix, const char * infix, const char * suffix);
-FILE * openPrintFile(const char * prefix, const char * suffix);
+osmOutput * openPrintFile(const parseState * state, const char * prefix, const char * suffix);
+osmOutput * openSharedFile(const parseState * state, const char * prefix, const char * suffix);
+osmOutput * openFile(const parseState * state, char * filename);
+osmOutput * sortInto(osmOutput * dest, const char * prefix, const char * suffix, osmRecordPrinter print, size_t memory);
+void setPrologConfig(const char * prefix, bool split, bool declare, parseState * state, long dictvalues, osmTagDict ** dict);
+osmOutput * openSpoolFile(osmOutput * dest, const char * tmpprefix);
+bool parseStages(const char * layout, bool threads[3]);
 
 /* main */
 int main(int argc, char * argv[]) {
+	static const struct option longopts[] = {
+		{"tbl", required_argument, NULL, 't'},
+		{"bin", required_argument, NULL, 'b'},
+		{"pgcopy", required_argument, NULL, 'y'},
+		{"pl", required_argument, NULL, 'l'},
+		{"contiguous", no_argument, NULL, 'c'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"parser", required_argument, NULL, 'p'},
+		{"async", no_argument, NULL, 'a'},
+		{"stages", required_argument, NULL, 'T'},
+		{"sorted", no_argument, NULL, 's'},
+		{"sortmem", required_argument, NULL, 'm'},
+		{"tagdict", no_argument, NULL, 'd'},
+		{"dictvalues", required_argument, NULL, 'v'},
+		{"tags", required_argument, NULL, 'g'},
+		{"tagfile", required_argument, NULL, 'f'},
+		{"dropuntagged", no_argument, NULL, 'u'},
+		{"bbox", required_argument, NULL, 'x'},
+		{"polygon", required_argument, NULL, 'o'},
+		{"geometry", no_argument, NULL, 'e'},
+		{"locations", required_argument, NULL, 'n'},
+		{"stats", no_argument, NULL, 'S'},
+		{"statsfile", required_argument, NULL, 'J'},
+		{"progress", required_argument, NULL, 'P'},
+		{"precision", required_argument, NULL, 'r'},
+		{"change", no_argument, NULL, 'C'},
+		{"checkpoint", required_argument, NULL, 'k'},
+		{"checkpointinterval", required_argument, NULL, 'i'},
+		{"resume", no_argument, NULL, 'R'},
+		{"shards", required_argument, NULL, 'h'},
+		{"shardrange", required_argument, NULL, 'H'},
+		{NULL, 0, NULL, 0}
+	};
 	int error;
+	int opt;
+	char * endptr;
+	long jobs = 1;
+	osmParser parser = MMAP;
+	/* after reading, parsing and formatting: the next stage has a thread of its own */
+	bool stagethreads[3] = { true, false, false };
+	bool sorted = false;
+	long sortmem = 1024;
+	bool tagdict = false;
+	long dictvalues = 1000;
+	char * tableprefix = NULL;
+	char * binaryprefix = NULL;
+	char * pgcopyprefix = NULL;
+	char * prologprefix = NULL;
+	bool contiguous = false;
 	char * xmlfilename = NULL;
+	osmTagFilter * tagfilter = osm2prolog_createTagFilter();
+	osmRegion * region = NULL;
+	osmIdSet * regionnodes = NULL;
+	bool geometry = false;
+	char * locationfile = NULL;
+	bool stats = false;
+	char * statsfile = NULL;
+	long progress = 0;
+	long precision = 0;
+	bool changes = false;
+	char * checkpointfile = NULL;
+	long checkpointinterval = 60;
+	bool resume = false;
+	long shards = 1;
+	long long shardrange = 0;
+	osmTagDict * dict = NULL;
+	bool parallel = false;
+	uint_least64_t parsestart;
+	struct stat info;
 
 	parseState * state = osm2prolog_createParseState();
 
 	fprintf(stderr, "osm2prolog v0.2 - usage and license: see the 'README' and 'COPYING' files.\n");
 
-	/* exec <osm xml filename> || exec -tbl <filename prefix> <osm xml filename> */
-	assert(argc == 2 || argc == 4);
+	/* exec [-tbl|-bin|-pgcopy <filename prefix> [-sorted [-sortmem <MiB>]] | -pl <filename prefix> | -contiguous]
+	 *      [-tagdict [-dictvalues <n>]] [-tags <rule>[,<rule>...]] [-tagfile <rules file>] [-dropuntagged]
+	 *      [-bbox <minlon,minlat,maxlon,maxlat>] [-polygon <poly file>]
+	 *      [-geometry [-locations <store file>]] [-j <threads>] [-parser mmap|libxml] [-async] [-stages <layout>]
+	 *      [-stats] [-statsfile <json file>] [-progress <seconds>] [-precision <decimals>] [-change]
+	 *      [-checkpoint <file> [-checkpointinterval <seconds>] [-resume]]
+	 *      [-shards <n> [-shardrange <ids>]]
+	 *      <osm xml or pbf filename, or - for stdin>
+	 * with -stages, reading, parsing, formatting and writing run on the threads
+	 * <layout> puts them on: the four stages in this order, with a '/' before
+	 * a stage that has a thread of its own and a '+' before one that runs on
+	 * the same thread, e.g. read/parse/format/write for four threads; the
+	 * default is read/parse+format+write, -async is read/parse+format/write,
+	 * and only streamed inputs are read by a thread of their own;
+	 * with -pgcopy, the tables are <prefix>_node.pgcopy and so on, to load
+	 * into PostgreSQL with COPY ... WITH (FORMAT binary), see pgcopy.h;
+	 * with -locations, -geometry keeps the node locations in <store file>, which
+	 * must not exist yet and is removed as soon as it is opened, instead of
+	 * in memory;
+	 * with -change, the input is an osmChange file and the output applies it to
+	 * an earlier conversion: prolog retractall and assertz directives, to
+	 * consult after the conversion, whose predicates are declared dynamic, or
+	 * tables of the rows to insert and <prefix>_node_delete and
+	 * <prefix>_way_delete tables of the ids to delete first, but no way
+	 * geometries, which need the nodes of the earlier conversion;
+	 * with -checkpoint, a conversion to -tbl or -pl files can continue where
+	 * it was interrupted with -resume and otherwise the same arguments;
+	 * with -shards, the -tbl or -pl files are split in <n> sets of files,
+	 * <prefix>_node.<k> or <prefix>_node.<k>.pl and so on, that each take the
+	 * nodes and ways of some ids with their tags: ids hashed to shards, or
+	 * with -shardrange, <ids> consecutive ids per shard; the -tagdict
+	 * dictionaries are shared, in <prefix>_tagkey_dict and so on */
+	while (-1 != (opt = getopt_long_only(argc, argv, "j:", longopts, NULL))) {
+		switch (opt) {
+			case 't':
+				tableprefix = optarg;
+				break;
+			case 'b':
+				binaryprefix = optarg;
+				break;
+			case 'y':
+				pgcopyprefix = optarg;
+				break;
+			case 'l':
+				prologprefix = optarg;
+				break;
+			case 'c':
+				contiguous = true;
+				break;
+			case 'j':
+				errno = 0;
+				jobs = strtol(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || jobs < 1 || jobs > 1024) {
+					fprintf(stderr, "invalid number of threads: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 'p':
+				if (0 == strcmp(optarg, "mmap"))
+					parser = MMAP;
+				else if (0 == strcmp(optarg, "libxml"))
+					parser = LIBXML;
+				else {
+					fprintf(stderr, "unknown parser: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 'a':
+				stagethreads[2] = true;
+				break;
+			case 'T':
+				if (!parseStages(optarg, stagethreads)) {
+					fprintf(stderr, "invalid stage layout: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 's':
+				sorted = true;
+				break;
+			case 'm':
+				errno = 0;
+				sortmem = strtol(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || sortmem < 4 || (unsigned long)sortmem > SIZE_MAX / 1024 / 1024) {
+					fprintf(stderr, "invalid sort memory size: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 'd':
+				tagdict = true;
+				break;
+			case 'v':
+				errno = 0;
+				dictvalues = strtol(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || dictvalues < 0) {
+					fprintf(stderr, "invalid number of dictionary values: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 'g':
+				if (!osm2prolog_addTagRules(tagfilter, optarg, ',', "-tags"))
+					usage(argv[0]);
+				break;
+			case 'f':
+				if (!osm2prolog_addTagRulesFile(tagfilter, optarg))
+					usage(argv[0]);
+				break;
+			case 'u':
+				state->dropUntagged = true;
+				break;
+			case 'x':
+				region = region ? region : osm2prolog_createRegion();
+				if (!osm2prolog_setRegionBox(region, optarg)) {
+					fprintf(stderr, "invalid bounding box: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 'o':
+				region = region ? region : osm2prolog_createRegion();
+				if (!osm2prolog_setRegionPolygon(region, optarg))
+					usage(argv[0]);
+				break;
+			case 'e':
+				geometry = true;
+				break;
+			case 'n':
+				geometry = true;
+				locationfile = optarg;
+				break;
+			case 'S':
+				stats = true;
+				break;
+			case 'J':
+				stats = true;
+				statsfile = optarg;
+				break;
+			case 'P':
+				errno = 0;
+				progress = strtol(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || progress < 1 || progress > 86400) {
+					fprintf(stderr, "invalid progress interval: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 'r':
+				errno = 0;
+				precision = strtol(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || precision < 1 || precision > 7) {
+					fprintf(stderr, "invalid coordinate precision: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				state->precision = (unsigned int)precision;
+				break;
+			case 'C':
+				changes = true;
+				break;
+			case 'k':
+				checkpointfile = optarg;
+				break;
+			case 'i':
+				errno = 0;
+				checkpointinterval = strtol(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || checkpointinterval < 1 || checkpointinterval > 86400) {
+					fprintf(stderr, "invalid checkpoint interval: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 'R':
+				resume = true;
+				break;
+			case 'h':
+				errno = 0;
+				shards = strtol(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || shards < 1 || shards > 1024) {
+					fprintf(stderr, "invalid number of shards: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			case 'H':
+				errno = 0;
+				shardrange = strtoll(optarg, &endptr, 10);
+				if (0 != errno || '\0' != *endptr || shardrange < 1) {
+					fprintf(stderr, "invalid shard range: '%s'\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	/* at most one output format */
+	if (optind != argc - 1 || (!!tableprefix + !!binaryprefix + !!pgcopyprefix + !!prologprefix + contiguous) > 1)
+		usage(argv[0]);
+	xmlfilename = argv[optind];
+	state->tagfilter = tagfilter;
+	if ((binaryprefix || pgcopyprefix) && geometry) {
+		fprintf(stderr, "Note: -bin and -pgcopy have no way geometries, ignoring -geometry.\n");
+		geometry = false;
+	}
+	if (changes && (binaryprefix || pgcopyprefix || region)) {
+		fprintf(stderr, "-change can't write -bin or -pgcopy tables, and can't keep to a -bbox or -polygon: "
+				"which ways those keep depends on all nodes of the earlier conversion\n");
+		usage(argv[0]);
+	}
+	if (changes && geometry) {
+		fprintf(stderr, "-change can't write -geometry: the locations of the nodes a change "
+				"does not touch are only in the earlier conversion\n");
+		usage(argv[0]);
+	}
+	state->changes = changes;
+	/* checkpoints need the input in slices, and outputs that only depend on
+	 * what was read before them */
+	if (resume && !checkpointfile) {
+		fprintf(stderr, "-resume needs the -checkpoint file\n");
+		usage(argv[0]);
+	}
+	if (checkpointfile && (osm2prolog_isStreamInput(xmlfilename) || !(tableprefix || prologprefix)
+				|| sorted || tagdict || region || geometry)) {
+		fprintf(stderr, "-checkpoint needs an uncompressed regular file and -tbl or -pl files, "
+				"without -sorted, -tagdict, -bbox, -polygon or -geometry\n");
+		usage(argv[0]);
+	}
+	/* every shard is a set of files of its own */
+	if (shards > 1 && !(tableprefix || prologprefix)) {
+		fprintf(stderr, "-shards needs -tbl or -pl files\n");
+		usage(argv[0]);
+	}
+	if (shardrange > 0 && shards < 2) {
+		fprintf(stderr, "-shardrange needs -shards\n");
+		usage(argv[0]);
+	}
+	if (geometry && !(state->locations = osm2prolog_openLocationStore(locationfile)))
+		exit(EXIT_FAILURE);
+	/* ways need the nodes of all earlier chunks, so these are parsed in order */
+	if (region) {
+		state->region = region;
+		state->regionnodes = regionnodes = osm2prolog_createIdSet();
+	}
+	if ((region || geometry) && jobs > 1) {
+		fprintf(stderr, "Note: -bbox, -polygon and -geometry need the nodes before the ways, ignoring -j.\n");
+		jobs = 1;
+	}
+	if (checkpointfile && (jobs > 1 || LIBXML == parser)) {
+		fprintf(stderr, "Note: checkpoints are written by the tokenizer in one thread, ignoring -j and -parser libxml.\n");
+		jobs = 1;
+		parser = MMAP;
+	}
+	if (changes && jobs > 1) {
+		fprintf(stderr, "Note: -change applies the changes in order, ignoring -j.\n");
+		jobs = 1;
+	}
+	if (stagethreads[1] && jobs > 1) {
+		fprintf(stderr, "Note: the threads of -j format what they parse, formatting on the parser's thread.\n");
+		stagethreads[1] = false;
+	}
+	state->readThread = stagethreads[0];
+	state->formatThread = stagethreads[1];
+
+	if (binaryprefix && tagdict) {
+		fprintf(stderr, "Note: -bin always encodes tags with dictionaries, ignoring -tagdict.\n");
+		tagdict = false;
+	}
+	if (pgcopyprefix && tagdict) {
+		fprintf(stderr, "Note: -pgcopy writes the tags as text, ignoring -tagdict.\n");
+		tagdict = false;
+	}
+	if (changes && tagdict) {
+		fprintf(stderr, "Note: the dictionary ids of a change would not match those of the earlier conversion, ignoring -tagdict.\n");
+		tagdict = false;
+	}
+	/* -1 for no tag dictionary */
+	if (!tagdict)
+		dictvalues = -1;
+
+	if (checkpointfile && !(state->checkpoint = osm2prolog_openCheckpoint(checkpointfile, xmlfilename,
+					(unsigned int)checkpointinterval, resume)))
+		exit(EXIT_FAILURE);
+
+	/* outputs opened from here on are written by the writer thread */
+	if (stagethreads[2])
+		osm2prolog_startWriter();
 
 	state->printMode = PL;
-	if (argc == 4) {
+	if (tableprefix && !sorted)
 		fprintf(stderr, "Note: %s produces completely unsorted tables. "
-				"If you would like to have the table sorted according to some column, "
-				"something amongst these lines might prove to be useful:\n"
+				"If you would like to have the tables sorted on their first column, "
+				"use -sorted, or something amongst these lines might prove to be useful:\n"
 				"\tsort -s -t\"$(echo -e '\t')\" -k1n,1\n",
 				argv[0]);
-		setPrintConfig(argv, state);
-		xmlfilename = argv[3];
+	else if (!tableprefix && !binaryprefix && !pgcopyprefix && sorted)
+		fprintf(stderr, "Note: -sorted only applies to tables (-tbl, -bin or -pgcopy), ignoring it.\n");
+	/* the outputs of every shard are set up like those of a conversion
+	 * without shards, which share the sort memory and the tag dictionary */
+	if (shards > 1)
+		state->shards = osm2prolog_createShards((unsigned int)shards, (uint_least64_t)shardrange);
+	do {
+		if (tableprefix)
+			setPrintConfig(tableprefix, TABLE, state, sorted ? (size_t)sortmem * 1024 * 1024 / (size_t)shards : 0, dictvalues, &dict);
+		else if (binaryprefix)
+			setPrintConfig(binaryprefix, BINARY, state, sorted ? (size_t)sortmem * 1024 * 1024 : 0, -1, &dict);
+		else if (pgcopyprefix)
+			setPrintConfig(pgcopyprefix, PGCOPY, state, sorted ? (size_t)sortmem * 1024 * 1024 : 0, -1, &dict);
+		/* the facts of a change are asserted, and a resumed conversion has
+		 * written its declarations before */
+		if (PL == state->printMode)
+			setPrologConfig(prologprefix, prologprefix || contiguous, !changes && !resume, state, dictvalues, &dict);
+		if (state->shards)
+			osm2prolog_addShard(state);
+	} while (state->shards && osm2prolog_nextShard(state->shards) < osm2prolog_shardCount(state->shards));
+	/* the encoders keep the dictionary */
+	if (dict)
+		osm2prolog_releaseTagDict(dict);
+
+	xmlInitParser();
+	osm2prolog_init();
+
+	/* the size of the input is only known for regular files */
+	if (stats || progress > 0) {
+		osm2prolog_startStats((0 == stat(xmlfilename, &info) && S_ISREG(info.st_mode)) ? (uint_least64_t)info.st_size : 0,
+				(unsigned int)progress);
+		state->timePhases = stats;
 	}
+	parsestart = osm2prolog_now();
 
-	if (argc == 2)
-		xmlfilename = argv[1];
+	/* the PBF reader and the tokenizer return 1 for inputs they leave to libxml2 */
+	error = 1;
+	if (osm2prolog_isStreamInput(xmlfilename)) {
+		if (jobs > 1)
+			fprintf(stderr, "Note: -j needs an uncompressed regular file, %s is read as a stream instead.\n", xmlfilename);
+		error = osm2prolog_parseStream(state, xmlfilename, parser);
+	}
+	else if (jobs > 1) {
+		parallel = true;
+		error = osm2prolog_parseParallel(state, xmlfilename, (unsigned int)jobs, parser);
+	}
+	else {
+		error = osm2prolog_parsePBFFile(state, xmlfilename);
+		if (1 == error && MMAP == parser)
+			error = osm2prolog_parseMappedFile(state, xmlfilename);
+	}
+	/* libxml2 parses without checkpoints, so it can't resume either */
+	if (1 == error && resume) {
+		fprintf(stderr, "%s: can't resume, this input needs libxml2.\n", xmlfilename);
+		error = -1;
+	}
+	if (1 == error)
+		error = osm2prolog_parseXMLFile(state, xmlfilename);
+
+	/* outputs are normally closed at the end of the document already */
+	if (!osm2prolog_closeOutputs(state))
+		state->outputfailed = true;
+	if (state->outputfailed)
+		error = -1;
 
-	error = xmlSAXUserParseFile(&osm2prolog, state, xmlfilename);
+	/* parallel workers report their own time, without the writing */
+	if (!parallel)
+		osm2prolog_addParseTime(osm2prolog_now() - parsestart, true);
+	if (stats && !osm2prolog_reportStats(state, xmlfilename, statsfile))
+		error = -1;
+
+	osm2prolog_cleanup();
 	xmlCleanupParser();
+	if (state->locations)
+		osm2prolog_closeLocationStore(state->locations);
+	if (state->checkpoint)
+		osm2prolog_closeCheckpoint(state->checkpoint, 0 == error);
 	osm2prolog_freeParseState(state);
+	osm2prolog_freeTagFilter(tagfilter);
+	if (region) {
+		osm2prolog_freeIdSet(regionnodes);
+		osm2prolog_freeRegion(region);
+	}
+	osm2prolog_stopWriter();
 
-	if (error < 0)
+	if (0 != error)
 		return EXIT_FAILURE;
 	else
 		return EXIT_SUCCESS;
 }
 
-void setPrintConfig(char * argv[], parseState * state) {
-	/* argv: exec -tbl <filename prefix> <osm xml filename> */
-	const char * prefix = argv[2];
+void usage(const char * exec) {
+	fprintf(stderr, "usage: %s [-tbl|-bin|-pgcopy <filename prefix> [-sorted [-sortmem <MiB>]] | -pl <filename prefix> | -contiguous] [-tagdict [-dictvalues <n>]] [-tags <rule>[,<rule>...]] [-tagfile <rules file>] [-dropuntagged] [-bbox <minlon,minlat,maxlon,maxlat>] [-polygon <poly file>] [-geometry [-locations <store file>]] [-j <threads>] [-parser mmap|libxml] [-async] [-stages <layout>] [-stats] [-statsfile <json file>] [-progress <seconds>] [-precision <decimals>] [-change] [-checkpoint <file> [-checkpointinterval <seconds>] [-resume]] [-shards <n> [-shardrange <ids>]] <input.osm[.gz|.bz2]|input.osm.pbf|input.osc[.gz|.bz2]|->\n", exec);
+	exit(EXIT_FAILURE);
+}
+
+/* sets up TABLE, BINARY or PGCOPY output; a sortmemory of 0 writes unsorted tables,
+ * otherwise it is shared by the four sorted tables; a dictvalues of -1
+ * writes the tags as they are, otherwise they are dictionary encoded with
+ * *dict, which is created first if it is NULL, so that shards share it */
+void setPrintConfig(const char * prefix, osmPrintMode mode, parseState * state, size_t sortmemory, long dictvalues, osmTagDict ** dict) {
+	osmOutput * tables[4];
+	size_t memory = sortmemory / 4;
+	osmRecordPrinter printTags = printTagRecord;
 
-	if (0 == strcmp(argv[1], "-tbl")) {
-		state->printMode = TABLE;
+	state->printMode = mode;
+	state->tableRecords = (BINARY == mode) || (PGCOPY == mode) || (sortmemory > 0);
 
-		state->node_file = openPrintFile(prefix, "node");
-		state->way_file = openPrintFile(prefix, "way");
-		state->nodetag_file = openPrintFile(prefix, "nodetag");
-		state->waytag_file = openPrintFile(prefix, "waytag");
+	if (BINARY == mode || PGCOPY == mode) {
+		if (!((BINARY == mode) ? osm2prolog_openBinaryTables : osm2prolog_openCopyTables)(prefix, &tables[0], &tables[1], &tables[2], &tables[3]))
+			exit(EXIT_FAILURE);
+		state->node_file = tables[0];
+		state->way_file = tables[1];
+		state->nodetag_file = tables[2];
+		state->waytag_file = tables[3];
+		/* the binary and COPY tables take the sorted records as they are */
+		if (sortmemory > 0) {
+			state->node_file = sortInto(tables[0], prefix, "node", osm2prolog_copyRecord, memory);
+			state->way_file = sortInto(tables[1], prefix, "way", osm2prolog_copyRecord, memory);
+			state->nodetag_file = sortInto(tables[2], prefix, "nodetag", osm2prolog_copyRecord, memory);
+			state->waytag_file = sortInto(tables[3], prefix, "waytag", osm2prolog_copyRecord, memory);
+		}
+		return;
+	}
+
+	state->node_file = openPrintFile(state, prefix, "node");
+	state->way_file = openPrintFile(state, prefix, "way");
+	state->nodetag_file = openPrintFile(state, prefix, "nodetag");
+	state->waytag_file = openPrintFile(state, prefix, "waytag");
+	if (state->changes) {
+		state->nodedelete_file = openPrintFile(state, prefix, "node_delete");
+		state->waydelete_file = openPrintFile(state, prefix, "way_delete");
+	}
+
+	/* the encoders take the (sorted) tag records as they are */
+	if (dictvalues >= 0) {
+		state->tagRecords = true;
+		printTags = osm2prolog_copyRecord;
+		if (!*dict)
+			*dict = osm2prolog_createTagDict(TABLE, openSharedFile(state, prefix, "tagkey_dict"), openSharedFile(state, prefix, "tagvalue_dict"),
+					true, (size_t)dictvalues);
+		state->nodetag_file = osm2prolog_openTagEncoder(*dict, state->nodetag_file, true, NULL);
+		state->waytag_file = osm2prolog_openTagEncoder(*dict, state->waytag_file, true, NULL);
+	}
+
+	if (sortmemory > 0) {
+		state->node_file = sortInto(state->node_file, prefix, "node", printNodeRecord, memory);
+		state->way_file = sortInto(state->way_file, prefix, "way", state->locations ? printWayGeomRecord : printWayRecord, memory);
+		state->nodetag_file = sortInto(state->nodetag_file, prefix, "nodetag", printTags, memory);
+		state->waytag_file = sortInto(state->waytag_file, prefix, "waytag", printTags, memory);
+	}
+}
+
+/* with 'split', writes every predicate contiguously, in clause order: to
+ * <prefix>_<predicate>.pl files, or with a NULL prefix to stdout, with the
+ * ways and tags spooled to temporary files until the nodes are done;
+ * with 'declare', every output starts by declaring its predicates dynamic,
+ * and multifile for the files of a shard; a dictvalues of -1 writes the tags
+ * as they are, otherwise they are dictionary encoded with *dict, which is
+ * created first if it is NULL, so that shards share it */
+void setPrologConfig(const char * prefix, bool split, bool declare, parseState * state, long dictvalues, osmTagDict ** dict) {
+	const char * tmpdir = getenv("TMPDIR");
+	char * tmpprefix = strconcat((tmpdir && *tmpdir) ? tmpdir : "/tmp", "/", "osm2prolog.");
+	osmOutput * keys;
+	osmOutput * values;
+	const bool multifile = (NULL != state->shards);
+
+	state->printMode = PL;
+	state->splitPredicates = split;
+
+	if (!split) {
+		state->prolog_file = osm2prolog_openOutputFd(STDOUT_FILENO);
+		keys = values = state->prolog_file;
+	}
+	else if (prefix) {
+		state->prolog_file = openPrintFile(state, prefix, "node.pl");
+		state->way_file = openPrintFile(state, prefix, "way.pl");
+		state->nodetag_file = openPrintFile(state, prefix, "node_tag.pl");
+		state->waytag_file = openPrintFile(state, prefix, "way_tag.pl");
+		state->waygeom_file = state->locations ? openPrintFile(state, prefix, "way_geom.pl") : NULL;
+		keys = (dictvalues >= 0 && !*dict) ? openSharedFile(state, prefix, "tagkey_dict.pl") : NULL;
+		values = (dictvalues >= 0 && !*dict) ? openSharedFile(state, prefix, "tagvalue_dict.pl") : NULL;
+		if (declare) {
+			printDeclaration(state->prolog_file, "node/3", multifile);
+			printDeclaration(state->way_file, "way/2", multifile);
+			printDeclaration(state->nodetag_file, "node_tag/3", multifile);
+			printDeclaration(state->waytag_file, "way_tag/3", multifile);
+			if (state->waygeom_file)
+				printDeclaration(state->waygeom_file, "way_geom/2", multifile);
+		}
 	}
 	else {
-		fprintf(stderr, "usage: %s [-tbl <filename prefix>] <input.xml>\n", argv[0]);
-		fprintf(stderr, "was invoked as \"'%s' '%s' '%s' '%s'\"\n'", argv[0], argv[1], argv[2], argv[3]);
-		osm2prolog_freeParseState(state);
-		exit(EXIT_FAILURE);
+		state->prolog_file = osm2prolog_openOutputFd(STDOUT_FILENO);
+		state->way_file = openSpoolFile(state->prolog_file, tmpprefix);
+		state->nodetag_file = openSpoolFile(state->prolog_file, tmpprefix);
+		state->waytag_file = openSpoolFile(state->prolog_file, tmpprefix);
+		state->waygeom_file = state->locations ? openSpoolFile(state->prolog_file, tmpprefix) : NULL;
+		keys = (dictvalues >= 0) ? openSpoolFile(state->prolog_file, tmpprefix) : NULL;
+		values = (dictvalues >= 0) ? openSpoolFile(state->prolog_file, tmpprefix) : NULL;
+	}
+	free(tmpprefix);
+	if (declare && !(split && prefix))
+		printDeclaration(state->prolog_file, state->locations
+				? "node/3, way/2, node_tag/3, way_tag/3, way_geom/2" : "node/3, way/2, node_tag/3, way_tag/3", false);
+
+	/* without 'split', everything goes to stdout, which the encoders and the
+	 * dictionary leave open */
+	if (dictvalues >= 0) {
+		state->tagRecords = true;
+		if (!*dict)
+			*dict = osm2prolog_createTagDict(PL, keys, values, split, (size_t)dictvalues);
+		state->nodetag_file = osm2prolog_openTagEncoder(*dict, split ? state->nodetag_file : state->prolog_file, split, "node_tag");
+		state->waytag_file = osm2prolog_openTagEncoder(*dict, split ? state->waytag_file : state->prolog_file, split, "way_tag");
 	}
 }
 
@@ -99,11 +647,76 @@ char * strconcat(const char * prefix, const char * infix, const char * suffix) {
 	return ret;
 }
 
-FILE * openPrintFile(const char * prefix, const char * suffix) {
+/* the files of a shard get its index before their .pl extension, if any */
+osmOutput * openPrintFile(const parseState * state, const char * prefix, const char * suffix) {
 	char * filename = strconcat(prefix, "_", suffix);
-	FILE * filep = fopen(filename, "w");
+	const size_t len = strlen(filename);
+	const bool pl = (len > 3 && 0 == strcmp(filename + len - 3, ".pl"));
+	char index[16];
+	char * sharded;
+
+	if (state->shards) {
+		snprintf(index, sizeof(index), ".%u", osm2prolog_nextShard(state->shards));
+		if (pl)
+			filename[len - 3] = '\0';
+		sharded = strconcat(filename, index, pl ? ".pl" : "");
+		free(filename);
+		filename = sharded;
+	}
+	return openFile(state, filename);
+}
+
+/* files that all shards share, like the tag dictionaries, get no index */
+osmOutput * openSharedFile(const parseState * state, const char * prefix, const char * suffix) {
+	return openFile(state, strconcat(prefix, "_", suffix));
+}
+
+/* checkpointed conversions open their outputs through the checkpoint;
+ * frees 'filename' */
+osmOutput * openFile(const parseState * state, char * filename) {
+	osmOutput * out = state->checkpoint ? osm2prolog_openCheckpointOutput(state->checkpoint, filename) : osm2prolog_openOutput(filename);
+
 	free(filename);
-	if (!filep)
-		perror("openPrintFile");
-	return filep;
+	if (!out)
+		exit(EXIT_FAILURE);
+	return out;
+}
+
+/* runs are spilled next to the table, as <prefix>_<suffix>.sort.XXXXXX */
+osmOutput * sortInto(osmOutput * dest, const char * prefix, const char * suffix, osmRecordPrinter print, size_t memory) {
+	char * tmpprefix = strconcat(prefix, "_", suffix);
+	char * tmpname = strconcat(tmpprefix, ".sort.", "");
+	osmOutput * out = osm2prolog_openSortedOutput(dest, print, tmpname, memory);
+
+	free(tmpname);
+	free(tmpprefix);
+	return out;
+}
+
+osmOutput * openSpoolFile(osmOutput * dest, const char * tmpprefix) {
+	osmOutput * out = osm2prolog_openSpoolOutput(dest, tmpprefix);
+	if (!out)
+		exit(EXIT_FAILURE);
+	return out;
+}
+
+/* parses a -stages layout into whether the stage after reading, parsing and
+ * formatting has a thread of its own */
+bool parseStages(const char * layout, bool threads[3]) {
+	static const char * const stages[] = { "read", "parse", "format", "write" };
+	size_t len;
+	size_t i;
+
+	for (i = 0; i < 4; ++i) {
+		len = strlen(stages[i]);
+		if (0 != strncmp(layout, stages[i], len))
+			return false;
+		layout += len;
+		if (3 == i)
+			break;
+		if ('/' != *layout && '+' != *layout)
+			return false;
+		threads[i] = ('/' == *layout++);
+	}
+	return '\0' == *layout;
 }
@@ -0,0 +1,114 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* The osm2prolog library, libosm2prolog.
+ *
+ * A reader parses OSM XML that is fed to it in pieces of any size, or reads
+ * an OSM XML, PBF or compressed XML file by itself, and passes the nodes,
+ * ways and tags that a conversion would write to callbacks, as typed
+ * records instead of text. Tags are filtered, and untagged elements
+ * dropped, as with the -tags, -tagfile and -dropuntagged options.
+ *
+ * Records are passed in input order. As tags are written while their
+ * parent is still being parsed, the tags of a node or way come right
+ * before the node or way itself. Ids are 64 bit integers, coordinates fixed
+ * point degrees times OSM2PROLOG_COORD_SCALE. Way node arrays and tag text
+ * point into the buffers of the parser, and are only valid during the
+ * callback; tag text is not nul-terminated.
+ *
+ * Every reader is independent, so readers can be used in several threads
+ * at once. Warnings about malformed elements go to stderr.
+ *
+ * Link with -losm2prolog and the libraries it uses: libxml2, zlib, libbz2
+ * and pthreads. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* fixed point coordinates are degrees times this */
+#define OSM2PROLOG_COORD_SCALE 10000000
+/* the fixed point value of coordinates that do not fit */
+#define OSM2PROLOG_COORD_UNUSABLE INT32_MIN
+
+typedef struct osmReader osmReader;
+
+typedef
+struct osmNode {
+	int_least64_t id;
+	int32_t lat;
+	int32_t lon;
+}
+osmNode;
+
+typedef
+struct osmWay {
+	int_least64_t id;
+	const int_least64_t * nodes; /* node ids, in order */
+	size_t numnodes; /* at least 1 */
+}
+osmWay;
+
+typedef
+struct osmTag {
+	int_least64_t id; /* of the node or way */
+	const unsigned char * key; /* UTF-8, as in the input */
+	size_t keylen;
+	const unsigned char * value;
+	size_t valuelen;
+}
+osmTag;
+
+/* the callbacks of a reader, any of which may be NULL; each gets the 'arg'
+ * the reader was opened with, and returns false to stop the reader */
+typedef
+struct osmCallbacks {
+	bool (*node)(void * arg, const osmNode * node);
+	bool (*way)(void * arg, const osmWay * way);
+	bool (*nodetag)(void * arg, const osmTag * tag);
+	bool (*waytag)(void * arg, const osmTag * tag);
+}
+osmCallbacks;
+
+/* creates a reader, the callbacks are copied */
+osmReader * osm2prolog_openReader(const osmCallbacks * callbacks, void * arg);
+
+/* adds tag filter rules, in the syntax of the -tags option; call before
+ * the reader gets any input. Returns false on a malformed rule. */
+bool osm2prolog_readerTags(osmReader * reader, const char * rules);
+
+/* drops nodes and ways without tags that pass the filter; call before the
+ * reader gets any input */
+void osm2prolog_readerDropUntagged(osmReader * reader);
+
+/* parses the next piece of an OSM XML document, calling the callbacks for
+ * the records it completes. Returns false on malformed input or when a
+ * callback stopped the reader, and from then on. */
+bool osm2prolog_feed(osmReader * reader, const void * data, size_t size);
+
+/* parses a whole file instead of fed input: OSM XML, PBF, gzip or bzip2
+ * compressed OSM XML, or "-" for stdin. Returns false if the file could not
+ * be read, was incomplete or malformed, or a callback stopped the reader. */
+bool osm2prolog_readFile(osmReader * reader, const char * filename);
+
+/* ends the input, parsing what was fed last, and frees the reader. Returns
+ * false if the input was incomplete or malformed, or a callback stopped
+ * the reader. */
+bool osm2prolog_closeReader(osmReader * reader);
@@ -0,0 +1,553 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output.h"
+#include "stats.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libxml/xmlmemory.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* size of the buffers of file outputs */
+#define FILE_BUFFER_SIZE ((size_t)1024 * 1024)
+/* initial size of memory outputs, they grow as needed */
+#define MEMORY_BUFFER_SIZE ((size_t)64 * 1024)
+/* enough for any int64 */
+#define INT_MAXLEN 20
+
+struct osmOutput {
+	int fd; /* -1 for memory and sink outputs */
+	bool closefd;
+	osmSinkWrite sinkwrite; /* NULL unless this is a sink output */
+	osmSinkClose sinkclose;
+	void * sinkarg;
+	osmOutput * spooldest; /* NULL unless this is a spool output */
+	char * data;
+	size_t size;
+	size_t cap;
+
+	/* with the writer thread, 'spare' is being written while 'data' is
+	 * filled; the fields below are protected by the writer lock */
+	bool async;
+	char * spare;
+	size_t sparesize;
+	bool writing;
+	bool failed;
+	osmOutput * next; /* in the writer queue */
+};
+
+/* the background writer, shared by all outputs */
+static struct {
+	pthread_t thread;
+	bool running;
+	bool stopping;
+	osmOutput * head;
+	osmOutput * tail;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+} writer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static osmOutput * newOutput(int fd, bool closefd, size_t cap);
+static bool isMemory(const osmOutput * out);
+static void makeRoom(osmOutput * out, size_t len);
+static bool writeAll(int fd, const char * data, size_t size, bool sync);
+static bool copySpool(osmOutput * out);
+static void * writerThread(void * arg);
+static size_t cleanPrefix(const unsigned char * str, size_t len);
+static size_t escapeByte(unsigned char c, osmEscape escape, char * buf);
+
+/**********/
+/* writer */
+/**********/
+bool osm2prolog_startWriter(void) {
+	writer.stopping = false;
+	writer.running = (0 == pthread_create(&writer.thread, NULL, writerThread, NULL));
+	if (!writer.running)
+		fprintf(stderr, "Failed to start writer thread, writing without it.\n");
+	return writer.running;
+}
+
+void osm2prolog_stopWriter(void) {
+	if (!writer.running)
+		return;
+
+	pthread_mutex_lock(&writer.lock);
+	writer.stopping = true;
+	pthread_cond_broadcast(&writer.work);
+	pthread_mutex_unlock(&writer.lock);
+
+	pthread_join(writer.thread, NULL);
+	writer.running = false;
+}
+
+static void * writerThread(void * arg __attribute__((unused))) {
+	osmOutput * out;
+	bool ok;
+
+	for (;;) {
+		pthread_mutex_lock(&writer.lock);
+		while (!writer.head && !writer.stopping)
+			pthread_cond_wait(&writer.work, &writer.lock);
+		out = writer.head;
+		if (!out) {
+			pthread_mutex_unlock(&writer.lock);
+			break;
+		}
+		writer.head = out->next;
+		if (!writer.head)
+			writer.tail = NULL;
+		pthread_mutex_unlock(&writer.lock);
+
+		/* after a failure, the rest of the output is dropped */
+		ok = !out->failed && writeAll(out->fd, out->spare, out->sparesize, false);
+
+		pthread_mutex_lock(&writer.lock);
+		out->failed = out->failed || !ok;
+		out->writing = false;
+		pthread_cond_broadcast(&writer.done);
+		pthread_mutex_unlock(&writer.lock);
+	}
+	return NULL;
+}
+
+
+
+/***********/
+/* outputs */
+/***********/
+osmOutput * osm2prolog_openOutput(const char * filename) {
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if (fd < 0) {
+		perror(filename);
+		return NULL;
+	}
+	return newOutput(fd, true, FILE_BUFFER_SIZE);
+}
+
+osmOutput * osm2prolog_reopenOutput(const char * filename, uint_least64_t offset) {
+	int fd = open(filename, O_WRONLY);
+	struct stat info;
+
+	if (fd < 0 || 0 != fstat(fd, &info)) {
+		perror(filename);
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	if ((uint_least64_t)info.st_size < offset) {
+		fprintf(stderr, "%s: shorter than when it was checkpointed\n", filename);
+		close(fd);
+		return NULL;
+	}
+	if (0 != ftruncate(fd, (off_t)offset) || (off_t)-1 == lseek(fd, (off_t)offset, SEEK_SET)) {
+		perror(filename);
+		close(fd);
+		return NULL;
+	}
+	return newOutput(fd, true, FILE_BUFFER_SIZE);
+}
+
+osmOutput * osm2prolog_openOutputFd(int fd) {
+	return newOutput(fd, false, FILE_BUFFER_SIZE);
+}
+
+osmOutput * osm2prolog_openMemoryOutput(void) {
+	return newOutput(-1, false, MEMORY_BUFFER_SIZE);
+}
+
+osmOutput * osm2prolog_openSpoolOutput(osmOutput * dest, const char * tmpprefix) {
+	int fd = osm2prolog_createTempFile(tmpprefix);
+	osmOutput * out;
+
+	if (fd < 0)
+		return NULL;
+	out = newOutput(fd, true, FILE_BUFFER_SIZE);
+	out->spooldest = dest;
+	return out;
+}
+
+osmOutput * osm2prolog_openSinkOutput(osmSinkWrite sinkwrite, osmSinkClose sinkclose, void * arg) {
+	osmOutput * out = newOutput(-1, false, FILE_BUFFER_SIZE);
+
+	out->sinkwrite = sinkwrite;
+	out->sinkclose = sinkclose;
+	out->sinkarg = arg;
+	return out;
+}
+
+const char * osm2prolog_outputData(const osmOutput * out, size_t * size) {
+	*size = out->size;
+	return out->data;
+}
+
+bool osm2prolog_flushOutput(osmOutput * out) {
+	char * buffer;
+	bool ok;
+
+	if (isMemory(out) || 0 == out->size)
+		return !out->failed;
+
+	if (out->sinkwrite) {
+		out->failed = out->failed || !out->sinkwrite(out->sinkarg, out->data, out->size);
+		out->size = 0;
+		return !out->failed;
+	}
+
+	if (!out->async) {
+		/* after a failure, the rest of the output is dropped */
+		out->failed = out->failed || !writeAll(out->fd, out->data, out->size, true);
+		out->size = 0;
+		return !out->failed;
+	}
+
+	/* hand the buffer to the writer thread and continue with the spare one,
+	 * once the writer is done with that */
+	pthread_mutex_lock(&writer.lock);
+	while (out->writing)
+		pthread_cond_wait(&writer.done, &writer.lock);
+	if (!out->spare)
+		out->spare = xmlMalloc(out->cap);
+	buffer = out->spare;
+	out->spare = out->data;
+	out->sparesize = out->size;
+	out->data = buffer;
+	out->size = 0;
+	out->writing = true;
+	out->next = NULL;
+	if (writer.tail)
+		writer.tail->next = out;
+	else
+		writer.head = out;
+	writer.tail = out;
+	pthread_cond_signal(&writer.work);
+	ok = !out->failed;
+	pthread_mutex_unlock(&writer.lock);
+
+	return ok;
+}
+
+bool osm2prolog_syncOutput(osmOutput * out, uint_least64_t * size) {
+	bool ok = osm2prolog_flushOutput(out);
+	off_t offset;
+
+	if (out->fd < 0 || out->spooldest)
+		return false;
+	if (out->async) {
+		pthread_mutex_lock(&writer.lock);
+		while (out->writing)
+			pthread_cond_wait(&writer.done, &writer.lock);
+		ok = ok && !out->failed;
+		pthread_mutex_unlock(&writer.lock);
+	}
+	if (!ok)
+		return false;
+
+	if (0 != fdatasync(out->fd) || (off_t)-1 == (offset = lseek(out->fd, 0, SEEK_CUR))) {
+		perror("fdatasync");
+		return false;
+	}
+	*size = (uint_least64_t)offset;
+	return true;
+}
+
+bool osm2prolog_closeOutput(osmOutput * out) {
+	bool ok = osm2prolog_flushOutput(out);
+
+	if (out->async) {
+		pthread_mutex_lock(&writer.lock);
+		while (out->writing)
+			pthread_cond_wait(&writer.done, &writer.lock);
+		ok = ok && !out->failed;
+		pthread_mutex_unlock(&writer.lock);
+	}
+
+	if (out->spooldest && ok)
+		ok = copySpool(out);
+	if (out->closefd && 0 != close(out->fd)) {
+		perror("close");
+		ok = false;
+	}
+	/* the sink is closed even after a failure, so it can clean up */
+	if (out->sinkclose)
+		ok = out->sinkclose(out->sinkarg) && ok;
+	xmlFree(out->spare);
+	xmlFree(out->data);
+	xmlFree(out);
+	return ok;
+}
+
+int osm2prolog_createTempFile(const char * tmpprefix) {
+	size_t prefixlen = strlen(tmpprefix);
+	char * template = xmlMalloc(prefixlen + 7);
+	int fd;
+
+	memcpy(template, tmpprefix, prefixlen);
+	memcpy(template + prefixlen, "XXXXXX", 7);
+	fd = mkstemp(template);
+	if (fd < 0)
+		perror(template);
+	else
+		unlink(template);
+	xmlFree(template);
+	return fd;
+}
+
+static osmOutput * newOutput(int fd, bool closefd, size_t cap) {
+	osmOutput * out = xmlMalloc(sizeof(osmOutput));
+
+	memset(out, 0, sizeof(osmOutput));
+	out->fd = fd;
+	out->closefd = closefd;
+	out->cap = cap;
+	out->data = xmlMalloc(cap);
+	out->async = fd >= 0 && writer.running;
+	return out;
+}
+
+static bool isMemory(const osmOutput * out) {
+	return out->fd < 0 && !out->sinkwrite;
+}
+
+/* grows memory outputs until len more bytes fit, or flushes file and sink
+ * outputs (which never grow, so len may still not fit) */
+static void makeRoom(osmOutput * out, size_t len) {
+	if (out->size + len <= out->cap)
+		return;
+
+	if (isMemory(out)) {
+		while (out->size + len > out->cap)
+			out->cap *= 2;
+		out->data = xmlRealloc(out->data, out->cap);
+	}
+	else
+		osm2prolog_flushOutput(out);
+}
+
+/* appends everything a spool output wrote to its destination, through the
+ * now idle buffer */
+static bool copySpool(osmOutput * out) {
+	ssize_t len;
+
+	if (0 != lseek(out->fd, 0, SEEK_SET)) {
+		perror("lseek");
+		return false;
+	}
+	for (;;) {
+		len = read(out->fd, out->data, out->cap);
+		if (len < 0 && EINTR == errno)
+			continue;
+		if (len < 0) {
+			perror("read");
+			return false;
+		}
+		if (0 == len)
+			return true;
+		osm2prolog_put(out->spooldest, out->data, (size_t)len);
+	}
+}
+
+/* 'sync' when the caller waits for it, rather than the writer thread */
+static bool writeAll(int fd, const char * data, size_t size, bool sync) {
+	uint_least64_t start = osm2prolog_statsEnabled() ? osm2prolog_now() : 0;
+	ssize_t len;
+
+	while (size > 0) {
+		len = write(fd, data, size);
+		if (len < 0 && EINTR == errno)
+			continue;
+		if (len < 0) {
+			perror("write");
+			return false;
+		}
+		data += len;
+		size -= (size_t)len;
+	}
+	if (start)
+		osm2prolog_addWriteTime(osm2prolog_now() - start, sync);
+	return true;
+}
+
+
+
+/**************/
+/* formatting */
+/**************/
+void osm2prolog_put(osmOutput * out, const void * data, size_t len) {
+	const char * src = data;
+	size_t piece;
+
+	makeRoom(out, len);
+	/* data bigger than a file buffer goes through it in pieces, so it stays
+	 * in order with the writer thread */
+	while (len > out->cap - out->size) {
+		piece = out->cap - out->size;
+		memcpy(out->data + out->size, src, piece);
+		out->size += piece;
+		src += piece;
+		len -= piece;
+		osm2prolog_flushOutput(out);
+	}
+	memcpy(out->data + out->size, src, len);
+	out->size += len;
+}
+
+void osm2prolog_putString(osmOutput * out, const char * str) {
+	osm2prolog_put(out, str, strlen(str));
+}
+
+void osm2prolog_putChar(osmOutput * out, char c) {
+	if (out->size == out->cap)
+		makeRoom(out, 1);
+	out->data[out->size++] = c;
+}
+
+void osm2prolog_putInt(osmOutput * out, int_least64_t num) {
+	char buf[INT_MAXLEN + 1];
+	char * pos = buf + sizeof(buf);
+	/* negate unsigned, so INT64_MIN works too */
+	uint_least64_t magnitude = (num < 0) ? -(uint_least64_t)num : (uint_least64_t)num;
+
+	do {
+		*--pos = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude > 0);
+	if (num < 0)
+		*--pos = '-';
+
+	osm2prolog_put(out, pos, (size_t)(buf + sizeof(buf) - pos));
+}
+
+void osm2prolog_putEscaped(osmOutput * out, const unsigned char * str, size_t len, osmEscape escape) {
+	const unsigned char * const end = str + len;
+	size_t clean;
+	char buf[8];
+
+	/* almost all text is clean, and goes to the buffer in one piece */
+	while (str < end) {
+		clean = cleanPrefix(str, (size_t)(end - str));
+		osm2prolog_put(out, str, clean);
+		str += clean;
+		if (str < end) {
+			osm2prolog_put(out, buf, escapeByte(*str, escape, buf));
+			++str;
+		}
+	}
+}
+
+/* returns the length of the part of 'str' that no escape mode changes: no
+ * control characters, quotes or backslashes; checks 32 or 16 bytes at a
+ * time where the compiler targets AVX2 or SSE2 */
+static size_t cleanPrefix(const unsigned char * str, size_t len) {
+	size_t i = 0;
+	unsigned int mask;
+
+#if defined(__AVX2__)
+	const __m256i controls = _mm256_set1_epi8(0x1f);
+	const __m256i quote = _mm256_set1_epi8('\'');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i del = _mm256_set1_epi8(0x7f);
+	__m256i bytes;
+
+	for (; i + 32 <= len; i += 32) {
+		bytes = _mm256_loadu_si256((const __m256i *)(str + i));
+		/* unsigned bytes <= 0x1f are their own minimum with 0x1f */
+		mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(
+					_mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, controls), bytes), _mm256_cmpeq_epi8(bytes, quote)),
+					_mm256_or_si256(_mm256_cmpeq_epi8(bytes, backslash), _mm256_cmpeq_epi8(bytes, del))));
+		if (mask)
+			return i + (size_t)__builtin_ctz(mask);
+	}
+#elif defined(__SSE2__)
+	const __m128i controls = _mm_set1_epi8(0x1f);
+	const __m128i quote = _mm_set1_epi8('\'');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i del = _mm_set1_epi8(0x7f);
+	__m128i bytes;
+
+	for (; i + 16 <= len; i += 16) {
+		bytes = _mm_loadu_si128((const __m128i *)(str + i));
+		/* unsigned bytes <= 0x1f are their own minimum with 0x1f */
+		mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(bytes, controls), bytes), _mm_cmpeq_epi8(bytes, quote)),
+					_mm_or_si128(_mm_cmpeq_epi8(bytes, backslash), _mm_cmpeq_epi8(bytes, del))));
+		if (mask)
+			return i + (size_t)__builtin_ctz(mask);
+	}
+#else
+	(void)mask;
+#endif
+	for (; i < len; ++i) {
+		if (str[i] < 0x20 || '\'' == str[i] || '\\' == str[i] || 0x7f == str[i])
+			break;
+	}
+	return i;
+}
+
+/* writes the escaped form of a byte that cleanPrefix stopped at, returns
+ * its length */
+static size_t escapeByte(unsigned char c, osmEscape escape, char * buf) {
+	static const char hex[] = "0123456789abcdef";
+	char short_escape = '\0';
+
+	switch (c) {
+		case '\\': short_escape = '\\'; break;
+		case '\t': short_escape = 't'; break;
+		case '\n': short_escape = 'n'; break;
+		case '\r': short_escape = 'r'; break;
+		case '\'': short_escape = (ESCAPE_ATOM == escape) ? '\'' : '\0'; break;
+		default: break;
+	}
+	if (short_escape) {
+		buf[0] = '\\';
+		buf[1] = short_escape;
+		return 2;
+	}
+	/* the other control characters only need escaping in atoms, as "\xHH\" */
+	if (ESCAPE_FIELD == escape || '\'' == c) {
+		buf[0] = (char)c;
+		return 1;
+	}
+	buf[0] = '\\';
+	buf[1] = 'x';
+	buf[2] = hex[c >> 4];
+	buf[3] = hex[c & 0xf];
+	buf[4] = '\\';
+	return 5;
+}
@@ -0,0 +1,112 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Buffered output without stdio.
+ *
+ * Records are formatted straight into a large buffer per output file, which
+ * is written with write(2) when it fills up. Optionally, a background
+ * writer thread does the writing while the parser fills a second buffer.
+ * Memory outputs never write anything, they just grow, and are used to
+ * collect the output of one chunk of a parallel parse. Sink outputs hand
+ * their buffer to a callback instead of a file, see sort.h. Spool outputs
+ * write to a temporary file, which is appended to another output when the
+ * spool output is closed. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct osmOutput osmOutput;
+
+/* consumes the buffered data of a sink output, returns false on failure */
+typedef bool (*osmSinkWrite)(void * arg, const char * data, size_t size);
+/* called once when a sink output is closed, returns false on failure */
+typedef bool (*osmSinkClose)(void * arg);
+
+/* starts the background writer thread, file outputs opened afterwards use
+ * it until osm2prolog_stopWriter is called */
+bool osm2prolog_startWriter(void);
+
+/* stops the background writer thread, after all outputs using it are closed */
+void osm2prolog_stopWriter(void);
+
+/* creates a file for writing, returns NULL on failure */
+osmOutput * osm2prolog_openOutput(const char * filename);
+
+/* opens an existing file for writing at 'offset', cutting off whatever
+ * follows, to continue an interrupted conversion; returns NULL on failure
+ * or if the file is shorter */
+osmOutput * osm2prolog_reopenOutput(const char * filename, uint_least64_t offset);
+
+/* writes to an already open file descriptor, which is not closed afterwards */
+osmOutput * osm2prolog_openOutputFd(int fd);
+
+/* collects output in memory */
+osmOutput * osm2prolog_openMemoryOutput(void);
+
+/* writes to an unlinked temporary file created by osm2prolog_createTempFile,
+ * and appends its contents to 'dest' when closed (before 'dest' is closed);
+ * returns NULL on failure */
+osmOutput * osm2prolog_openSpoolOutput(osmOutput * dest, const char * tmpprefix);
+
+/* passes everything written to 'sinkwrite', in buffer sized pieces that do
+ * not respect record boundaries; sink outputs never use the writer thread */
+osmOutput * osm2prolog_openSinkOutput(osmSinkWrite sinkwrite, osmSinkClose sinkclose, void * arg);
+
+/* creates and unlinks a temporary file named 'tmpprefix' followed by six
+ * random characters, returns its descriptor or -1 on failure */
+int osm2prolog_createTempFile(const char * tmpprefix);
+
+/* returns the contents of a memory output */
+const char * osm2prolog_outputData(const osmOutput * out, size_t * size);
+
+/* writes out all buffered data, returns false if any write failed */
+bool osm2prolog_flushOutput(osmOutput * out);
+
+/* writes out all buffered data and waits until it is on disk, storing the
+ * size of the file; returns false if any write failed, or for outputs that
+ * do not write a file of their own */
+bool osm2prolog_syncOutput(osmOutput * out, uint_least64_t * size);
+
+/* flushes and frees an output, returns false if any write failed */
+bool osm2prolog_closeOutput(osmOutput * out);
+
+/* appends raw bytes */
+void osm2prolog_put(osmOutput * out, const void * data, size_t len);
+
+/* appends a nul-terminated string */
+void osm2prolog_putString(osmOutput * out, const char * str);
+
+void osm2prolog_putChar(osmOutput * out, char c);
+
+/* appends a decimal integer */
+void osm2prolog_putInt(osmOutput * out, int_least64_t num);
+
+/* how osm2prolog_putEscaped escapes text */
+typedef
+enum osmEscape {
+	ESCAPE_ATOM, /* for the inside of a quoted prolog atom */
+	ESCAPE_FIELD /* for a tab separated field, like PostgreSQL's COPY text format */
+}
+osmEscape;
+
+/* appends text, escaping what can't appear in it as is; UTF-8 and other
+ * bytes from 0x80 up pass unchanged */
+void osm2prolog_putEscaped(osmOutput * out, const unsigned char * str, size_t len, osmEscape escape);
@@ -0,0 +1,425 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parallel.h"
+#include "elements.h"
+#include "pbf.h"
+#include "sax_callbacks.h"
+#include "shard.h"
+#include "stats.h"
+#include "tokenizer.h"
+#include "types.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/parser.h>
+
+/* chunk sizes are derived from the input size, but kept within these bounds */
+#define MIN_CHUNK_SIZE ((size_t)64 * 1024)
+#define MAX_CHUNK_SIZE ((size_t)16 * 1024 * 1024)
+/* amount of data handed to libxml2 in one xmlParseChunk call */
+#define FEED_SIZE ((size_t)1024 * 1024)
+
+/* the output streams of a parseState, in a fixed order */
+#define NUM_STREAMS 5
+
+/* one slice of the input, and the output it produced */
+typedef
+struct parseChunk {
+	size_t begin;
+	size_t end;
+	bool done;
+	bool failed;
+	osmOutput * outputs[NUM_STREAMS]; /* unless sharded, then those of the shards of 'counted' */
+	parseState * counted; /* the state that parsed it, for its counters */
+	osmNesting * nesting; /* of its elements, for the tokenizer */
+}
+parseChunk;
+
+/* shared between the writer (calling thread) and the workers */
+typedef
+struct parallelJob {
+	const char * data;
+	size_t size;
+	osmPrintMode printMode;
+	bool tableRecords;
+	bool splitPredicates;
+	bool tagRecords;
+	unsigned int precision;
+	const osmTagFilter * tagfilter;
+	bool dropUntagged;
+	bool timePhases;
+	const osmShards * shards; /* NULL unless the outputs are sharded */
+	osmParser parser;
+
+	parseChunk * chunks;
+	size_t numchunks;
+	size_t window;	/* max number of parsed chunks waiting to be written */
+
+	/* protected by lock */
+	size_t nextchunk;	/* next chunk to hand out to a worker */
+	size_t written;	/* number of chunks written to the output */
+	bool failed;
+	pthread_mutex_t lock;
+	pthread_cond_t chunkdone;
+	pthread_cond_t chunkwritten;
+}
+parallelJob;
+
+/************************/
+/* forward declarations */
+/************************/
+static osmOutput ** streamOf(parseState * state, size_t i);
+static size_t splitChunks(parallelJob * job, unsigned int jobs);
+static bool parseChunkData(parallelJob * job, parseChunk * chunk, bool first, bool last);
+static bool parseChunkXML(parallelJob * job, parseChunk * chunk, parseState * state, bool first, bool last);
+static void * worker(void * arg);
+static void writeChunk(parseState * state, parseChunk * chunk);
+static void writeStreams(parseState * state, osmOutput ** outputs);
+
+/*****************/
+/* the interface */
+/*****************/
+int osm2prolog_parseParallel(parseState * state, const char * filename, unsigned int jobs, osmParser parser) {
+	parallelJob job;
+	osmNesting * nesting;
+	pthread_t * workers;
+	unsigned int numworkers;
+	unsigned int i;
+	size_t k;
+	bool failed = false;
+
+	memset(&job, 0, sizeof(job));
+	job.data = osm2prolog_mapFile(filename, &job.size);
+	if (!job.data) {
+		fprintf(stderr, "%s: cannot map input file (parallel parsing needs a non-empty regular file)\n", filename);
+		return -1;
+	}
+
+	job.parser = parser;
+	if (osm2prolog_isPBF(job.data, job.size))
+		job.parser = PBF;
+	else if (MMAP == parser && !osm2prolog_tokenizerSupports(job.data, job.size)) {
+		fprintf(stderr, "Note: %s uses XML features the fast tokenizer does not support, using libxml2.\n", filename);
+		job.parser = LIBXML;
+	}
+
+	osm2prolog_startDocument(state);
+	nesting = osm2prolog_createNesting(true);
+	job.printMode = state->printMode;
+	job.tableRecords = state->tableRecords;
+	job.splitPredicates = state->splitPredicates;
+	job.tagRecords = state->tagRecords;
+	job.precision = state->precision;
+	job.tagfilter = state->tagfilter;
+	job.dropUntagged = state->dropUntagged;
+	job.timePhases = state->timePhases;
+	job.shards = state->shards;
+
+	job.numchunks = splitChunks(&job, jobs);
+	job.window = 2 * (size_t)jobs;
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.chunkdone, NULL);
+	pthread_cond_init(&job.chunkwritten, NULL);
+
+	numworkers = (jobs < job.numchunks) ? jobs : (unsigned int)job.numchunks;
+	fprintf(stderr, "Parsing %zu chunks using %u threads\n", job.numchunks, numworkers);
+
+	workers = xmlMalloc(numworkers * sizeof(pthread_t));
+	for (i = 0; i < numworkers; ++i) {
+		if (0 != pthread_create(&workers[i], NULL, worker, &job)) {
+			fprintf(stderr, "Failed to start worker thread.\n");
+			numworkers = i;
+			failed = true;
+			pthread_mutex_lock(&job.lock);
+			job.failed = true;
+			pthread_cond_broadcast(&job.chunkwritten);
+			pthread_mutex_unlock(&job.lock);
+			break;
+		}
+	}
+
+	/* write chunks in input order as soon as they are available */
+	for (k = 0; k < job.numchunks && numworkers > 0 && !failed; ++k) {
+		pthread_mutex_lock(&job.lock);
+		while (!job.chunks[k].done)
+			pthread_cond_wait(&job.chunkdone, &job.lock);
+		pthread_mutex_unlock(&job.lock);
+
+		/* the tokenizer checks the nesting of a chunk on its own, the
+		 * chunks are checked to nest in input order */
+		if (job.chunks[k].nesting && !job.chunks[k].failed && !osm2prolog_joinNesting(nesting, job.chunks[k].nesting)) {
+			fprintf(stderr, "Error: failed to parse chunk at offset %zu.\n", job.chunks[k].begin);
+			job.chunks[k].failed = true;
+		}
+		writeChunk(state, &job.chunks[k]);
+		failed = job.chunks[k].failed;
+
+		pthread_mutex_lock(&job.lock);
+		++job.written;
+		job.failed = failed;
+		pthread_cond_broadcast(&job.chunkwritten);
+		pthread_mutex_unlock(&job.lock);
+	}
+
+	/* on failure, workers stop picking up chunks; wait for the running ones */
+	for (i = 0; i < numworkers; ++i)
+		pthread_join(workers[i], NULL);
+	xmlFree(workers);
+
+	for (k = 0; k < job.numchunks; ++k) {
+		for (i = 0; i < NUM_STREAMS; ++i) {
+			if (job.chunks[k].outputs[i])
+				osm2prolog_closeOutput(job.chunks[k].outputs[i]);
+		}
+		if (job.chunks[k].counted)
+			osm2prolog_freeParseState(job.chunks[k].counted);
+		osm2prolog_freeNesting(job.chunks[k].nesting);
+	}
+	xmlFree(job.chunks);
+	if (MMAP == job.parser && !failed && numworkers > 0)
+		failed = !osm2prolog_endNesting(nesting);
+	osm2prolog_freeNesting(nesting);
+
+	pthread_cond_destroy(&job.chunkwritten);
+	pthread_cond_destroy(&job.chunkdone);
+	pthread_mutex_destroy(&job.lock);
+	osm2prolog_unmapFile(job.data, job.size);
+
+	osm2prolog_endDocument(state);
+
+	return failed ? -1 : 0;
+}
+
+
+
+/*************/
+/* splitting */
+/*************/
+static osmOutput ** streamOf(parseState * state, size_t i) {
+	osmOutput ** streams[NUM_STREAMS] = {
+		&state->prolog_file,
+		&state->node_file,
+		&state->way_file,
+		&state->nodetag_file,
+		&state->waytag_file
+	};
+	return streams[i];
+}
+
+/* fills job->chunks, returns the number of chunks */
+static size_t splitChunks(parallelJob * job, unsigned int jobs) {
+	size_t chunksize = job->size / ((size_t)jobs * 8);
+	size_t maxchunks;
+	size_t numchunks = 0;
+	size_t begin = 0;
+	size_t end;
+
+	chunksize = (chunksize < MIN_CHUNK_SIZE) ? MIN_CHUNK_SIZE : chunksize;
+	chunksize = (chunksize > MAX_CHUNK_SIZE) ? MAX_CHUNK_SIZE : chunksize;
+	maxchunks = job->size / chunksize + 1;
+	job->chunks = xmlMalloc(maxchunks * sizeof(parseChunk));
+	memset(job->chunks, 0, maxchunks * sizeof(parseChunk));
+
+	while (begin < job->size) {
+		if (job->size - begin <= chunksize)
+			end = job->size;
+		else if (PBF == job->parser)
+			end = osm2prolog_pbfBoundary(job->data, job->size, begin, begin + chunksize);
+		else
+			end = osm2prolog_findBoundary(job->data, job->size, begin, begin + chunksize);
+		job->chunks[numchunks].begin = begin;
+		job->chunks[numchunks].end = end;
+		++numchunks;
+		begin = end;
+	}
+	return numchunks;
+}
+
+
+
+/***********/
+/* parsing */
+/***********/
+static bool parseChunkData(parallelJob * job, parseChunk * chunk, bool first, bool last) {
+	parseState * state;
+	uint_least64_t start = osm2prolog_now();
+	bool ok;
+	size_t i;
+	unsigned int k;
+
+	state = osm2prolog_createParseState();
+	state->printMode = job->printMode;
+	state->tableRecords = job->tableRecords;
+	state->splitPredicates = job->splitPredicates;
+	state->tagRecords = job->tagRecords;
+	state->precision = job->precision;
+	state->tagfilter = job->tagfilter;
+	state->dropUntagged = job->dropUntagged;
+	state->timePhases = job->timePhases;
+	if (job->shards) {
+		state->shards = osm2prolog_copyShards(job->shards);
+		for (k = 0; k < osm2prolog_shardCount(job->shards); ++k) {
+			for (i = 0; i < NUM_STREAMS; ++i)
+				*streamOf(state, i) = osm2prolog_openMemoryOutput();
+			osm2prolog_addShard(state);
+		}
+	}
+	else {
+		for (i = 0; i < NUM_STREAMS; ++i) {
+			chunk->outputs[i] = osm2prolog_openMemoryOutput();
+			*streamOf(state, i) = chunk->outputs[i];
+		}
+	}
+
+	if (PBF == job->parser)
+		ok = osm2prolog_decodeBlobs(state, job->data + chunk->begin, chunk->end - chunk->begin, chunk->begin);
+	else if (MMAP == job->parser) {
+		chunk->nesting = osm2prolog_createNesting(false);
+		ok = osm2prolog_tokenize(state, chunk->nesting, job->data + chunk->begin, chunk->end - chunk->begin, chunk->begin);
+	}
+	else
+		ok = parseChunkXML(job, chunk, state, first, last);
+
+	/* the outputs and the counters stay with the chunk until it is written */
+	for (i = 0; i < NUM_STREAMS; ++i)
+		*streamOf(state, i) = NULL;
+	chunk->counted = state;
+	osm2prolog_addParseTime(osm2prolog_now() - start, false);
+	osm2prolog_addProgress(chunk->end - chunk->begin, osm2prolog_elementCount(state));
+
+	if (!ok)
+		fprintf(stderr, "Error: failed to parse chunk at offset %zu.\n", chunk->begin);
+	return ok;
+}
+
+/* Chunks other than the first and last are not documents by themselves, so
+ * libxml2 gets them wrapped in a bare <osm> root element. */
+static bool parseChunkXML(parallelJob * job, parseChunk * chunk, parseState * state, bool first, bool last) {
+	static const char openroot[] = "<osm>";
+	static const char closeroot[] = "</osm>";
+	const char * data = job->data + chunk->begin;
+	size_t remaining = chunk->end - chunk->begin;
+	size_t feed;
+	xmlParserCtxtPtr ctxt;
+	bool ok;
+
+	/* workers get the element callbacks only, the document is started and
+	 * ended exactly once, on the output state */
+	ctxt = osm2prolog_createParser(state, false, NULL);
+	if (!ctxt) {
+		fprintf(stderr, "Failed to set up a parser for chunk at offset %zu.\n", chunk->begin);
+		return false;
+	}
+
+	if (!first)
+		xmlParseChunk(ctxt, openroot, sizeof(openroot) - 1, 0);
+	while (remaining > 0 && ctxt->wellFormed) {
+		feed = (remaining > FEED_SIZE) ? FEED_SIZE : remaining;
+		xmlParseChunk(ctxt, data, (int)feed, 0);
+		data += feed;
+		remaining -= feed;
+	}
+	if (!last)
+		xmlParseChunk(ctxt, closeroot, sizeof(closeroot) - 1, 0);
+	xmlParseChunk(ctxt, NULL, 0, 1);
+	ok = ctxt->wellFormed;
+	osm2prolog_freeParser(ctxt);
+
+	return ok;
+}
+
+static void * worker(void * arg) {
+	parallelJob * job = arg;
+	parseChunk * chunk;
+	size_t k;
+	bool ok;
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		while (!job->failed && job->nextchunk < job->numchunks
+				&& job->nextchunk >= job->written + job->window)
+			pthread_cond_wait(&job->chunkwritten, &job->lock);
+		if (job->failed || job->nextchunk >= job->numchunks) {
+			pthread_mutex_unlock(&job->lock);
+			break;
+		}
+		k = job->nextchunk++;
+		pthread_mutex_unlock(&job->lock);
+
+		chunk = &job->chunks[k];
+		ok = parseChunkData(job, chunk, 0 == k, job->numchunks - 1 == k);
+
+		pthread_mutex_lock(&job->lock);
+		chunk->failed = !ok;
+		chunk->done = true;
+		pthread_cond_broadcast(&job->chunkdone);
+		pthread_mutex_unlock(&job->lock);
+	}
+	return NULL;
+}
+
+
+
+/***********/
+/* writing */
+/***********/
+static void writeChunk(parseState * state, parseChunk * chunk) {
+	osmOutput * outputs[NUM_STREAMS];
+	unsigned int k;
+	size_t i;
+
+	/* the outputs of the shards are closed with the state that parsed them */
+	if (chunk->counted->shards) {
+		for (k = 0; k < osm2prolog_shardCount(state->shards); ++k) {
+			osm2prolog_useShard(state, k);
+			osm2prolog_useShard(chunk->counted, k);
+			for (i = 0; i < NUM_STREAMS; ++i)
+				outputs[i] = *streamOf(chunk->counted, i);
+			writeStreams(state, outputs);
+		}
+	}
+	else {
+		writeStreams(state, chunk->outputs);
+		for (i = 0; i < NUM_STREAMS; ++i) {
+			osm2prolog_closeOutput(chunk->outputs[i]);
+			chunk->outputs[i] = NULL;
+		}
+	}
+	osm2prolog_addCounters(state, chunk->counted);
+	osm2prolog_freeParseState(chunk->counted);
+	chunk->counted = NULL;
+}
+
+/* appends the memory outputs of a chunk to the streams of the state */
+static void writeStreams(parseState * state, osmOutput ** outputs) {
+	osmOutput * out;
+	const char * data;
+	size_t size;
+	size_t i;
+
+	for (i = 0; i < NUM_STREAMS; ++i) {
+		out = *streamOf(state, i);
+		data = osm2prolog_outputData(outputs[i], &size);
+		if (out && size > 0)
+			osm2prolog_put(out, data, size);
+	}
+}
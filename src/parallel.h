@@ -0,0 +1,35 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "types.h"
+#include "util.h"
+
+/* Parses an OSM XML or PBF file using 'jobs' worker threads.
+ *
+ * The file is split into chunks at top level <node, <way and <relation
+ * elements, or at blob boundaries for PBF input. Every chunk is parsed by
+ * its own parser (the mmap tokenizer or libxml2, depending on 'parser', or
+ * the PBF reader) with its own parseState, into memory buffers that are
+ * written to the output files of 'state' in the original chunk order, so
+ * the result is identical to a sequential parse. (The document callbacks
+ * run only once, on 'state'.)
+ *
+ * Returns 0 on success, -1 on failure. */
+int osm2prolog_parseParallel(parseState * state, const char * filename, unsigned int jobs, osmParser parser);
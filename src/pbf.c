@@ -0,0 +1,650 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pbf.h"
+#include "elements.h"
+#include "stats.h"
+#include "types.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <libxml/xmlmemory.h>
+
+/* limits from the format specification */
+#define MAX_BLOB_HEADER_SIZE ((size_t)64 * 1024)
+#define MAX_BLOB_SIZE ((size_t)32 * 1024 * 1024)
+
+/* protobuf wire types */
+#define WIRE_VARINT 0
+#define WIRE_FIXED64 1
+#define WIRE_BYTES 2
+#define WIRE_FIXED32 5
+
+
+/* (part of) a protobuf message that is being decoded */
+typedef
+struct pbfBuffer {
+	const uint8_t * pos;
+	const uint8_t * end;
+}
+pbfBuffer;
+
+/* one decoded field: varints and fixed size values end up in 'value',
+ * length delimited fields in 'bytes' */
+typedef
+struct pbfField {
+	uint32_t number;
+	uint64_t value;
+	pbfBuffer bytes;
+}
+pbfField;
+
+/* the parts of a PrimitiveBlock needed to decode its groups */
+typedef
+struct pbfBlock {
+	osmSlice * strings;
+	size_t numstrings;
+	int_least64_t granularity;
+	int_least64_t latoffset;
+	int_least64_t lonoffset;
+}
+pbfBlock;
+
+/************************/
+/* forward declarations */
+/************************/
+static bool readVarint(pbfBuffer * buf, uint64_t * value);
+static bool readField(pbfBuffer * buf, pbfField * field);
+static inline int_least64_t zigzag(uint64_t value);
+static inline int_least64_t addDelta(int_least64_t sum, uint64_t value);
+static inline int32_t fixedDegrees(int_least64_t offset, int_least64_t granularity, int_least64_t value);
+static inline bool atEnd(const pbfBuffer * buf);
+
+static bool readBlobHeader(const char * data, size_t size, size_t * offset, pbfBuffer * type, pbfBuffer * blob);
+static uint8_t * inflateBlob(pbfBuffer blob, size_t * size);
+static bool decodeHeaderBlock(pbfBuffer buf);
+static bool decodePrimitiveBlock(parseState * state, pbfBuffer buf);
+static bool readStringTable(pbfBuffer buf, pbfBlock * block);
+static bool decodeNode(parseState * state, const pbfBlock * block, pbfBuffer buf);
+static bool decodeDenseNodes(parseState * state, const pbfBlock * block, pbfBuffer buf);
+static bool decodeWay(parseState * state, const pbfBlock * block, pbfBuffer buf);
+static bool emitTags(parseState * state, const pbfBlock * block, pbfBuffer keys, pbfBuffer vals);
+static bool emitTag(parseState * state, const pbfBlock * block, uint64_t key, uint64_t val);
+
+static inline bool isType(pbfBuffer type, const char * name);
+
+/*****************/
+/* the interface */
+/*****************/
+bool osm2prolog_isPBF(const char * data, size_t size) {
+	size_t offset = 0;
+	pbfBuffer type;
+	pbfBuffer blob;
+
+	return readBlobHeader(data, size, &offset, &type, &blob) && isType(type, "OSMHeader");
+}
+
+size_t osm2prolog_pbfBoundary(const char * data, size_t size, size_t begin, size_t from) {
+	pbfBuffer type;
+	pbfBuffer blob;
+
+	while (begin < from) {
+		if (!readBlobHeader(data, size, &begin, &type, &blob))
+			return size;
+	}
+	return begin;
+}
+
+bool osm2prolog_decodeBlobs(parseState * state, const char * data, size_t size, size_t offset) {
+	size_t pos = 0;
+	size_t blobstart;
+	size_t rawsize;
+	uint8_t * raw;
+	pbfBuffer type;
+	pbfBuffer blob;
+	pbfBuffer block;
+	bool ok = true;
+
+	while (ok && pos < size) {
+		blobstart = pos;
+		if (!readBlobHeader(data, size, &pos, &type, &blob)) {
+			fprintf(stderr, "Error: malformed blob header at offset %zu.\n", offset + blobstart);
+			return false;
+		}
+		/* only OSMHeader and OSMData are defined, skip anything else */
+		if (!isType(type, "OSMHeader") && !isType(type, "OSMData"))
+			continue;
+
+		raw = inflateBlob(blob, &rawsize);
+		if (!raw) {
+			fprintf(stderr, "Error: cannot decompress blob at offset %zu.\n", offset + blobstart);
+			return false;
+		}
+		block.pos = raw;
+		block.end = raw + rawsize;
+
+		ok = isType(type, "OSMHeader")
+			? decodeHeaderBlock(block)
+			: decodePrimitiveBlock(state, block);
+		if (!ok)
+			fprintf(stderr, "Error: malformed %s block at offset %zu.\n",
+					isType(type, "OSMHeader") ? "header" : "data", offset + blobstart);
+
+		xmlFree(raw);
+	}
+	return ok;
+}
+
+int osm2prolog_parsePBFFile(parseState * state, const char * filename) {
+	size_t size = 0;
+	const char * data = osm2prolog_mapFile(filename, &size);
+	uint_least64_t elements;
+	uint_least64_t resume = 0;
+	size_t begin;
+	size_t end;
+	bool ok;
+
+	if (!data)
+		return 1;
+	if (!osm2prolog_isPBF(data, size)) {
+		osm2prolog_unmapFile(data, size);
+		return 1;
+	}
+
+	/* in slices, so progress can be reported and checkpoints written */
+	osm2prolog_startDocument(state);
+	ok = !state->checkpoint || osm2prolog_resumeConversion(state, &resume);
+	for (begin = (size_t)resume; ok && begin < size; begin = end) {
+		end = (size - begin <= OSM_PROGRESS_STEP) ? size : osm2prolog_pbfBoundary(data, size, begin, begin + OSM_PROGRESS_STEP);
+		elements = osm2prolog_elementCount(state);
+		ok = osm2prolog_decodeBlobs(state, data + begin, end - begin, begin);
+		osm2prolog_addProgress(end - begin, osm2prolog_elementCount(state) - elements);
+		if (ok && state->checkpoint)
+			osm2prolog_passCheckpoint(state, end);
+	}
+	osm2prolog_endDocument(state);
+
+	osm2prolog_unmapFile(data, size);
+	return ok ? 0 : -1;
+}
+
+
+
+/************/
+/* protobuf */
+/************/
+static bool readVarint(pbfBuffer * buf, uint64_t * value) {
+	uint64_t result = 0;
+	unsigned int shift;
+
+	for (shift = 0; shift < 64 && buf->pos < buf->end; shift += 7) {
+		result |= (uint64_t)(*buf->pos & 0x7F) << shift;
+		if (!(*buf->pos++ & 0x80)) {
+			*value = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* reads the next field of a message, returns false at the end of the
+ * message or on malformed input (check atEnd to tell them apart) */
+static bool readField(pbfBuffer * buf, pbfField * field) {
+	uint64_t key;
+	uint64_t len;
+
+	if (atEnd(buf) || !readVarint(buf, &key))
+		return false;
+	field->number = (uint32_t)(key >> 3);
+	field->value = 0;
+
+	switch (key & 0x7) {
+		case WIRE_VARINT:
+			return readVarint(buf, &field->value);
+		case WIRE_FIXED64:
+			if (buf->end - buf->pos < 8)
+				return false;
+			buf->pos += 8;
+			return true;
+		case WIRE_BYTES:
+			if (!readVarint(buf, &len) || len > (uint64_t)(buf->end - buf->pos))
+				return false;
+			field->bytes.pos = buf->pos;
+			field->bytes.end = buf->pos + len;
+			buf->pos += len;
+			return true;
+		case WIRE_FIXED32:
+			if (buf->end - buf->pos < 4)
+				return false;
+			buf->pos += 4;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static inline int_least64_t zigzag(uint64_t value) {
+	return (int_least64_t)(value >> 1) ^ -(int_least64_t)(value & 1);
+}
+
+/* delta coded values are summed unsigned, so corrupt input can't overflow */
+static inline int_least64_t addDelta(int_least64_t sum, uint64_t value) {
+	return (int_least64_t)((uint_least64_t)sum + (uint_least64_t)zigzag(value));
+}
+
+/* coordinates are stored in nanodegrees, which this rounds (half away from
+ * zero) to the fixed point of the element layer */
+static inline int32_t fixedDegrees(int_least64_t offset, int_least64_t granularity, int_least64_t value) {
+	const int_least64_t nanodegrees = (int_least64_t)((uint_least64_t)offset + (uint_least64_t)granularity * (uint_least64_t)value);
+	uint_least64_t magnitude = (nanodegrees < 0) ? (uint_least64_t)0 - (uint_least64_t)nanodegrees : (uint_least64_t)nanodegrees;
+
+	magnitude = magnitude / 100 + (magnitude % 100 >= 50);
+	if (magnitude > (uint_least64_t)INT32_MAX)
+		return OSM_COORD_UNUSABLE;
+	return (nanodegrees < 0) ? -(int32_t)magnitude : (int32_t)magnitude;
+}
+
+static inline bool atEnd(const pbfBuffer * buf) {
+	return buf->pos >= buf->end;
+}
+
+
+
+/*********/
+/* blobs */
+/*********/
+/* reads the blob at *offset, and advances offset past it */
+static bool readBlobHeader(const char * data, size_t size, size_t * offset, pbfBuffer * type, pbfBuffer * blob) {
+	const uint8_t * pos = (const uint8_t *)data + *offset;
+	pbfBuffer header;
+	pbfField field;
+	uint64_t datasize = 0;
+	bool hastype = false;
+	size_t headersize;
+
+	if (size - *offset < 4)
+		return false;
+	headersize = ((size_t)pos[0] << 24) | ((size_t)pos[1] << 16) | ((size_t)pos[2] << 8) | (size_t)pos[3];
+	if (headersize > MAX_BLOB_HEADER_SIZE || headersize > size - *offset - 4)
+		return false;
+
+	header.pos = pos + 4;
+	header.end = header.pos + headersize;
+	while (readField(&header, &field)) {
+		if (1 == field.number) {
+			*type = field.bytes;
+			hastype = true;
+		}
+		else if (3 == field.number)
+			datasize = field.value;
+	}
+	if (!atEnd(&header) || !hastype || datasize > MAX_BLOB_SIZE || datasize > size - *offset - 4 - headersize)
+		return false;
+
+	blob->pos = header.end;
+	blob->end = header.end + datasize;
+	*offset += 4 + headersize + (size_t)datasize;
+	return true;
+}
+
+/* returns the uncompressed contents of a blob in a new buffer */
+static uint8_t * inflateBlob(pbfBuffer blob, size_t * size) {
+	pbfField field;
+	pbfBuffer raw = {NULL, NULL};
+	pbfBuffer zdata = {NULL, NULL};
+	uint64_t rawsize = 0;
+	uint8_t * dest;
+	uLongf destlen;
+
+	while (readField(&blob, &field)) {
+		switch (field.number) {
+			case 1:
+				raw = field.bytes;
+				break;
+			case 2:
+				rawsize = field.value;
+				break;
+			case 3:
+				zdata = field.bytes;
+				break;
+			default:
+				/* lzma, bzip2, lz4 and zstd blobs are not supported */
+				break;
+		}
+	}
+	if (!atEnd(&blob))
+		return NULL;
+
+	if (raw.pos) {
+		*size = (size_t)(raw.end - raw.pos);
+		dest = xmlMalloc(*size + 1);
+		memcpy(dest, raw.pos, *size);
+		return dest;
+	}
+
+	if (!zdata.pos || rawsize > MAX_BLOB_SIZE)
+		return NULL;
+	destlen = (uLongf)rawsize;
+	dest = xmlMalloc((size_t)rawsize + 1);
+	if (Z_OK != uncompress(dest, &destlen, zdata.pos, (uLong)(zdata.end - zdata.pos)) || destlen != rawsize) {
+		xmlFree(dest);
+		return NULL;
+	}
+	*size = (size_t)destlen;
+	return dest;
+}
+
+
+
+/**********/
+/* blocks */
+/**********/
+/* checks that we know all features the file requires */
+static bool decodeHeaderBlock(pbfBuffer buf) {
+	static const char * const supported[] = {"OsmSchema-V0.6", "DenseNodes"};
+	pbfField field;
+	size_t i;
+
+	while (readField(&buf, &field)) {
+		/* required_features */
+		if (4 != field.number)
+			continue;
+		for (i = 0; i < sizeof(supported) / sizeof(supported[0]); ++i) {
+			if (isType(field.bytes, supported[i]))
+				break;
+		}
+		if (i == sizeof(supported) / sizeof(supported[0])) {
+			fprintf(stderr, "Error: unsupported PBF feature: %.*s\n",
+					(int)(field.bytes.end - field.bytes.pos), field.bytes.pos);
+			return false;
+		}
+	}
+	return atEnd(&buf);
+}
+
+static bool decodePrimitiveBlock(parseState * state, pbfBuffer buf) {
+	pbfBlock block = {NULL, 0, 100, 0, 0};
+	pbfBuffer groups = buf;
+	pbfBuffer group;
+	pbfField field;
+	bool ok = true;
+
+	/* the block parameters may follow the groups, so find them first */
+	while (ok && readField(&buf, &field)) {
+		switch (field.number) {
+			case 1:
+				ok = readStringTable(field.bytes, &block);
+				break;
+			case 17:
+				block.granularity = (int_least64_t)field.value;
+				break;
+			case 19:
+				block.latoffset = (int_least64_t)field.value;
+				break;
+			case 20:
+				block.lonoffset = (int_least64_t)field.value;
+				break;
+			default:
+				break;
+		}
+	}
+	ok = ok && atEnd(&buf);
+
+	while (ok && readField(&groups, &field)) {
+		if (2 != field.number)
+			continue;
+		group = field.bytes;
+		while (ok && readField(&group, &field)) {
+			switch (field.number) {
+				case 1:
+					ok = decodeNode(state, &block, field.bytes);
+					break;
+				case 2:
+					ok = decodeDenseNodes(state, &block, field.bytes);
+					break;
+				case 3:
+					ok = decodeWay(state, &block, field.bytes);
+					break;
+				default:
+					/* relations and changesets are ignored */
+					break;
+			}
+		}
+		ok = ok && atEnd(&group);
+	}
+
+	xmlFree(block.strings);
+	return ok;
+}
+
+static bool readStringTable(pbfBuffer buf, pbfBlock * block) {
+	pbfBuffer table = buf;
+	pbfField field;
+	size_t count = 0;
+
+	while (readField(&table, &field))
+		count += (1 == field.number);
+	if (!atEnd(&table))
+		return false;
+
+	xmlFree(block->strings);
+	block->strings = xmlMalloc((count ? count : 1) * sizeof(osmSlice));
+	block->numstrings = 0;
+	while (readField(&buf, &field)) {
+		if (1 != field.number)
+			continue;
+		block->strings[block->numstrings].str = field.bytes.pos;
+		block->strings[block->numstrings].len = (size_t)(field.bytes.end - field.bytes.pos);
+		++block->numstrings;
+	}
+	return true;
+}
+
+
+
+/************/
+/* elements */
+/************/
+static bool decodeNode(parseState * state, const pbfBlock * block, pbfBuffer buf) {
+	pbfBuffer keys = {NULL, NULL};
+	pbfBuffer vals = {NULL, NULL};
+	pbfField field;
+	int_least64_t id = 0;
+	int_least64_t lat = 0;
+	int_least64_t lon = 0;
+	bool ok;
+
+	while (readField(&buf, &field)) {
+		switch (field.number) {
+			case 1:
+				id = zigzag(field.value);
+				break;
+			case 2:
+				keys = field.bytes;
+				break;
+			case 3:
+				vals = field.bytes;
+				break;
+			case 8:
+				lat = zigzag(field.value);
+				break;
+			case 9:
+				lon = zigzag(field.value);
+				break;
+			default:
+				break;
+		}
+	}
+	if (!atEnd(&buf))
+		return false;
+
+	osm2prolog_startNode(state, id, fixedDegrees(block->latoffset, block->granularity, lat),
+			fixedDegrees(block->lonoffset, block->granularity, lon));
+	ok = emitTags(state, block, keys, vals);
+	osm2prolog_endElement(state, NODE);
+	return ok;
+}
+
+/* dense nodes store ids and coordinates delta coded in parallel arrays, and
+ * all tags in one array of key, value, ..., 0 sequences */
+static bool decodeDenseNodes(parseState * state, const pbfBlock * block, pbfBuffer buf) {
+	pbfBuffer ids = {NULL, NULL};
+	pbfBuffer lats = {NULL, NULL};
+	pbfBuffer lons = {NULL, NULL};
+	pbfBuffer keysvals = {NULL, NULL};
+	pbfField field;
+	uint64_t value;
+	uint64_t key;
+	int_least64_t id = 0;
+	int_least64_t lat = 0;
+	int_least64_t lon = 0;
+	bool ok = true;
+
+	while (readField(&buf, &field)) {
+		switch (field.number) {
+			case 1:
+				ids = field.bytes;
+				break;
+			case 8:
+				lats = field.bytes;
+				break;
+			case 9:
+				lons = field.bytes;
+				break;
+			case 10:
+				keysvals = field.bytes;
+				break;
+			default:
+				break;
+		}
+	}
+	if (!atEnd(&buf))
+		return false;
+
+	while (ok && !atEnd(&ids)) {
+		if (!readVarint(&ids, &value))
+			return false;
+		id = addDelta(id, value);
+		if (!readVarint(&lats, &value))
+			return false;
+		lat = addDelta(lat, value);
+		if (!readVarint(&lons, &value))
+			return false;
+		lon = addDelta(lon, value);
+
+		osm2prolog_startNode(state, id, fixedDegrees(block->latoffset, block->granularity, lat),
+				fixedDegrees(block->lonoffset, block->granularity, lon));
+
+		/* a block without any tags may leave out keys_vals altogether */
+		while (ok && !atEnd(&keysvals)) {
+			if (!readVarint(&keysvals, &key))
+				return false;
+			if (0 == key)
+				break;
+			ok = readVarint(&keysvals, &value) && emitTag(state, block, key, value);
+		}
+
+		osm2prolog_endElement(state, NODE);
+	}
+	return ok;
+}
+
+static bool decodeWay(parseState * state, const pbfBlock * block, pbfBuffer buf) {
+	pbfBuffer keys = {NULL, NULL};
+	pbfBuffer vals = {NULL, NULL};
+	pbfBuffer refs = {NULL, NULL};
+	pbfField field;
+	uint64_t value;
+	int_least64_t id = 0;
+	int_least64_t ref = 0;
+	bool ok = true;
+
+	while (readField(&buf, &field)) {
+		switch (field.number) {
+			case 1:
+				id = (int_least64_t)field.value;
+				break;
+			case 2:
+				keys = field.bytes;
+				break;
+			case 3:
+				vals = field.bytes;
+				break;
+			case 8:
+				refs = field.bytes;
+				break;
+			default:
+				break;
+		}
+	}
+	if (!atEnd(&buf))
+		return false;
+
+	osm2prolog_startWay(state, id);
+	while (ok && !atEnd(&refs)) {
+		ok = readVarint(&refs, &value);
+		if (!ok)
+			break;
+		ref = addDelta(ref, value);
+		osm2prolog_addWayNode(state, ref);
+	}
+	ok = ok && emitTags(state, block, keys, vals);
+	osm2prolog_endElement(state, WAY);
+	return ok;
+}
+
+/* keys and vals are parallel packed arrays of string table indices */
+static bool emitTags(parseState * state, const pbfBlock * block, pbfBuffer keys, pbfBuffer vals) {
+	uint64_t key;
+	uint64_t val;
+
+	while (!atEnd(&keys)) {
+		if (!readVarint(&keys, &key) || !readVarint(&vals, &val)
+				|| !emitTag(state, block, key, val))
+			return false;
+	}
+	return true;
+}
+
+static bool emitTag(parseState * state, const pbfBlock * block, uint64_t key, uint64_t val) {
+	osmSlice attrs[_OSM_ELEMENT_SIZE_] = {{NULL, 0}};
+
+	if (key >= block->numstrings || val >= block->numstrings)
+		return false;
+
+	attrs[K] = block->strings[key];
+	attrs[V] = block->strings[val];
+	osm2prolog_startElement(state, TAG, attrs);
+	osm2prolog_endElement(state, TAG);
+	return true;
+}
+
+
+
+/********/
+/* UTIL */
+/********/
+/* compares a string field to a nul-terminated name */
+static inline bool isType(pbfBuffer type, const char * name) {
+	const size_t len = strlen(name);
+	return (size_t)(type.end - type.pos) == len && 0 == memcmp(type.pos, name, len);
+}
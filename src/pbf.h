@@ -0,0 +1,51 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* A reader for OSM PBF files (.osm.pbf).
+ *
+ * The file is a sequence of blobs: an OSMHeader blob, followed by OSMData
+ * blobs that each hold a zlib compressed (or raw) PrimitiveBlock. Nodes,
+ * dense nodes and ways are handed to the typed element handlers, with ids
+ * as integers and coordinates rounded to the element layer's fixed point,
+ * and tags to osm2prolog_startElement as slices into the block's string
+ * table. Relations are ignored, as they are in XML input. */
+
+#include "util.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* checks whether data starts with an OSM PBF blob header */
+bool osm2prolog_isPBF(const char * data, size_t size);
+
+/* returns the offset of the first blob boundary at or after 'from', walking
+ * the blobs starting at 'begin' (which must be a blob boundary), or 'size'
+ * if there is none */
+size_t osm2prolog_pbfBoundary(const char * data, size_t size, size_t begin, size_t from);
+
+/* calls the element handlers for all blobs in [data, data + size), which
+ * must start and end at blob boundaries. 'offset' is the position of 'data'
+ * in the input, used in messages. Returns false on malformed input. */
+bool osm2prolog_decodeBlobs(parseState * state, const char * data, size_t size, size_t offset);
+
+/* maps and decodes a whole file, including the document callbacks.
+ * Returns 0 on success, -1 on failure, or 1 without producing any output if
+ * the file is not a PBF file. */
+int osm2prolog_parsePBFFile(parseState * state, const char * filename);
@@ -0,0 +1,260 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pgcopy.h"
+#include "output.h"
+#include "types.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* record layout, as written by osm2prolog_putRecord */
+#define KEY_SIZE sizeof(int_least64_t)
+#define LEN_SIZE sizeof(uint_least32_t)
+#define HEADER_SIZE (KEY_SIZE + LEN_SIZE)
+
+/* one table file, and the records it got so far */
+typedef
+struct copyTable {
+	osmElement kind; /* NODE, WAY or TAG */
+	osmOutput * out;
+	unsigned char * pending; /* incomplete record data */
+	size_t size;
+	size_t cap;
+}
+copyTable;
+
+/************************/
+/* forward declarations */
+/************************/
+static copyTable * openTable(osmElement kind, const char * prefix, const char * name);
+static bool closeTable(copyTable * table);
+static bool tableWrite(void * arg, const char * data, size_t size);
+static bool tableClose(void * arg);
+static void handleRecord(copyTable * table, int_least64_t key, const unsigned char * payload, size_t len);
+static void putCoordinate(osmOutput * out, const unsigned char * fixedpoint);
+static void putInt16(osmOutput * out, int_least16_t num);
+static void putInt32(osmOutput * out, int_least32_t num);
+static void putInt64(osmOutput * out, int_least64_t num);
+
+/***********/
+/* opening */
+/***********/
+bool osm2prolog_openCopyTables(const char * prefix, osmOutput ** node, osmOutput ** way, osmOutput ** nodetag, osmOutput ** waytag) {
+	copyTable * tables[4];
+	bool ok = true;
+	size_t i;
+
+	tables[0] = openTable(NODE, prefix, "node");
+	tables[1] = openTable(WAY, prefix, "way");
+	tables[2] = openTable(TAG, prefix, "nodetag");
+	tables[3] = openTable(TAG, prefix, "waytag");
+	for (i = 0; i < 4; ++i)
+		ok = ok && tables[i];
+
+	if (!ok) {
+		for (i = 0; i < 4; ++i)
+			if (tables[i])
+				closeTable(tables[i]);
+		return false;
+	}
+
+	*node = osm2prolog_openSinkOutput(tableWrite, tableClose, tables[0]);
+	*way = osm2prolog_openSinkOutput(tableWrite, tableClose, tables[1]);
+	*nodetag = osm2prolog_openSinkOutput(tableWrite, tableClose, tables[2]);
+	*waytag = osm2prolog_openSinkOutput(tableWrite, tableClose, tables[3]);
+	return true;
+}
+
+/* creates <prefix>_<name>.pgcopy and writes its header */
+static copyTable * openTable(osmElement kind, const char * prefix, const char * name) {
+	size_t prefixlen = strlen(prefix);
+	size_t namelen = strlen(name);
+	char * filename = xmlMalloc(prefixlen + namelen + 9);
+	copyTable * table;
+	osmOutput * out;
+
+	memcpy(filename, prefix, prefixlen);
+	filename[prefixlen] = '_';
+	memcpy(filename + prefixlen + 1, name, namelen);
+	memcpy(filename + prefixlen + 1 + namelen, ".pgcopy", 8);
+	out = osm2prolog_openOutput(filename);
+	xmlFree(filename);
+	if (!out)
+		return NULL;
+
+	/* signature, flags, header extension length */
+	osm2prolog_put(out, OSM_PGCOPY_SIGNATURE, OSM_PGCOPY_SIGNATURE_SIZE);
+	putInt32(out, 0);
+	putInt32(out, 0);
+
+	table = xmlMalloc(sizeof(copyTable));
+	memset(table, 0, sizeof(copyTable));
+	table->kind = kind;
+	table->out = out;
+	return table;
+}
+
+/* writes the trailer */
+static bool closeTable(copyTable * table) {
+	bool ok;
+
+	putInt16(table->out, -1);
+	ok = osm2prolog_closeOutput(table->out);
+	xmlFree(table->pending);
+	xmlFree(table);
+	return ok;
+}
+
+
+
+/**********/
+/* tables */
+/**********/
+/* records may be split over several calls, the rest of one is kept */
+static bool tableWrite(void * arg, const char * data, size_t size) {
+	copyTable * table = arg;
+	size_t pos = 0;
+	uint_least32_t paylen;
+	int_least64_t key;
+
+	if (table->size + size > table->cap) {
+		table->cap = table->cap ? table->cap : 64 * 1024;
+		while (table->size + size > table->cap)
+			table->cap *= 2;
+		table->pending = xmlRealloc(table->pending, table->cap);
+	}
+	memcpy(table->pending + table->size, data, size);
+	table->size += size;
+
+	while (pos + HEADER_SIZE <= table->size) {
+		memcpy(&paylen, table->pending + pos + KEY_SIZE, LEN_SIZE);
+		if (pos + HEADER_SIZE + paylen > table->size)
+			break;
+		memcpy(&key, table->pending + pos, KEY_SIZE);
+		handleRecord(table, key, table->pending + pos + HEADER_SIZE, paylen);
+		pos += HEADER_SIZE + paylen;
+	}
+	memmove(table->pending, table->pending + pos, table->size - pos);
+	table->size -= pos;
+	return true;
+}
+
+static bool tableClose(void * arg) {
+	copyTable * table = arg;
+	bool ok = true;
+
+	if (table->size > 0) {
+		fprintf(stderr, "INTERNAL ERROR: incomplete record in PostgreSQL COPY output.\n");
+		ok = false;
+	}
+	return closeTable(table) && ok;
+}
+
+/* writes one record (see print.c for the payloads) as a row */
+static void handleRecord(copyTable * table, int_least64_t key, const unsigned char * payload, size_t len) {
+	osmOutput * out = table->out;
+	const size_t numnodes = len / sizeof(int_least64_t);
+	int_least64_t nodeid;
+	uint_least32_t keylen;
+	size_t i;
+
+	switch (table->kind) {
+		case NODE:
+			putInt16(out, 3);
+			putInt32(out, 8);
+			putInt64(out, key);
+			putCoordinate(out, payload);
+			putCoordinate(out, payload + sizeof(int32_t));
+			break;
+		case WAY:
+			putInt16(out, 2);
+			putInt32(out, 8);
+			putInt64(out, key);
+			/* dimensions, no NULLs, element type, number of elements, lower bound */
+			putInt32(out, (int_least32_t)(5 * 4 + numnodes * (4 + 8)));
+			putInt32(out, 1);
+			putInt32(out, 0);
+			putInt32(out, OSM_PGCOPY_INT8OID);
+			putInt32(out, (int_least32_t)numnodes);
+			putInt32(out, 1);
+			for (i = 0; i < numnodes; ++i) {
+				memcpy(&nodeid, payload + i * sizeof(nodeid), sizeof(nodeid));
+				putInt32(out, 8);
+				putInt64(out, nodeid);
+			}
+			break;
+		default:
+			memcpy(&keylen, payload, sizeof(keylen));
+			payload += sizeof(keylen);
+			putInt16(out, 3);
+			putInt32(out, 8);
+			putInt64(out, key);
+			putInt32(out, (int_least32_t)keylen);
+			osm2prolog_put(out, payload, keylen);
+			putInt32(out, (int_least32_t)(len - sizeof(keylen) - keylen));
+			osm2prolog_put(out, payload + keylen, len - sizeof(keylen) - keylen);
+	}
+}
+
+/* a float8 field of a fixed point coordinate of a record, NULL if it did
+ * not fit; dividing the exact fixed point value gives the double nearest
+ * to its decimal notation */
+static void putCoordinate(osmOutput * out, const unsigned char * fixedpoint) {
+	int32_t fixed;
+	double degrees;
+	int_least64_t bits;
+
+	memcpy(&fixed, fixedpoint, sizeof(fixed));
+	if (OSM_COORD_UNUSABLE == fixed) {
+		putInt32(out, -1);
+		return;
+	}
+	degrees = (double)fixed / OSM_COORD_SCALE;
+	memcpy(&bits, &degrees, sizeof(bits));
+	putInt32(out, 8);
+	putInt64(out, bits);
+}
+
+static void putInt16(osmOutput * out, int_least16_t num) {
+	const uint_least16_t u = (uint_least16_t)num;
+	const unsigned char buf[2] = {(unsigned char)(u >> 8), (unsigned char)u};
+
+	osm2prolog_put(out, buf, sizeof(buf));
+}
+
+static void putInt32(osmOutput * out, int_least32_t num) {
+	const uint_least32_t u = (uint_least32_t)num;
+	const unsigned char buf[4] = {(unsigned char)(u >> 24), (unsigned char)(u >> 16), (unsigned char)(u >> 8), (unsigned char)u};
+
+	osm2prolog_put(out, buf, sizeof(buf));
+}
+
+static void putInt64(osmOutput * out, int_least64_t num) {
+	const uint_least64_t u = (uint_least64_t)num;
+	unsigned char buf[8];
+	size_t i;
+
+	for (i = 0; i < sizeof(buf); ++i)
+		buf[i] = (unsigned char)(u >> (56 - 8 * i));
+	osm2prolog_put(out, buf, sizeof(buf));
+}
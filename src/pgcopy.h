@@ -0,0 +1,63 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* PostgreSQL binary COPY tables.
+ *
+ * Every table is a file <prefix>_<table>.pgcopy in the binary format of
+ * PostgreSQL's COPY (see "COPY - File Formats" in its documentation), to be
+ * loaded into tables like these with COPY ... FROM ... WITH (FORMAT binary):
+ *
+ *   CREATE TABLE node (id int8, lat float8, lon float8);
+ *   CREATE TABLE way (id int8, nodes int8[]);
+ *   CREATE TABLE nodetag (id int8, k text, v text);
+ *   CREATE TABLE waytag (id int8, k text, v text);
+ *
+ * A file starts with the 11 byte signature "PGCOPY\n\377\r\n\0", a zero
+ * int32 of flags and a zero int32 header extension length, and ends with an
+ * int16 of -1. In between, every row is an int16 number of fields, each an
+ * int32 length followed by that many bytes of value, or a length of -1 for
+ * NULL. All integers are big-endian.
+ *
+ *   int8     8 byte integer
+ *   float8   IEEE 754 double; the coordinates are rounded to the 7
+ *            decimals of OSM_COORD_SCALE first, and those that do not fit
+ *            are NULL
+ *   text     the raw bytes, which the server expects in its encoding,
+ *            UTF-8 for OSM data
+ *   int8[]   int32 1 dimension, int32 0 (no NULLs), int32 element type 20
+ *            (int8), int32 number of elements, int32 lower bound 1, then per
+ *            element an int32 length of 8 and the int8
+ *
+ * The tables take the records of sort.h, so they work with -j and -sorted
+ * in the same way as the text tables. */
+
+#include "output.h"
+
+#include <stdbool.h>
+
+#define OSM_PGCOPY_SIGNATURE "PGCOPY\n\377\r\n"
+/* the signature includes its nul byte */
+#define OSM_PGCOPY_SIGNATURE_SIZE 11
+/* the oid of int8 in pg_type */
+#define OSM_PGCOPY_INT8OID 20
+
+/* opens the table outputs of PGCOPY mode, which create the table files for
+ * the given prefix; returns false on failure, with nothing left open */
+bool osm2prolog_openCopyTables(const char * prefix, osmOutput ** node, osmOutput ** way, osmOutput ** nodetag, osmOutput ** waytag);
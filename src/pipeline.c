@@ -0,0 +1,326 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pipeline.h"
+#include "locations.h"
+#include "print.h"
+#include "shard.h"
+#include "types.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* batches are handed to the format thread when they are this full */
+#define BATCH_SIZE ((size_t)1024 * 1024)
+/* number of batches the parser may run ahead of the format thread */
+#define NUM_BATCHES 4
+/* records start at multiples of this, for the node ids of ways */
+#define RECORD_ALIGN sizeof(int_least64_t)
+
+typedef
+enum recordType {
+	NODE_RECORD,
+	WAY_RECORD, /* followed by the node ids, and their locations with geometry */
+	TAG_RECORD, /* followed by the key and the value */
+	DELETION_RECORD
+}
+recordType;
+
+/* followed by the lengths[0] + lengths[1] bytes of the record, see recordType */
+typedef
+struct recordHeader {
+	int_least64_t id;
+	uint_least32_t type;
+	uint_least32_t element; /* the parent of a tag, or the deleted element */
+	size_t lengths[2]; /* lat and lon, key and value, or node ids and locations */
+	int32_t coords[2]; /* the lat and lon of a node in fixed point */
+}
+recordHeader;
+
+typedef
+struct batch {
+	char * data;
+	size_t size;
+	size_t cap;
+}
+batch;
+
+struct osmPipeline {
+	parseState * format; /* prints the records, owns the outputs */
+	pthread_t thread;
+	batch batches[NUM_BATCHES];
+
+	/* protected by lock */
+	size_t filled; /* number of batches queued by the parser */
+	size_t consumed; /* number of batches printed */
+	bool stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static char * addRecord(osmPipeline * pipeline, const recordHeader * header);
+static void queueBatch(osmPipeline * pipeline);
+static void * formatter(void * arg);
+static void printBatch(parseState * format, const batch * b);
+
+/*****************/
+/* the interface */
+/*****************/
+void osm2prolog_startPipeline(parseState * state) {
+	osmPipeline * pipeline = xmlMalloc(sizeof(osmPipeline));
+	osmOutput ** slots[OSM_OUTPUT_SLOTS];
+	size_t i;
+
+	memset(pipeline, 0, sizeof(osmPipeline));
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->changed, NULL);
+	for (i = 0; i < NUM_BATCHES; ++i) {
+		pipeline->batches[i].cap = BATCH_SIZE;
+		pipeline->batches[i].data = xmlMalloc(BATCH_SIZE);
+	}
+
+	/* the format state shares everything but the outputs, which only it uses */
+	pipeline->format = xmlMalloc(sizeof(parseState));
+	memcpy(pipeline->format, state, sizeof(parseState));
+	if (0 != pthread_create(&pipeline->thread, NULL, formatter, pipeline)) {
+		fprintf(stderr, "Failed to start format thread, formatting without it.\n");
+		for (i = 0; i < NUM_BATCHES; ++i)
+			xmlFree(pipeline->batches[i].data);
+		xmlFree(pipeline->format);
+		pthread_cond_destroy(&pipeline->changed);
+		pthread_mutex_destroy(&pipeline->lock);
+		xmlFree(pipeline);
+		return;
+	}
+	osm2prolog_outputSlots(state, slots);
+	for (i = 0; i < OSM_OUTPUT_SLOTS; ++i)
+		*slots[i] = NULL;
+	state->shards = NULL;
+	state->pipeline = pipeline;
+}
+
+void osm2prolog_queueNode(parseState * state) {
+	recordHeader header = { state->parentid, NODE_RECORD, NODE, { 0, 0 }, { state->latfixed, state->lonfixed } };
+	char * data;
+
+	header.lengths[0] = strlen((const char *)state->lat);
+	header.lengths[1] = strlen((const char *)state->lon);
+	data = addRecord(state->pipeline, &header);
+	memcpy(data, state->lat, header.lengths[0]);
+	memcpy(data + header.lengths[0], state->lon, header.lengths[1]);
+}
+
+void osm2prolog_queueWay(parseState * state) {
+	recordHeader header = { state->parentid, WAY_RECORD, WAY, { 0, 0 }, { 0, 0 } };
+	int32_t * coords;
+	char * data;
+	size_t i;
+
+	header.lengths[0] = state->numways * sizeof(int_least64_t);
+	if (state->locations)
+		header.lengths[1] = state->numways * 2 * sizeof(int32_t);
+	data = addRecord(state->pipeline, &header);
+	memcpy(data, state->waynodeids, header.lengths[0]);
+	if (!state->locations)
+		return;
+	coords = (int32_t *)(data + header.lengths[0]);
+	for (i = 0; i < state->numways; ++i) {
+		if (!osm2prolog_getLocation(state->locations, state->waynodeids[i], &coords[2 * i], &coords[2 * i + 1]))
+			coords[2 * i] = coords[2 * i + 1] = OSM_COORD_UNUSABLE;
+	}
+}
+
+void osm2prolog_queueTag(parseState * state) {
+	recordHeader header = { state->parentid, TAG_RECORD, state->parent, { state->tagkey.len, state->tagvalue.len }, { 0, 0 } };
+	char * data = addRecord(state->pipeline, &header);
+
+	memcpy(data, state->tagkey.str, state->tagkey.len);
+	memcpy(data + state->tagkey.len, state->tagvalue.str, state->tagvalue.len);
+}
+
+void osm2prolog_queueDeletion(parseState * state, osmElement element) {
+	recordHeader header = { state->parentid, DELETION_RECORD, element, { 0, 0 }, { 0, 0 } };
+
+	addRecord(state->pipeline, &header);
+}
+
+void osm2prolog_drainPipeline(parseState * state) {
+	osmPipeline * pipeline = state->pipeline;
+
+	queueBatch(pipeline);
+	pthread_mutex_lock(&pipeline->lock);
+	while (pipeline->consumed < pipeline->filled)
+		pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+bool osm2prolog_stopPipeline(parseState * state) {
+	osmPipeline * pipeline = state->pipeline;
+	parseState * format = pipeline->format;
+	size_t i;
+	bool ok;
+
+	queueBatch(pipeline);
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->stopping = true;
+	pthread_cond_broadcast(&pipeline->changed);
+	pthread_mutex_unlock(&pipeline->lock);
+	pthread_join(pipeline->thread, NULL);
+
+	/* the state gets the shards back, to free them */
+	ok = osm2prolog_closeOutputs(format);
+	state->shards = format->shards;
+	state->pipeline = NULL;
+
+	xmlFree(format);
+	for (i = 0; i < NUM_BATCHES; ++i)
+		xmlFree(pipeline->batches[i].data);
+	pthread_cond_destroy(&pipeline->changed);
+	pthread_mutex_destroy(&pipeline->lock);
+	xmlFree(pipeline);
+	return ok;
+}
+
+
+
+/*************/
+/* the queue */
+/*************/
+/* returns room for the header's lengths of record data, in the batch being
+ * filled, queueing it first if the record doesn't fit */
+static char * addRecord(osmPipeline * pipeline, const recordHeader * header) {
+	size_t len = sizeof(recordHeader) + header->lengths[0] + header->lengths[1];
+	batch * b = &pipeline->batches[pipeline->filled % NUM_BATCHES];
+	char * record;
+
+	len = (len + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+	if (b->size + len > b->cap) {
+		queueBatch(pipeline);
+		b = &pipeline->batches[pipeline->filled % NUM_BATCHES];
+		/* for records that don't fit in any batch */
+		if (len > b->cap) {
+			b->cap = len;
+			b->data = xmlRealloc(b->data, len);
+		}
+	}
+	record = b->data + b->size;
+	memcpy(record, header, sizeof(recordHeader));
+	b->size += len;
+	return record + sizeof(recordHeader);
+}
+
+/* hands the batch being filled to the format thread, and waits for the
+ * next one to be free */
+static void queueBatch(osmPipeline * pipeline) {
+	if (0 == pipeline->batches[pipeline->filled % NUM_BATCHES].size)
+		return;
+
+	pthread_mutex_lock(&pipeline->lock);
+	++pipeline->filled;
+	pthread_cond_broadcast(&pipeline->changed);
+	while (pipeline->filled - pipeline->consumed >= NUM_BATCHES)
+		pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+/* prints batches until the pipeline stops */
+static void * formatter(void * arg) {
+	osmPipeline * pipeline = arg;
+	batch * b;
+
+	for (;;) {
+		pthread_mutex_lock(&pipeline->lock);
+		while (pipeline->filled == pipeline->consumed && !pipeline->stopping)
+			pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+		if (pipeline->filled == pipeline->consumed) {
+			pthread_mutex_unlock(&pipeline->lock);
+			break;
+		}
+		b = &pipeline->batches[pipeline->consumed % NUM_BATCHES];
+		pthread_mutex_unlock(&pipeline->lock);
+
+		printBatch(pipeline->format, b);
+		b->size = 0;
+
+		pthread_mutex_lock(&pipeline->lock);
+		++pipeline->consumed;
+		pthread_cond_broadcast(&pipeline->changed);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+	return NULL;
+}
+
+
+
+/**************/
+/* formatting */
+/**************/
+/* sets the fields of the format state that the print functions use */
+static void printBatch(parseState * format, const batch * b) {
+	const recordHeader * header;
+	const char * data;
+	size_t pos;
+	size_t len;
+
+	for (pos = 0; pos < b->size; pos += (len + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN) {
+		header = (const recordHeader *)(b->data + pos);
+		data = b->data + pos + sizeof(recordHeader);
+		len = sizeof(recordHeader) + header->lengths[0] + header->lengths[1];
+
+		format->parentid = header->id;
+		osm2prolog_selectShard(format, header->id);
+		switch (header->type) {
+			case NODE_RECORD:
+				memcpy(format->lat, data, header->lengths[0]);
+				format->lat[header->lengths[0]] = '\0';
+				memcpy(format->lon, data + header->lengths[0], header->lengths[1]);
+				format->lon[header->lengths[1]] = '\0';
+				format->latfixed = header->coords[0];
+				format->lonfixed = header->coords[1];
+				printNode(strConstants[NODE], format);
+				break;
+			case WAY_RECORD:
+				format->numways = header->lengths[0] / sizeof(int_least64_t);
+				format->waynodeids = (int_least64_t *)data;
+				format->waycoords = header->lengths[1] ? (const int32_t *)(data + header->lengths[0]) : NULL;
+				printWay(strConstants[WAY], format);
+				break;
+			case TAG_RECORD:
+				format->parent = (osmElement)header->element;
+				format->tagprefix = strConstants[format->parent];
+				format->tagkey.str = (const xmlChar *)data;
+				format->tagkey.len = header->lengths[0];
+				format->tagvalue.str = (const xmlChar *)(data + header->lengths[0]);
+				format->tagvalue.len = header->lengths[1];
+				printTag(strConstants[TAG], format);
+				break;
+			case DELETION_RECORD:
+			default:
+				printDeletion((osmElement)header->element, format);
+				break;
+		}
+	}
+}
@@ -0,0 +1,60 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Formatting on a thread of its own.
+ *
+ * A conversion runs in four stages: reading (and decompressing) the input,
+ * parsing it, formatting the nodes, ways and tags, and writing the outputs.
+ * The -stages option lays them out over threads. Reading has its own
+ * thread in input.h, and writing in output.h (osm2prolog_startWriter); a
+ * pipeline puts formatting on a thread of its own.
+ *
+ * With a pipeline, the print functions of print.h copy what they would
+ * print into batches of records instead, which a format thread prints
+ * with a parseState of its own that takes over the outputs (and shards).
+ * Batches are queued in a small ring, so the parser can run ahead by a few
+ * batches. The format thread never looks at the location store, which the
+ * parser is still filling: way records carry the locations of their nodes.
+ * The output is the same as without a pipeline. */
+
+#include "types.h"
+
+#include <stdbool.h>
+
+typedef struct osmPipeline osmPipeline;
+
+struct parseState;
+
+/* starts the format thread, which takes over the outputs of the state;
+ * without a thread, the state keeps printing itself */
+void osm2prolog_startPipeline(struct parseState * state);
+
+/* queue the current node, way, tag or deletion of the state, see print.h */
+void osm2prolog_queueNode(struct parseState * state);
+void osm2prolog_queueWay(struct parseState * state);
+void osm2prolog_queueTag(struct parseState * state);
+void osm2prolog_queueDeletion(struct parseState * state, osmElement element);
+
+/* waits until everything queued is printed, for a checkpoint */
+void osm2prolog_drainPipeline(struct parseState * state);
+
+/* prints the rest, stops the format thread and closes the outputs;
+ * returns false if a write failed */
+bool osm2prolog_stopPipeline(struct parseState * state);
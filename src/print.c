@@ -0,0 +1,454 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "print.h"
+#include "locations.h"
+#include "osm2prolog.h"
+#include "output.h"
+#include "pipeline.h"
+#include "sort.h"
+#include "types.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/xmlstring.h>
+
+/************************/
+/* forward declarations */
+/************************/
+static void putNodeRow(osmOutput * out, int_least64_t id, const xmlChar * lat, size_t latlen, const xmlChar * lon, size_t lonlen);
+static void putWayRow(osmOutput * out, int_least64_t id, int_least64_t nodeid);
+static void putWayGeomRow(osmOutput * out, int_least64_t id, int_least64_t nodeid, bool known, int32_t lat, int32_t lon);
+static void putWayGeomFact(osmOutput * out, const parseState * state);
+static bool getWayNodeLocation(const parseState * state, size_t i, int32_t * lat, int32_t * lon);
+static void putFixedPoint(osmOutput * out, int32_t coord);
+static void putTagRow(osmOutput * out, int_least64_t id, const xmlChar * key, size_t keylen, const xmlChar * value, size_t valuelen);
+static void putFactStart(osmOutput * out, const parseState * state);
+static void putFactEnd(osmOutput * out, const parseState * state);
+static void putRetraction(osmOutput * out, const xmlChar * name, const char * suffix, int_least64_t id, unsigned int args);
+
+/************/
+/* PRINTING */
+/************/
+void printWay(const xmlChar * name, parseState * state) {
+	osmOutput * out;
+	size_t i = 0;
+	size_t waysmaxidx = state->numways - 1;
+	int32_t coords[2];
+	bool known;
+	osmWay way;
+
+	if (state->pipeline) {
+		osm2prolog_queueWay(state);
+		return;
+	}
+	switch (state->printMode) {
+		case TABLE:
+		case BINARY:
+		case PGCOPY:
+			out = state->way_file;
+			if (state->locations && state->tableRecords) {
+				/* record: per node the id as int64, lat and lon as int32 fixed point */
+				osm2prolog_putRecord(out, state->parentid, state->numways * (sizeof(int_least64_t) + sizeof(coords)));
+				for (i = 0; i < state->numways; ++i) {
+					if (!getWayNodeLocation(state, i, &coords[0], &coords[1]))
+						coords[0] = coords[1] = OSM_COORD_UNUSABLE;
+					osm2prolog_put(out, &state->waynodeids[i], sizeof(int_least64_t));
+					osm2prolog_put(out, coords, sizeof(coords));
+				}
+				break;
+			}
+			if (state->locations) {
+				for (i = 0; i < state->numways; ++i) {
+					known = getWayNodeLocation(state, i, &coords[0], &coords[1]);
+					putWayGeomRow(out, state->parentid, state->waynodeids[i], known, coords[0], coords[1]);
+				}
+				break;
+			}
+			if (state->tableRecords) {
+				/* record: the node ids, as int64 */
+				osm2prolog_putRecord(out, state->parentid, state->numways * sizeof(int_least64_t));
+				osm2prolog_put(out, state->waynodeids, state->numways * sizeof(int_least64_t));
+				break;
+			}
+			while (i < state->numways)
+				putWayRow(out, state->parentid, (state->waynodeids)[i++]);
+			break;
+		case CALLBACK:
+			way.id = state->parentid;
+			way.nodes = state->waynodeids;
+			way.numnodes = state->numways;
+			if (state->callbacks->way && !state->stopped)
+				state->stopped = !state->callbacks->way(state->callbackarg, &way);
+			break;
+		case PL:
+		default:
+			/* print: "name(wayid, [list-of-nodeid])." */
+			out = state->splitPredicates ? state->way_file : state->prolog_file;
+			putFactStart(out, state);
+			osm2prolog_putString(out, (const char *)name);
+			osm2prolog_putChar(out, '(');
+			osm2prolog_putInt(out, state->parentid);
+			osm2prolog_put(out, ", [", 3);
+			while (i < waysmaxidx) {
+				osm2prolog_putInt(out, (state->waynodeids)[i++]);
+				osm2prolog_put(out, ", ", 2);
+			}
+			osm2prolog_putInt(out, state->waynodeids[waysmaxidx]);
+			osm2prolog_putChar(out, ']');
+			putFactEnd(out, state);
+			if (state->locations)
+				putWayGeomFact(state->splitPredicates ? state->waygeom_file : state->prolog_file, state);
+			break;
+	}
+}
+
+void printNode(const xmlChar * name, parseState * state) {
+	osmOutput * out;
+	size_t latlen;
+	size_t lonlen;
+	osmNode node;
+
+	if (state->pipeline) {
+		osm2prolog_queueNode(state);
+		return;
+	}
+	switch (state->printMode) {
+		case TABLE:
+			out = state->node_file;
+			latlen = strlen((const char *)state->lat);
+			lonlen = strlen((const char *)state->lon);
+			if (state->tableRecords) {
+				/* record: lat length as one byte, lat, lon */
+				osm2prolog_putRecord(out, state->parentid, 1 + latlen + lonlen);
+				osm2prolog_putChar(out, (char)latlen);
+				osm2prolog_put(out, state->lat, latlen);
+				osm2prolog_put(out, state->lon, lonlen);
+				break;
+			}
+			putNodeRow(out, state->parentid, state->lat, latlen, state->lon, lonlen);
+			break;
+		case BINARY:
+		case PGCOPY:
+			/* record: lat and lon in fixed point */
+			out = state->node_file;
+			osm2prolog_putRecord(out, state->parentid, 2 * sizeof(int32_t));
+			osm2prolog_put(out, &state->latfixed, sizeof(int32_t));
+			osm2prolog_put(out, &state->lonfixed, sizeof(int32_t));
+			break;
+		case CALLBACK:
+			node.id = state->parentid;
+			node.lat = state->latfixed;
+			node.lon = state->lonfixed;
+			if (state->callbacks->node && !state->stopped)
+				state->stopped = !state->callbacks->node(state->callbackarg, &node);
+			break;
+		case PL:
+		default:
+			/* print: "name(nodeid, lat, lon)." */
+			out = state->prolog_file;
+			putFactStart(out, state);
+			osm2prolog_putString(out, (const char *)name);
+			osm2prolog_putChar(out, '(');
+			osm2prolog_putInt(out, state->parentid);
+			osm2prolog_put(out, ", ", 2);
+			osm2prolog_putString(out, (const char *)state->lat);
+			osm2prolog_put(out, ", ", 2);
+			osm2prolog_putString(out, (const char *)state->lon);
+			putFactEnd(out, state);
+	}
+}	
+
+/* TODO unify tag prefix printing, and tag prefix file naming, or somesuch */
+void printTag(const xmlChar * name, parseState * state) {
+	osmOutput * tagfile = NULL;
+	uint_least32_t keylen;
+	bool (*callback)(void * arg, const osmTag * tag);
+	osmTag tag;
+
+	if (state->pipeline) {
+		osm2prolog_queueTag(state);
+		return;
+	}
+	/* first select tagfile */
+	switch (state->parent) {
+		case NODE:
+			tagfile = state->nodetag_file;
+			break;
+		case WAY:
+			tagfile = state->waytag_file;
+			break;
+		case _OSM_ELEMENT_UNSET_:
+			fprintf(stderr, "INTERNAL ERROR: trying to print tag element when parent element is not set. Aborting.\n");
+			fprintf(stderr, "key and value were: '%.*s' and '%.*s'\n",
+					(int)state->tagkey.len, state->tagkey.str, (int)state->tagvalue.len, state->tagvalue.str);
+			exit(EXIT_FAILURE);
+			break;
+		default:
+			fprintf(stderr, "ABORT: No table file for current tag element (tag inside %s element).\n", strConstants[state->parent]);
+			exit(EXIT_FAILURE);
+	}
+	if (state->tableRecords || state->tagRecords) {
+		/* record: key length as uint32, key, value, all unfiltered */
+		keylen = (uint_least32_t)state->tagkey.len;
+		osm2prolog_putRecord(tagfile, state->parentid, sizeof(keylen) + state->tagkey.len + state->tagvalue.len);
+		osm2prolog_put(tagfile, &keylen, sizeof(keylen));
+		osm2prolog_put(tagfile, state->tagkey.str, state->tagkey.len);
+		osm2prolog_put(tagfile, state->tagvalue.str, state->tagvalue.len);
+		return;
+	}
+
+	switch (state->printMode) {
+		case TABLE:
+		case BINARY:
+		case PGCOPY:
+			putTagRow(tagfile, state->parentid, state->tagkey.str, state->tagkey.len, state->tagvalue.str, state->tagvalue.len);
+			break;
+		case CALLBACK:
+			callback = (NODE == state->parent) ? state->callbacks->nodetag : state->callbacks->waytag;
+			tag.id = state->parentid;
+			tag.key = state->tagkey.str;
+			tag.keylen = state->tagkey.len;
+			tag.value = state->tagvalue.str;
+			tag.valuelen = state->tagvalue.len;
+			if (callback && !state->stopped)
+				state->stopped = !callback(state->callbackarg, &tag);
+			break;
+		case PL:
+		default:
+			/* print: tagprefix_name(parentid, key, value). */
+			if (!state->splitPredicates)
+				tagfile = state->prolog_file;
+			putFactStart(tagfile, state);
+			osm2prolog_putString(tagfile, (const char *)state->tagprefix);
+			osm2prolog_putChar(tagfile, '_');
+			osm2prolog_putString(tagfile, (const char *)name);
+			osm2prolog_putChar(tagfile, '(');
+			osm2prolog_putInt(tagfile, state->parentid);
+			osm2prolog_put(tagfile, ", '", 3);
+			osm2prolog_putEscaped(tagfile, state->tagkey.str, state->tagkey.len, ESCAPE_ATOM);
+			osm2prolog_put(tagfile, "', '", 4);
+			osm2prolog_putEscaped(tagfile, state->tagvalue.str, state->tagvalue.len, ESCAPE_ATOM);
+			osm2prolog_putChar(tagfile, '\'');
+			putFactEnd(tagfile, state);
+	}
+}
+
+void printDeletion(osmElement element, parseState * state) {
+	const bool node = (NODE == element);
+	osmOutput * out;
+
+	if (state->pipeline) {
+		osm2prolog_queueDeletion(state, element);
+		return;
+	}
+	switch (state->printMode) {
+		case TABLE:
+			/* print: "id" */
+			out = node ? state->nodedelete_file : state->waydelete_file;
+			osm2prolog_putInt(out, state->parentid);
+			osm2prolog_putChar(out, '\n');
+			break;
+		case BINARY:
+		case PGCOPY:
+		case CALLBACK:
+			/* no deletion tables */
+			break;
+		case PL:
+		default:
+			/* print: ":- retractall(name(id, _, ...))." for the element, its tags and its geometry */
+			out = (state->splitPredicates && !node) ? state->way_file : state->prolog_file;
+			putRetraction(out, strConstants[element], "", state->parentid, node ? 2 : 1);
+			out = state->splitPredicates ? (node ? state->nodetag_file : state->waytag_file) : state->prolog_file;
+			putRetraction(out, strConstants[element], "_tag", state->parentid, 2);
+			if (!node && state->locations)
+				putRetraction(state->splitPredicates ? state->waygeom_file : state->prolog_file,
+						strConstants[element], "_geom", state->parentid, 1);
+	}
+}
+
+void printDeclaration(osmOutput * out, const char * predicates, bool multifile) {
+	/* print: ":- dynamic predicates." */
+	osm2prolog_put(out, ":- dynamic ", 11);
+	osm2prolog_putString(out, predicates);
+	osm2prolog_put(out, ".\n", 2);
+	/* print: ":- multifile predicates." */
+	if (multifile) {
+		osm2prolog_put(out, ":- multifile ", 13);
+		osm2prolog_putString(out, predicates);
+		osm2prolog_put(out, ".\n", 2);
+	}
+}
+
+
+
+/*****************/
+/* SORTED TABLES */
+/*****************/
+void printNodeRecord(osmOutput * out, int_least64_t id, const unsigned char * payload, size_t len) {
+	size_t latlen = payload[0];
+
+	putNodeRow(out, id, payload + 1, latlen, payload + 1 + latlen, len - 1 - latlen);
+}
+
+void printWayRecord(osmOutput * out, int_least64_t id, const unsigned char * payload, size_t len) {
+	int_least64_t nodeid;
+	size_t i;
+
+	for (i = 0; i + sizeof(nodeid) <= len; i += sizeof(nodeid)) {
+		memcpy(&nodeid, payload + i, sizeof(nodeid));
+		putWayRow(out, id, nodeid);
+	}
+}
+
+void printWayGeomRecord(osmOutput * out, int_least64_t id, const unsigned char * payload, size_t len) {
+	int_least64_t nodeid;
+	int32_t coords[2];
+	size_t i;
+
+	for (i = 0; i + sizeof(nodeid) + sizeof(coords) <= len; i += sizeof(nodeid) + sizeof(coords)) {
+		memcpy(&nodeid, payload + i, sizeof(nodeid));
+		memcpy(coords, payload + i + sizeof(nodeid), sizeof(coords));
+		putWayGeomRow(out, id, nodeid, OSM_COORD_UNUSABLE != coords[0], coords[0], coords[1]);
+	}
+}
+
+void printTagRecord(osmOutput * out, int_least64_t id, const unsigned char * payload, size_t len) {
+	uint_least32_t keylen;
+
+	memcpy(&keylen, payload, sizeof(keylen));
+	payload += sizeof(keylen);
+	putTagRow(out, id, payload, keylen, payload + keylen, len - sizeof(keylen) - keylen);
+}
+
+/* print: "nodeid <tab> lat <tab> lon" */
+static void putNodeRow(osmOutput * out, int_least64_t id, const xmlChar * lat, size_t latlen, const xmlChar * lon, size_t lonlen) {
+	osm2prolog_putInt(out, id);
+	osm2prolog_putChar(out, '\t');
+	osm2prolog_put(out, lat, latlen);
+	osm2prolog_putChar(out, '\t');
+	osm2prolog_put(out, lon, lonlen);
+	osm2prolog_putChar(out, '\n');
+}
+
+/* print: "wayid <tab> nodeid" */
+static void putWayRow(osmOutput * out, int_least64_t id, int_least64_t nodeid) {
+	osm2prolog_putInt(out, id);
+	osm2prolog_putChar(out, '\t');
+	osm2prolog_putInt(out, nodeid);
+	osm2prolog_putChar(out, '\n');
+}
+
+/* print: "wayid <tab> nodeid <tab> lat <tab> lon", with empty coordinates
+ * for nodes without a location */
+static void putWayGeomRow(osmOutput * out, int_least64_t id, int_least64_t nodeid, bool known, int32_t lat, int32_t lon) {
+	osm2prolog_putInt(out, id);
+	osm2prolog_putChar(out, '\t');
+	osm2prolog_putInt(out, nodeid);
+	osm2prolog_putChar(out, '\t');
+	if (known)
+		putFixedPoint(out, lat);
+	osm2prolog_putChar(out, '\t');
+	if (known)
+		putFixedPoint(out, lon);
+	osm2prolog_putChar(out, '\n');
+}
+
+/* print: "way_geom(wayid, [(lat, lon), ...])." with none for nodes without a
+ * location */
+static void putWayGeomFact(osmOutput * out, const parseState * state) {
+	int32_t lat;
+	int32_t lon;
+	size_t i;
+
+	putFactStart(out, state);
+	osm2prolog_put(out, "way_geom(", 9);
+	osm2prolog_putInt(out, state->parentid);
+	osm2prolog_put(out, ", [", 3);
+	for (i = 0; i < state->numways; ++i) {
+		if (i > 0)
+			osm2prolog_put(out, ", ", 2);
+		if (!getWayNodeLocation(state, i, &lat, &lon)) {
+			osm2prolog_put(out, "none", 4);
+			continue;
+		}
+		osm2prolog_putChar(out, '(');
+		putFixedPoint(out, lat);
+		osm2prolog_put(out, ", ", 2);
+		putFixedPoint(out, lon);
+		osm2prolog_putChar(out, ')');
+	}
+	osm2prolog_putChar(out, ']');
+	putFactEnd(out, state);
+}
+
+/* the location of the i-th node of the current way; a format thread gets
+ * the locations the parser looked up with the way (see pipeline.h) */
+static bool getWayNodeLocation(const parseState * state, size_t i, int32_t * lat, int32_t * lon) {
+	if (!state->waycoords)
+		return osm2prolog_getLocation(state->locations, state->waynodeids[i], lat, lon);
+	*lat = state->waycoords[2 * i];
+	*lon = state->waycoords[2 * i + 1];
+	return OSM_COORD_UNUSABLE != *lat;
+}
+
+/* print: degrees with the 7 decimals of OSM_COORD_SCALE */
+static void putFixedPoint(osmOutput * out, int32_t coord) {
+	char buf[OSM_DEGREES_MAXLEN];
+
+	osm2prolog_put(out, buf, osm2prolog_formatDegrees(coord, 7, buf));
+}
+
+/* print "parentid <tab> key <tab> value", with tabs, newlines and backslashes in keys and values escaped */
+static void putTagRow(osmOutput * out, int_least64_t id, const xmlChar * key, size_t keylen, const xmlChar * value, size_t valuelen) {
+	osm2prolog_putInt(out, id);
+	osm2prolog_putChar(out, '\t');
+	osm2prolog_putEscaped(out, key, keylen, ESCAPE_FIELD);
+	osm2prolog_putChar(out, '\t');
+	osm2prolog_putEscaped(out, value, valuelen, ESCAPE_FIELD);
+	osm2prolog_putChar(out, '\n');
+}
+
+/* print: ":- assertz(" before the facts of an osmChange file */
+static void putFactStart(osmOutput * out, const parseState * state) {
+	if (state->changes)
+		osm2prolog_put(out, ":- assertz(", 11);
+}
+
+/* print: the end of a fact, closing the assertz of an osmChange file */
+static void putFactEnd(osmOutput * out, const parseState * state) {
+	if (state->changes)
+		osm2prolog_put(out, ")).\n", 4);
+	else
+		osm2prolog_put(out, ").\n", 3);
+}
+
+/* print: ":- retractall(<name><suffix>(id, _, ...))." with 'args' anonymous arguments */
+static void putRetraction(osmOutput * out, const xmlChar * name, const char * suffix, int_least64_t id, unsigned int args) {
+	osm2prolog_put(out, ":- retractall(", 14);
+	osm2prolog_putString(out, (const char *)name);
+	osm2prolog_putString(out, suffix);
+	osm2prolog_putChar(out, '(');
+	osm2prolog_putInt(out, id);
+	while (args-- > 0)
+		osm2prolog_put(out, ", _", 3);
+	osm2prolog_put(out, ")).\n", 4);
+}
@@ -0,0 +1,55 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "output.h"
+#include "types.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libxml/xmlstring.h>
+
+/* prints the current node (state->parentid, lat, lon) */
+void printNode(const xmlChar * name, parseState * state);
+
+/* prints the current way (state->parentid, waynodeids) */
+void printWay(const xmlChar * name, parseState * state);
+
+/* prints the current tag (state->parent, parentid, tagkey, tagvalue) */
+void printTag(const xmlChar * name, parseState * state);
+
+/* prints the deletion of the node or way state->parentid, for a modify or
+ * delete block of an osmChange file: retractions of its facts, or its id in
+ * a deletion table */
+void printDeletion(osmElement element, parseState * state);
+
+/* prints ":- dynamic <predicates>." at the top of a prolog output, for its
+ * predicates as in "node/3, way/2": loaded facts stay dynamic, so that a
+ * -change conversion can retract and assert them; with 'multifile', also
+ * ":- multifile <predicates>.", to load the files of shards alongside */
+void printDeclaration(osmOutput * out, const char * predicates, bool multifile);
+
+/* record printers for sorted tables (see sort.h), formatting the records
+ * the functions above write when state->tableRecords is set */
+void printNodeRecord(osmOutput * out, int_least64_t id, const unsigned char * payload, size_t len);
+void printWayRecord(osmOutput * out, int_least64_t id, const unsigned char * payload, size_t len);
+void printWayGeomRecord(osmOutput * out, int_least64_t id, const unsigned char * payload, size_t len);
+void printTagRecord(osmOutput * out, int_least64_t id, const unsigned char * payload, size_t len);
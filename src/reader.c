@@ -0,0 +1,231 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osm2prolog.h"
+#include "elements.h"
+#include "filter.h"
+#include "input.h"
+#include "pbf.h"
+#include "sax_callbacks.h"
+#include "tokenizer.h"
+#include "types.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/parser.h>
+#include <libxml/xmlmemory.h>
+
+/* largest piece handed to libxml2 in one xmlParseChunk call */
+#define FEED_SIZE ((size_t)1 << 30)
+
+struct osmReader {
+	osmCallbacks callbacks;
+	parseState * state;
+	osmTagFilter * tagfilter;
+
+	/* the input up to the first element, until the parser is chosen */
+	char * head;
+	size_t headsize;
+	size_t headcap;
+
+	/* one of these, once chosen */
+	osmTokenFeed * tokens;
+	xmlParserCtxtPtr ctxt;
+
+	bool read; /* osm2prolog_readFile did the parsing */
+	bool failed;
+};
+
+/* the readers that are open, the shared structures of util.h exist while
+ * there are any */
+static pthread_mutex_t readerLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int numReaders = 0;
+
+/************************/
+/* forward declarations */
+/************************/
+static bool startParser(osmReader * reader);
+static bool parse(osmReader * reader, const char * data, size_t size);
+static void appendHead(osmReader * reader, const char * data, size_t size);
+
+/*****************/
+/* the interface */
+/*****************/
+osmReader * osm2prolog_openReader(const osmCallbacks * callbacks, void * arg) {
+	osmReader * reader;
+
+	pthread_mutex_lock(&readerLock);
+	if (0 == numReaders++) {
+		xmlInitParser();
+		osm2prolog_init();
+	}
+	pthread_mutex_unlock(&readerLock);
+
+	reader = xmlMalloc(sizeof(osmReader));
+	memset(reader, 0, sizeof(osmReader));
+	reader->callbacks = *callbacks;
+	reader->tagfilter = osm2prolog_createTagFilter();
+	reader->state = osm2prolog_createParseState();
+	reader->state->printMode = CALLBACK;
+	reader->state->quiet = true;
+	reader->state->tagfilter = reader->tagfilter;
+	reader->state->callbacks = &reader->callbacks;
+	reader->state->callbackarg = arg;
+	return reader;
+}
+
+bool osm2prolog_readerTags(osmReader * reader, const char * rules) {
+	return osm2prolog_addTagRules(reader->tagfilter, rules, ',', "osm2prolog_readerTags");
+}
+
+void osm2prolog_readerDropUntagged(osmReader * reader) {
+	reader->state->dropUntagged = true;
+}
+
+bool osm2prolog_feed(osmReader * reader, const void * data, size_t size) {
+	if (reader->failed || reader->read)
+		return false;
+	if (reader->tokens || reader->ctxt)
+		return parse(reader, data, size);
+
+	/* the parser is chosen once the document prolog is complete */
+	appendHead(reader, data, size);
+	if (!osm2prolog_isPBF(reader->head, reader->headsize)
+			&& osm2prolog_findBoundary(reader->head, reader->headsize, 0, 0) == reader->headsize)
+		return true;
+	return startParser(reader) && parse(reader, reader->head, reader->headsize);
+}
+
+bool osm2prolog_readFile(osmReader * reader, const char * filename) {
+	parseState * state = reader->state;
+	int error;
+
+	if (reader->failed || reader->read || reader->headsize > 0 || reader->tokens || reader->ctxt) {
+		fprintf(stderr, "Error: %s: the reader already has input.\n", filename);
+		return false;
+	}
+	reader->read = true;
+
+	/* the PBF reader and the tokenizer return 1 for inputs they leave to libxml2 */
+	if (osm2prolog_isStreamInput(filename))
+		error = osm2prolog_parseStream(state, filename, MMAP);
+	else {
+		error = osm2prolog_parsePBFFile(state, filename);
+		if (1 == error)
+			error = osm2prolog_parseMappedFile(state, filename);
+		if (1 == error)
+			error = osm2prolog_parseXMLFile(state, filename);
+	}
+	reader->failed = (0 != error) || state->stopped;
+	return !reader->failed;
+}
+
+bool osm2prolog_closeReader(osmReader * reader) {
+	parseState * state = reader->state;
+	bool ok = !reader->failed;
+
+	if (!reader->read) {
+		if (ok && !reader->tokens && !reader->ctxt) {
+			if (0 == reader->headsize) {
+				fprintf(stderr, "Error: empty input.\n");
+				ok = false;
+			}
+			else
+				ok = startParser(reader) && parse(reader, reader->head, reader->headsize);
+		}
+		if (reader->tokens) {
+			ok = osm2prolog_closeTokenFeed(reader->tokens, ok) && ok;
+			osm2prolog_endDocument(state);
+		}
+		if (reader->ctxt) {
+			xmlParseChunk(reader->ctxt, NULL, 0, 1);
+			ok = ok && reader->ctxt->wellFormed;
+			osm2prolog_freeParser(reader->ctxt);
+		}
+	}
+	ok = ok && !state->stopped;
+
+	osm2prolog_freeParseState(state);
+	osm2prolog_freeTagFilter(reader->tagfilter);
+	xmlFree(reader->head);
+	xmlFree(reader);
+
+	pthread_mutex_lock(&readerLock);
+	if (0 == --numReaders)
+		osm2prolog_cleanup();
+	pthread_mutex_unlock(&readerLock);
+	return ok;
+}
+
+
+
+/***********/
+/* parsing */
+/***********/
+/* the tokenizer, unless the prolog needs libxml2; PBF blobs can't be fed */
+static bool startParser(osmReader * reader) {
+	if (osm2prolog_isPBF(reader->head, reader->headsize)) {
+		fprintf(stderr, "Error: PBF input has to be read with osm2prolog_readFile.\n");
+		reader->failed = true;
+		return false;
+	}
+	if (osm2prolog_tokenizerSupports(reader->head, reader->headsize)) {
+		reader->tokens = osm2prolog_openTokenFeed(reader->state);
+		osm2prolog_startDocument(reader->state);
+		return true;
+	}
+	reader->ctxt = osm2prolog_createParser(reader->state, true, NULL);
+	if (!reader->ctxt) {
+		fprintf(stderr, "Failed to set up a parser.\n");
+		reader->failed = true;
+	}
+	return !reader->failed;
+}
+
+static bool parse(osmReader * reader, const char * data, size_t size) {
+	size_t feed;
+	bool ok;
+
+	if (reader->tokens)
+		ok = osm2prolog_feedTokens(reader->tokens, data, size);
+	else {
+		while (size > 0 && reader->ctxt->wellFormed && !reader->state->stopped) {
+			feed = (size > FEED_SIZE) ? FEED_SIZE : size;
+			xmlParseChunk(reader->ctxt, data, (int)feed, 0);
+			data += feed;
+			size -= feed;
+		}
+		ok = reader->ctxt->wellFormed;
+	}
+	reader->failed = !ok || reader->state->stopped;
+	return !reader->failed;
+}
+
+static void appendHead(osmReader * reader, const char * data, size_t size) {
+	if (0 == size)
+		return;
+	if (reader->headsize + size > reader->headcap) {
+		reader->headcap = 2 * (reader->headsize + size);
+		reader->head = xmlRealloc(reader->head, reader->headcap);
+	}
+	memcpy(reader->head + reader->headsize, data, size);
+	reader->headsize += size;
+}
@@ -0,0 +1,317 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "region.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* edges per latitude band, on average, of the polygon index */
+#define EDGES_PER_BAND 8
+#define MAX_BANDS 65536
+
+/* one polygon edge, from (lon1, lat1) to (lon2, lat2) */
+typedef
+struct polyEdge {
+	double lon1;
+	double lat1;
+	double lon2;
+	double lat2;
+}
+polyEdge;
+
+struct osmRegion {
+	bool hasbox;
+	double minlat;
+	double minlon;
+	double maxlat;
+	double maxlon;
+
+	/* the polygon edges, without horizontal ones, which never cross a ray
+	 * along a latitude anyway */
+	polyEdge * edges;
+	size_t numedges;
+	size_t numvertices;
+	size_t maxedges;
+	double polyminlat;
+	double polyminlon;
+	double polymaxlat;
+	double polymaxlon;
+	/* the polygon bounding box is cut into latitude bands, band i has the
+	 * edges bandedges[bandstarts[i] .. bandstarts[i + 1]) that span it */
+	size_t numbands;
+	double bandheight;
+	size_t * bandstarts;
+	uint_least32_t * bandedges;
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static bool readRings(osmRegion * region, FILE * file, const char * filename);
+static bool isEnd(const char * line);
+static void addEdge(osmRegion * region, double lon1, double lat1, double lon2, double lat2);
+static void indexEdges(osmRegion * region);
+static size_t bandOf(const osmRegion * region, double lat);
+static bool inPolygon(const osmRegion * region, double lat, double lon);
+
+/**********/
+/* region */
+/**********/
+osmRegion * osm2prolog_createRegion(void) {
+	osmRegion * region = xmlMalloc(sizeof(osmRegion));
+
+	memset(region, 0, sizeof(osmRegion));
+	return region;
+}
+
+void osm2prolog_freeRegion(osmRegion * region) {
+	xmlFree(region->edges);
+	xmlFree(region->bandstarts);
+	xmlFree(region->bandedges);
+	xmlFree(region);
+}
+
+bool osm2prolog_setRegionBox(osmRegion * region, const char * box) {
+	double values[4];
+	char * end;
+	int i;
+
+	for (i = 0; i < 4; ++i) {
+		errno = 0;
+		values[i] = strtod(box, &end);
+		if (0 != errno || end == box || *end != ((3 == i) ? '\0' : ','))
+			return false;
+		box = end + 1;
+	}
+	/* also false for NaN */
+	if (!(values[0] <= values[2] && values[1] <= values[3]))
+		return false;
+
+	region->hasbox = true;
+	region->minlon = values[0];
+	region->minlat = values[1];
+	region->maxlon = values[2];
+	region->maxlat = values[3];
+	return true;
+}
+
+bool osm2prolog_setRegionPolygon(osmRegion * region, const char * filename) {
+	FILE * file = fopen(filename, "r");
+	bool ok;
+
+	if (!file) {
+		perror(filename);
+		return false;
+	}
+	ok = readRings(region, file, filename);
+	fclose(file);
+	if (ok && 0 == region->numedges) {
+		fprintf(stderr, "%s: the polygon is empty\n", filename);
+		ok = false;
+	}
+	if (ok)
+		indexEdges(region);
+	return ok;
+}
+
+bool osm2prolog_inRegion(const osmRegion * region, double lat, double lon) {
+	if (region->hasbox && !(lat >= region->minlat && lat <= region->maxlat
+				&& lon >= region->minlon && lon <= region->maxlon))
+		return false;
+	return !region->bandstarts || inPolygon(region, lat, lon);
+}
+
+
+
+/************/
+/* polygons */
+/************/
+static bool readRings(osmRegion * region, FILE * file, const char * filename) {
+	char * line = NULL;
+	size_t size = 0;
+	unsigned long lineno = 1;
+	bool inring = false;
+	bool first = false;
+	double lon;
+	double lat;
+	double firstlon = 0;
+	double firstlat = 0;
+	double lastlon = 0;
+	double lastlat = 0;
+	bool ok = false;
+
+	/* the name of the polygon */
+	if (-1 == getline(&line, &size, file)) {
+		fprintf(stderr, "%s: not a polygon file\n", filename);
+		free(line);
+		return false;
+	}
+	while (-1 != getline(&line, &size, file)) {
+		++lineno;
+		if (line[strspn(line, " \t\r\n")] == '\0')
+			continue;
+		if (!inring) {
+			/* the final END, or the name of the next ring */
+			if (isEnd(line)) {
+				ok = true;
+				break;
+			}
+			inring = true;
+			first = true;
+		}
+		else if (isEnd(line)) {
+			if (!first)
+				addEdge(region, lastlon, lastlat, firstlon, firstlat);
+			inring = false;
+		}
+		else if (2 != sscanf(line, "%lf %lf", &lon, &lat)) {
+			fprintf(stderr, "%s:%lu: expected \"lon lat\"\n", filename, lineno);
+			break;
+		}
+		else {
+			if (first) {
+				firstlon = lon;
+				firstlat = lat;
+				first = false;
+			}
+			else
+				addEdge(region, lastlon, lastlat, lon, lat);
+			lastlon = lon;
+			lastlat = lat;
+		}
+	}
+	if (!ok && !ferror(file) && feof(file))
+		fprintf(stderr, "%s: missing END\n", filename);
+	free(line);
+	return ok;
+}
+
+static bool isEnd(const char * line) {
+	line += strspn(line, " \t");
+	return 0 == strncmp(line, "END", 3) && line[3 + strspn(line + 3, " \t\r\n")] == '\0';
+}
+
+static void addEdge(osmRegion * region, double lon1, double lat1, double lon2, double lat2) {
+	polyEdge * edge;
+
+	if (0 == region->numvertices++) {
+		region->polyminlat = region->polymaxlat = lat1;
+		region->polyminlon = region->polymaxlon = lon1;
+	}
+	region->polyminlat = (lat1 < region->polyminlat) ? lat1 : region->polyminlat;
+	region->polymaxlat = (lat1 > region->polymaxlat) ? lat1 : region->polymaxlat;
+	region->polyminlon = (lon1 < region->polyminlon) ? lon1 : region->polyminlon;
+	region->polymaxlon = (lon1 > region->polymaxlon) ? lon1 : region->polymaxlon;
+	if (lat1 == lat2)
+		return;
+
+	if (region->numedges == region->maxedges) {
+		region->maxedges = region->maxedges ? 2 * region->maxedges : 1024;
+		region->edges = xmlRealloc(region->edges, region->maxedges * sizeof(polyEdge));
+	}
+	edge = &region->edges[region->numedges++];
+	edge->lon1 = lon1;
+	edge->lat1 = lat1;
+	edge->lon2 = lon2;
+	edge->lat2 = lat2;
+}
+
+/* fills the latitude bands, counting the edges of each band first */
+static void indexEdges(osmRegion * region) {
+	size_t * fill;
+	size_t first;
+	size_t last;
+	size_t band;
+	size_t i;
+
+	region->numbands = region->numedges / EDGES_PER_BAND + 1;
+	region->numbands = (region->numbands > MAX_BANDS) ? MAX_BANDS : region->numbands;
+	region->bandheight = (region->polymaxlat - region->polyminlat) / (double)region->numbands;
+	region->bandstarts = xmlMalloc((region->numbands + 1) * sizeof(size_t));
+	fill = xmlMalloc((region->numbands + 1) * sizeof(size_t));
+	memset(region->bandstarts, 0, (region->numbands + 1) * sizeof(size_t));
+
+	for (i = 0; i < region->numedges; ++i) {
+		first = bandOf(region, region->edges[i].lat1);
+		last = bandOf(region, region->edges[i].lat2);
+		if (first > last) {
+			band = first;
+			first = last;
+			last = band;
+		}
+		for (band = first; band <= last; ++band)
+			region->bandstarts[band + 1]++;
+	}
+	for (band = 0; band < region->numbands; ++band)
+		region->bandstarts[band + 1] += region->bandstarts[band];
+	memcpy(fill, region->bandstarts, (region->numbands + 1) * sizeof(size_t));
+
+	region->bandedges = xmlMalloc((region->bandstarts[region->numbands] + 1) * sizeof(uint_least32_t));
+	for (i = 0; i < region->numedges; ++i) {
+		first = bandOf(region, region->edges[i].lat1);
+		last = bandOf(region, region->edges[i].lat2);
+		if (first > last) {
+			band = first;
+			first = last;
+			last = band;
+		}
+		for (band = first; band <= last; ++band)
+			region->bandedges[fill[band]++] = (uint_least32_t)i;
+	}
+	xmlFree(fill);
+}
+
+static size_t bandOf(const osmRegion * region, double lat) {
+	double band;
+
+	if (!(region->bandheight > 0))
+		return 0;
+	band = (lat - region->polyminlat) / region->bandheight;
+	if (band < 0)
+		return 0;
+	if (band >= (double)(region->numbands - 1))
+		return region->numbands - 1;
+	return (size_t)band;
+}
+
+/* counts the edges crossed by a ray from the location towards the east */
+static bool inPolygon(const osmRegion * region, double lat, double lon) {
+	const polyEdge * edge;
+	size_t band;
+	size_t i;
+	bool inside = false;
+
+	if (!(lat >= region->polyminlat && lat <= region->polymaxlat
+				&& lon >= region->polyminlon && lon <= region->polymaxlon))
+		return false;
+
+	band = bandOf(region, lat);
+	for (i = region->bandstarts[band]; i < region->bandstarts[band + 1]; ++i) {
+		edge = &region->edges[region->bandedges[i]];
+		if ((edge->lat1 > lat) != (edge->lat2 > lat)
+				&& lon < edge->lon1 + (edge->lon2 - edge->lon1) * (lat - edge->lat1) / (edge->lat2 - edge->lat1))
+			inside = !inside;
+	}
+	return inside;
+}
@@ -0,0 +1,50 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* The area to extract: a bounding box, a polygon, or both, in which case a
+ * location has to be in both.
+ *
+ * Polygons are read from the Osmosis polygon filter file format: a name
+ * line, then rings of "lon lat" lines that each start with a name line
+ * (with a leading '!' for holes) and end with an END line, and a final END
+ * line. A location is inside when it is inside an odd number of rings, so
+ * holes and multiple outer rings work out without looking at the names.
+ *
+ * Nodes inside the region are kept and their ids recorded, ways are kept
+ * when they refer to at least one of those nodes. This needs the nodes
+ * before the ways and, within a way, the nd elements before the tags, which
+ * is the order of OSM files. */
+
+#include <stdbool.h>
+
+typedef struct osmRegion osmRegion;
+
+osmRegion * osm2prolog_createRegion(void);
+
+void osm2prolog_freeRegion(osmRegion * region);
+
+/* limits the region to "minlon,minlat,maxlon,maxlat", returns false if the
+ * box is invalid */
+bool osm2prolog_setRegionBox(osmRegion * region, const char * box);
+
+/* limits the region to the polygon in a file, returns false on failure */
+bool osm2prolog_setRegionPolygon(osmRegion * region, const char * filename);
+
+bool osm2prolog_inRegion(const osmRegion * region, double lat, double lon);
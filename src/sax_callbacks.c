@@ -17,16 +17,42 @@
  */
 
 #include "sax_callbacks.h"
+#include "elements.h"
+#include "stats.h"
 #include "types.h"
 #include "util.h"
 
-#include <inttypes.h>
-#include <stdio.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/dict.h>
 #include <libxml/parser.h>
+#include <libxml/parserInternals.h>
 #include <libxml/xmlstring.h>
 
-xmlSAXHandler osm2prolog = {
+/* per parser: the parseState, and strConstants interned in the parser's
+ * dictionary, so element and attribute names compare by pointer */
+typedef
+struct saxContext {
+	parseState * state;
+	const xmlChar * names[_OSM_ELEMENT_SIZE_];
+
+	/* progress, only reported by parsers that read the input themselves */
+	bool progress;
+	long reported; /* bytes */
+	uint_least64_t elements;
+}
+saxContext;
+
+/* callbacks are referenced by the handler below, so declare them first */
+static void startDocument(void * ctx);
+static void endDocument(void * ctx);
+static void startElementNs(void * ctx, const xmlChar * localname, const xmlChar * prefix, const xmlChar * URI,
+		int nb_namespaces, const xmlChar ** namespaces, int nb_attributes, int nb_defaulted, const xmlChar ** attributes);
+static void endElementNs(void * ctx, const xmlChar * localname, const xmlChar * prefix, const xmlChar * URI);
+
+static xmlSAXHandler osm2prolog = {
 	NULL, /* internalSubsetSAXFunc internalSubset */
 	NULL, /* isStandaloneSAXFunc isStandalone */
 	NULL, /* hasInternalSubsetSAXFunc hasInternalSubset */
@@ -41,8 +67,8 @@ xmlSAXHandler osm2prolog = {
 	NULL, /* setDocumentLocatorSAXFunc setDocumentLocator */
 	startDocument, /* startDocumentSAXFunc startDocument */
 	endDocument, /* endDocumentSAXFunc endDocument */
-	startElement, /* startElementSAXFunc startElement */
-	endElement, /* endElementSAXFunc endElement */
+	NULL, /* startElementSAXFunc startElement */
+	NULL, /* endElementSAXFunc endElement */
 	NULL, /* referenceSAXFunc reference */
 	NULL, /* charactersSAXFunc characters */
 	NULL, /* ignorableWhitespaceSAXFunc ignorableWhitespace */
@@ -51,429 +77,179 @@ xmlSAXHandler osm2prolog = {
 	NULL, /* warningSAXFunc warning */
 	NULL, /* errorSAXFunc error */
 	NULL, /* fatalErrorSAXFunc fatalError */
+	NULL, /* getParameterEntitySAXFunc getParameterEntity */
+	NULL, /* cdataBlockSAXFunc cdataBlock */
+	NULL, /* externalSubsetSAXFunc externalSubset */
+	XML_SAX2_MAGIC, /* unsigned int initialized */
+	NULL, /* void * _private */
+	startElementNs, /* startElementNsSAX2Func startElementNs */
+	endElementNs, /* endElementNsSAX2Func endElementNs */
+	NULL /* xmlStructuredErrorFunc serror */
 };
 
 /************************/
 /* forward declarations */
 /************************/
-static size_t findAttributes(size_t numkeys, osmElement keys[], const xmlChar ** attrs, const xmlChar ** values);
-
-static void parseOSM(const xmlChar ** attrs);
-static void parseNode(const xmlChar * name, parseState * state, const xmlChar ** attrs);
-static void parseWay(const xmlChar * name, parseState * state, const xmlChar ** attrs);
-static void parseND(const xmlChar * name, parseState * state, const xmlChar ** attrs);
-static void parseTag(const xmlChar * name, parseState * state, const xmlChar ** attrs);
-
-static void printNode(const xmlChar * name, parseState * state);
-static void printWay(const xmlChar * name, parseState * state);
-static void printTag(const xmlChar * name, parseState * state);
-
-static bool osm_strtoimax(const xmlChar * str, int_least64_t * num);
-static bool validDouble(const xmlChar * str);
-
-/* TODO in later versions
-	this parser currently only supports 1 level of element nesting
-		supported parents:
-			node
-			way
-		ignored parents:
-			relation
-*/
-
-/*************/
-/* callbacks */
-/*************/
-void startDocument(void * user_data) {
-	parseState * state = user_data;
-
-	/* Technically, these values are probably already set, but that's because
-	 * these are general sane values. We don't wan't to _depend_ on that though. */
-	state->parent = _OSM_ELEMENT_UNSET_;
-	state->lat = NULL;
-	state->lon = NULL;
-	state->badnode = true;
-	state->parentid = 0;
-	state->numways = 0;
-	state->badtag = true;
-	state->tagprefix = NULL;
-	state->tagkey = NULL;
-	state->tagvalue = NULL;
-
-	/* if printmode is not set to something we support, print warning and default to PL*/
-	state->printMode =
-		((state->printMode != PL) && (state->printMode != TABLE))
-		? (void)fprintf(stderr, "Warning: unrecognised print mode, defaulting to PL (prolog terms)\n"), PL
-		: state->printMode;
-
-	/* if we print to files (currently only tables), check filepointers and set defaults */
-	if (TABLE == state->printMode) {
-		state->node_file    = (state->node_file    ? state->node_file    : fopen("table_node", "w"));
-		state->way_file     = (state->way_file     ? state->way_file     : fopen("table_way", "w"));
-		state->nodetag_file = (state->nodetag_file ? state->nodetag_file : fopen("table_nodetag", "w"));
-		state->waytag_file  = (state->waytag_file  ? state->waytag_file  : fopen("table_waytag", "w"));
-	}
-
-	osm2prolog_init();
-
-	/* prevent swipl from complaining about the order of clauses */
-	if (PL == state->printMode)
-		printf(":-style_check(-discontiguous).\n");
-
-	fprintf(stderr, "Start Document\n");
+static void attachContext(xmlParserCtxtPtr ctxt, parseState * state);
+static osmElement findElement(const saxContext * sax, const xmlChar * name);
+static void findAttributes(const saxContext * sax, int nb_attributes, const xmlChar ** attributes, osmSlice * values);
+static void reportProgress(xmlParserCtxtPtr ctxt, saxContext * sax, bool all);
+
+/***********/
+/* parsers */
+/***********/
+xmlParserCtxtPtr osm2prolog_createParser(parseState * state, bool document, const char * filename) {
+	xmlSAXHandler handler = osm2prolog;
+	xmlParserCtxtPtr ctxt;
+
+	if (!document) {
+		handler.startDocument = NULL;
+		handler.endDocument = NULL;
+	}
+	/* without user data, the callbacks get the parser context */
+	ctxt = xmlCreatePushParserCtxt(&handler, NULL, NULL, 0, filename);
+	if (ctxt)
+		attachContext(ctxt, state);
+	return ctxt;
 }
 
-void endDocument(void * user_data) {
-	parseState * state = user_data;
-
-	fprintf(stderr, "End Document\n");
-
-	if (TABLE == state->printMode) {
-		fclose(state->node_file);
-		fclose(state->way_file);
-		fclose(state->nodetag_file);
-		fclose(state->waytag_file);
-	}
-
-	osm2prolog_cleanup();
+void osm2prolog_freeParser(xmlParserCtxtPtr ctxt) {
+	xmlFree(ctxt->_private);
+	ctxt->_private = NULL;
+	xmlFreeParserCtxt(ctxt);
 }
 
-void startElement(void * user_data, const xmlChar * name, const xmlChar ** attrs) {
-	parseState * state = user_data;
-
-	/* --- accepted --- */
-	/* osm (the xml root node) */
-	if (xmlStrEqual(name, strConstants[OSM])) {
-		parseOSM(attrs);
-		return;
-	}
-
-	/* node */
-	if (xmlStrEqual(name, strConstants[NODE])) {
-		parseNode(name, state, attrs);
-		return;
-	}
-	/* way */
-	if (xmlStrEqual(name, strConstants[WAY])) {
-		parseWay(name, state, attrs);
-		return;
-	}
-	/* nd */
-	if (xmlStrEqual(name, strConstants[ND])) {
-		parseND(name, state, attrs);
-		return;
-	}
-	/* tag */
-	if (xmlStrEqual(name, strConstants[TAG])) {
-		parseTag(name, state, attrs);
-		return;
-	}
-
-	/* --- ignored (deliberately and explicitely) --- */
-
-	/* relation */
-	if (xmlStrEqual(name, strConstants[RELATION]))
-		state->parent = RELATION;
-		return;
-	/* member */
-	if (xmlStrEqual(name, strConstants[MEMBER]))
-		return;
-
-	/* --- unknown --- */
-
-	fprintf(stderr, "unknown element: %s\n", name);
-}
-
-/* TODO make "parse cleanup" functions that will be called here */
-void endElement(void * user_data, const xmlChar * name) {
-	parseState * state = user_data;
-
-	/* node */
-	if (xmlStrEqual(name, strConstants[NODE]) && !state->badnode) {
-		printNode(name, state);
-		state->parent = _OSM_ELEMENT_UNSET_;
-		xmlFree(state->lon);
-		xmlFree(state->lat);
-	}
-
-	/* way */
-	if (xmlStrEqual(name, strConstants[WAY])) {
-		if (0 == state->numways)
-			fprintf(stderr, "Warning: way element doesn't contain nodes. Ignoring way.");
-		else
-			printWay(name, state);
-
-		state->parent = _OSM_ELEMENT_UNSET_;
-		state->numways = 0;
-		return;
-	}
-
-	/* nd - is only handled as a child of way*/
-
-	/* tag */	
-	if (xmlStrEqual(name, strConstants[TAG]) && !state->badtag) {
-		printTag(name, state);
-		xmlFree(state->tagkey);
-		xmlFree(state->tagvalue);
-	}
-
-	/* --- ignored (deliberately and explicitely) --- */
-
-	/* relation */
-	if (xmlStrEqual(name, strConstants[RELATION]))
-		state->parent = _OSM_ELEMENT_UNSET_;
-		return;
-	/* member */
-	if (xmlStrEqual(name, strConstants[MEMBER]))
-		return;
+int osm2prolog_parseXMLFile(parseState * state, const char * filename) {
+	xmlParserCtxtPtr ctxt = xmlCreateFileParserCtxt(filename);
+	int ret;
+
+	if (!ctxt)
+		return -1;
+	/* the context owns a full sized handler, SAX2 is detected when parsing */
+	memcpy(ctxt->sax, &osm2prolog, sizeof(xmlSAXHandler));
+	attachContext(ctxt, state);
+	((saxContext *)ctxt->_private)->progress = osm2prolog_statsEnabled();
+
+	xmlParseDocument(ctxt);
+	reportProgress(ctxt, ctxt->_private, true);
+	ret = ctxt->wellFormed ? 0 : (ctxt->errNo ? ctxt->errNo : -1);
+	osm2prolog_freeParser(ctxt);
+	return ret;
 }
 
-
-
-/*********************/
-/* parsing functions */
-/*********************/
-static size_t findAttributes(size_t numkeys, osmElement keys[], const xmlChar ** attrs, const xmlChar ** values) {
-	const xmlChar ** attrs_idx;
+/* decodes entities in attribute values as the tokenizer does, and interns
+ * the names to look for */
+static void attachContext(xmlParserCtxtPtr ctxt, parseState * state) {
+	saxContext * sax = xmlMalloc(sizeof(saxContext));
 	size_t i;
 
-	size_t foundkeys = 0;
-
-	/* no attributes or no keys: return immediately */
-	if (!attrs || !attrs[0] || !attrs[1] || !numkeys)
-		return 0;
-
-	/* as the order of the keys is important, check for each of them in order */
-	for (i = 0; i < numkeys; ++i) {
-		attrs_idx = attrs;
-		do {
-			if (xmlStrEqual(strConstants[keys[i]], attrs_idx[0])) {
-				values[i] = attrs_idx[1];
-				++foundkeys;
-				break;
-			}
-		}	while (*(attrs_idx += 2));
-	}
-	return foundkeys;
+	xmlCtxtUseOptions(ctxt, XML_PARSE_NOENT);
+	sax->state = state;
+	sax->progress = false;
+	sax->reported = 0;
+	sax->elements = 0;
+	sax->names[_OSM_ELEMENT_UNSET_] = NULL;
+	for (i = 1; i < _OSM_ELEMENT_SIZE_; ++i)
+		sax->names[i] = xmlDictLookup(ctxt->dict, strConstants[i], -1);
+	ctxt->_private = sax;
 }
 
-static void parseOSM(const xmlChar ** attrs) {
-	osmElement keys[] = {VERSION};
-	const size_t numkeys = (sizeof(keys) / sizeof(osmElement));
-	const xmlChar ** values = xmlMalloc(numkeys * sizeof(xmlChar *));
 
-	size_t foundkeys = findAttributes(numkeys, keys, attrs, values);
 
-	if (foundkeys == numkeys)
-		fprintf(stderr, "Openstreetmap XML, version %s\n", values[0]);
+/*************/
+/* callbacks */
+/*************/
+static void startDocument(void * ctx) {
+	const saxContext * sax = ((xmlParserCtxtPtr)ctx)->_private;
 
-	xmlFree(values);
+	osm2prolog_startDocument(sax->state);
 }
 
-static void parseNode(const xmlChar * name __attribute__((unused)), parseState * state, const xmlChar ** attrs) {
-	osmElement keys[] = {ID, LAT, LON};
-	const size_t numkeys = (sizeof(keys) / sizeof(osmElement));
-	const xmlChar ** values = xmlMalloc(numkeys * sizeof(xmlChar *));
-
-	size_t foundkeys = findAttributes(numkeys, keys, attrs, values);
-
-	state->badnode = true;
-
-	/* save the tuple if it's conform to what we expect */
-	if (foundkeys != numkeys)
-		fprintf(stderr, "Warning: Not all required keys for node record found. Ignoring node record.\n");
-	else {
-		if (!(
-					osm_strtoimax(values[0], &(state->parentid))
-					&& validDouble(values[1])
-					&& validDouble(values[2])
-		     ))
-			fprintf(stderr, "Warning: Failed to convert node ID, LAT or LON from string to number. Ignoring node record.\n");
-		else
-			state->parent = NODE;
-		state->lat = xmlStrdup(values[1]);
-		state->lon = xmlStrdup(values[2]);
-		state->badnode = false;
-	}
+static void endDocument(void * ctx) {
+	const saxContext * sax = ((xmlParserCtxtPtr)ctx)->_private;
 
-	xmlFree(values);
+	osm2prolog_endDocument(sax->state);
 }
 
-static void parseWay(const xmlChar * name __attribute__((unused)), parseState * state, const xmlChar ** attrs) {
-	osmElement keys[] = {ID};
-	const size_t numkeys = (sizeof(keys) / sizeof(osmElement));
-	const xmlChar ** values = xmlMalloc(numkeys * sizeof(xmlChar *));
-
-	size_t foundkeys = findAttributes(numkeys, keys, attrs, values);
-
-	if (foundkeys != numkeys)
-		fprintf(stderr, "Warning: Failed to find the ID for the current way record. Ignoring way record.\n");
-	else {
-		if (!osm_strtoimax(values[0], &(state->parentid)))
-			fprintf(stderr, "Warning: Failed to convert way ID from string to number. Ignoring way record.\n");
-		else
-			state->parent = WAY;
+static void startElementNs(void * ctx, const xmlChar * localname,
+		const xmlChar * prefix __attribute__((unused)), const xmlChar * URI __attribute__((unused)),
+		int nb_namespaces __attribute__((unused)), const xmlChar ** namespaces __attribute__((unused)),
+		int nb_attributes, int nb_defaulted __attribute__((unused)), const xmlChar ** attributes) {
+	const saxContext * sax = ((xmlParserCtxtPtr)ctx)->_private;
+	osmSlice values[_OSM_ELEMENT_SIZE_] = {{NULL, 0}};
+	osmElement element = findElement(sax, localname);
+
+	if (_OSM_ELEMENT_UNSET_ == element) {
+		if (!sax->state->quiet)
+			fprintf(stderr, "unknown element: %s\n", localname);
+		return;
 	}
 
-	xmlFree(values);
+	findAttributes(sax, nb_attributes, attributes, values);
+	osm2prolog_startElement(sax->state, element, values);
 }
 
-void parseND(const xmlChar * name __attribute__((unused)), parseState * state, const xmlChar ** attrs) {
-	osmElement keys[] = {REF};
-	const size_t numkeys = (sizeof(keys) / sizeof(osmElement));
-	const xmlChar ** values = xmlMalloc(numkeys * sizeof(xmlChar *));
-
-	size_t foundkeys = findAttributes(numkeys, keys, attrs, values);
-
-	if (foundkeys != numkeys)
-		fprintf(stderr, "Warning: Failed to find the REF (reference node) for the current ND record. Ignoring ND node.\n");
-	else {
-		if (state->parent != WAY)
-			fprintf(stderr, "Warning: Ignoring ND element outside WAY element.\n");
-		else {
-			if (!osm_strtoimax(values[0], &(state->waynodeids[state->numways++])))
-				fprintf(stderr, "Warning: Failed to convert ND node ID from string to number. Ignoring ND node.\n");
-			/* else: ND must not set parent so no action here */
-		}
-	}
+static void endElementNs(void * ctx, const xmlChar * localname,
+		const xmlChar * prefix __attribute__((unused)), const xmlChar * URI __attribute__((unused))) {
+	saxContext * sax = ((xmlParserCtxtPtr)ctx)->_private;
+	osmElement element = findElement(sax, localname);
 
-	xmlFree(values);
+	if (_OSM_ELEMENT_UNSET_ != element)
+		osm2prolog_endElement(sax->state, element);
+	if (sax->progress && (NODE == element || WAY == element || RELATION == element))
+		reportProgress(ctx, sax, false);
 }
 
-static void parseTag(const xmlChar * name __attribute__((unused)), parseState * state, const xmlChar ** attrs) {
-	osmElement keys[] = {K, V};
-	const size_t numkeys = (sizeof(keys) / sizeof(osmElement));
-	const xmlChar ** values = xmlMalloc(numkeys * sizeof(xmlChar *));
-
-	size_t foundkeys = findAttributes(numkeys, keys, attrs, values);
-
-	state->badtag = true;
-	state->tagprefix = NULL;
+/* reports the input consumed since the last report, once there is enough of
+ * it or when 'all' is set */
+static void reportProgress(xmlParserCtxtPtr ctxt, saxContext * sax, bool all) {
+	long consumed;
+	uint_least64_t elements;
 
-	/* known tag prefixes */
-	if (NODE == state->parent)
-		state->tagprefix = strConstants[NODE];
-	if (WAY == state->parent)
-		state->tagprefix = strConstants[WAY];
-
-	if (!state->tagprefix) {
-		/* IGNORED TAG - do absolutely nothing (but still free(values) :-)) */
-	}
-	else {
-		if (foundkeys != numkeys)
-			fprintf(stderr,	"Warning: Not all required keys for record <%s> found. Ignoring %s record in %s record.\n",
-					name, name, state->tagprefix);
-		else {
-			/* if NOT IGNORED KEY then print it, else do absolutely nothing (but still still free(values) :-)) */
-			if (!osmIgnoreKey(values[0])) {
-				state->badtag = false;
-				state->tagkey = xmlStrdup(values[0]);
-				state->tagvalue = xmlStrdup(values[1]);
-			}
-		}
-	}
-
-	xmlFree(values);
+	if (!sax->progress)
+		return;
+	consumed = xmlByteConsumed(ctxt);
+	if (consumed < sax->reported || (!all && (size_t)(consumed - sax->reported) < OSM_PROGRESS_STEP))
+		return;
+	elements = osm2prolog_elementCount(sax->state);
+	osm2prolog_addProgress((uint_least64_t)(consumed - sax->reported), elements - sax->elements);
+	sax->reported = consumed;
+	sax->elements = elements;
 }
 
 
 
-/************/
-/* PRINTING */
-/************/
-/* TODO open files once and keep them open through one parse */
-
-static void printWay(const xmlChar * name, parseState * state) {
-	size_t i = 0;
-	size_t waysmaxidx = state->numways - 1;
-
-	switch (state->printMode) {
-		case TABLE:
-			/* print: "wayid <tab> nodeid" */
-			while (i < state->numways)
-				fprintf(state->way_file, "%" PRIdLEAST64 "\t%" PRIdLEAST64 "\n", state->parentid, (state->waynodeids)[i++]);
-			break;
-		case PL:
-		default:
-			/* print: "name(wayid, [list-of-nodeid])." */
-			printf("%s(%" PRIdLEAST64 ", [", name, state->parentid);
-			while (i < waysmaxidx)
-				printf("%" PRIdLEAST64 ", ", (state->waynodeids)[i++]);
-			printf("%" PRIdLEAST64 "]).\n", state->waynodeids[waysmaxidx]);
-			break;
-	}
-}
+/***********/
+/* lookups */
+/***********/
+/* names come from the parser dictionary, so comparing pointers suffices */
+static osmElement findElement(const saxContext * sax, const xmlChar * name) {
+	static const osmElement elements[] = {NODE, ND, TAG, WAY, OSM, RELATION, MEMBER, OSMCHANGE, CREATE, MODIFY, DELETE};
+	size_t i;
 
-static void printNode(const xmlChar * name, parseState * state) {
-	switch (state->printMode) {
-		case TABLE:
-			/* print: "nodeid <tab> lat <tab> lon" */
-			fprintf(state->node_file, "%" PRIdLEAST64 "\t%s\t%s\n", state->parentid, state->lat, state->lon);
-			break;
-		case PL:
-		default:
-			/* print: "name(nodeid, lat, lon)." */
-			printf("%s(%" PRIdLEAST64 ", %s, %s).\n", name, state->parentid, state->lat, state->lon);
+	for (i = 0; i < sizeof(elements) / sizeof(osmElement); ++i) {
+		if (name == sax->names[elements[i]])
+			return elements[i];
 	}
-}	
-
-/* TODO unify tag prefix printing, and tag prefix file naming, or somesuch */
-static void printTag(const xmlChar * name, parseState * state) {
-	FILE * tagfile = NULL;
-	/* prolog_filter_str returns a pointer to an alloced copy, TODO rename prolog_filter_str */
-	xmlChar * key = prolog_filter_str(state->tagkey);
-	xmlChar * value = prolog_filter_str(state->tagvalue);
-
-	switch (state->printMode) {
-		case TABLE:
-			/* first select tagfile */
-			switch (state->parent) {
-				case NODE:
-					tagfile = state->nodetag_file;
-					break;
-				case WAY:
-					tagfile = state->waytag_file;
-					break;
-				case _OSM_ELEMENT_UNSET_:
-					fprintf(stderr, "INTERNAL ERROR: trying to print tag element when parent element is not set. Aborting.\n");
-					fprintf(stderr, "key and value were: '%s' and '%s'\n", key, value);
-					exit(EXIT_FAILURE);
-					break;
-				default:
-					fprintf(stderr, "ABORT: No table file for current tag element (tag inside %s element).\n", strConstants[state->parent]);
-					exit(EXIT_FAILURE);
-			}
-			/* print "parentid <tab> key <tab> value", - note that no keys or values will contain tabs as they are filtered */
-			fprintf(tagfile, "%" PRIdLEAST64 "\t%s\t%s\n", state->parentid, key, value);
-			break;
-		case PL:
-		default:
-			/* print: tagprefix_name(parentid, key, value). */
-			printf("%s_%s(%" PRIdLEAST64 ", '%s', '%s').\n", state->tagprefix, name, state->parentid, key, value);
-	}
-
-	xmlFree(key);
-	xmlFree(value);
+	return _OSM_ELEMENT_UNSET_;
 }
 
+/* stores the value of every known attribute at the index of its osmElement;
+ * libxml2 passes localname, prefix, URI, value and value end per attribute */
+static void findAttributes(const saxContext * sax, int nb_attributes, const xmlChar ** attributes, osmSlice * values) {
+	static const osmElement keys[] = {REF, K, V, ID, LAT, LON, VERSION};
+	size_t i;
 
-
-/********/
-/* UTIL */
-/********/
-
-static bool osm_strtoimax(const xmlChar * str, int_least64_t * num) {
-	char * endptr = NULL;
-	int_least64_t id = strtoimax((char *)str, &endptr, 10);
-	if ('\0' == *endptr) {
-		*num = id;
-		return true;
+	for (; nb_attributes > 0; --nb_attributes, attributes += 5) {
+		/* OSM attributes have no namespace */
+		if (attributes[1])
+			continue;
+		for (i = 0; i < sizeof(keys) / sizeof(osmElement); ++i) {
+			if (attributes[0] == sax->names[keys[i]]) {
+				values[keys[i]].str = attributes[3];
+				values[keys[i]].len = (size_t)(attributes[4] - attributes[3]);
+				break;
+			}
+		}
 	}
-	else
-		return false;
-}
-
-static bool validDouble(const xmlChar * str) {
-	char * endptr = NULL;
-	(void)strtod((char *)str, &endptr);
-	return '\0' == *endptr;
 }
@@ -18,6 +18,20 @@
 
 #pragma once
 
+/* libxml2 SAX2 parsing, calling the element handlers of elements.h */
+
+#include "util.h"
+
+#include <stdbool.h>
 #include <libxml/parser.h>
 
-extern xmlSAXHandler osm2prolog;
+/* creates a push parser (fed with xmlParseChunk) for a document, or without
+ * 'document' for a part of one, which does not start or end the document on
+ * 'state'; filename may be NULL, returns NULL on failure */
+xmlParserCtxtPtr osm2prolog_createParser(parseState * state, bool document, const char * filename);
+
+/* frees a parser created by osm2prolog_createParser */
+void osm2prolog_freeParser(xmlParserCtxtPtr ctxt);
+
+/* parses a whole file, returns 0 on success like xmlSAXUserParseFile */
+int osm2prolog_parseXMLFile(parseState * state, const char * filename);
@@ -0,0 +1,140 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shard.h"
+#include "util.h"
+
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+struct osmShards {
+	unsigned int count;
+	unsigned int added;
+	unsigned int selected;
+	uint_least64_t range; /* 0 to hash the ids */
+	osmOutput * (*outputs)[OSM_OUTPUT_SLOTS]; /* per shard */
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static unsigned int shardOf(const osmShards * shards, int_least64_t id);
+
+/**********/
+/* shards */
+/**********/
+osmShards * osm2prolog_createShards(unsigned int count, uint_least64_t range) {
+	osmShards * shards = xmlMalloc(sizeof(osmShards));
+
+	shards->count = count;
+	shards->added = 0;
+	shards->selected = 0;
+	shards->range = range;
+	shards->outputs = xmlMalloc(count * sizeof(shards->outputs[0]));
+	memset(shards->outputs, 0, count * sizeof(shards->outputs[0]));
+	return shards;
+}
+
+osmShards * osm2prolog_copyShards(const osmShards * shards) {
+	return osm2prolog_createShards(shards->count, shards->range);
+}
+
+void osm2prolog_freeShards(osmShards * shards) {
+	if (!shards)
+		return;
+	xmlFree(shards->outputs);
+	xmlFree(shards);
+}
+
+unsigned int osm2prolog_shardCount(const osmShards * shards) {
+	return shards->count;
+}
+
+unsigned int osm2prolog_nextShard(const osmShards * shards) {
+	return shards->added;
+}
+
+void osm2prolog_addShard(parseState * state) {
+	osmShards * shards = state->shards;
+	osmOutput ** slots[OSM_OUTPUT_SLOTS];
+	size_t i;
+
+	osm2prolog_outputSlots(state, slots);
+	for (i = 0; i < OSM_OUTPUT_SLOTS; ++i) {
+		shards->outputs[shards->added][i] = *slots[i];
+		*slots[i] = NULL;
+	}
+	if (++shards->added == shards->count)
+		osm2prolog_useShard(state, 0);
+}
+
+void osm2prolog_selectShard(parseState * state, int_least64_t id) {
+	unsigned int shard;
+
+	if (!state->shards)
+		return;
+	shard = shardOf(state->shards, id);
+	if (shard != state->shards->selected)
+		osm2prolog_useShard(state, shard);
+}
+
+void osm2prolog_useShard(parseState * state, unsigned int shard) {
+	osmOutput ** slots[OSM_OUTPUT_SLOTS];
+	size_t i;
+
+	osm2prolog_outputSlots(state, slots);
+	for (i = 0; i < OSM_OUTPUT_SLOTS; ++i)
+		*slots[i] = state->shards->outputs[shard][i];
+	state->shards->selected = shard;
+}
+
+/* the prolog file of a shard goes last, like in osm2prolog_closeOutputs */
+bool osm2prolog_closeShards(parseState * state) {
+	osmShards * shards = state->shards;
+	osmOutput ** slots[OSM_OUTPUT_SLOTS];
+	unsigned int shard;
+	size_t i;
+	bool ok = true;
+
+	osm2prolog_outputSlots(state, slots);
+	for (i = 0; i < OSM_OUTPUT_SLOTS; ++i)
+		*slots[i] = NULL;
+	for (shard = 0; shard < shards->added; ++shard) {
+		for (i = 0; i < OSM_OUTPUT_SLOTS; ++i) {
+			if (shards->outputs[shard][i])
+				ok = osm2prolog_closeOutput(shards->outputs[shard][i]) && ok;
+			shards->outputs[shard][i] = NULL;
+		}
+	}
+	return ok;
+}
+
+/* Fibonacci hashing spreads runs of consecutive ids, which are common in
+ * OSM data, evenly over the shards. */
+static unsigned int shardOf(const osmShards * shards, int_least64_t id) {
+	uint_least64_t shard;
+
+	if (shards->range > 0) {
+		if (id < 0)
+			return 0;
+		shard = (uint_least64_t)id / shards->range;
+		return (shard < shards->count) ? (unsigned int)shard : shards->count - 1;
+	}
+	shard = ((uint_least64_t)id * UINT64_C(0x9E3779B97F4A7C15)) >> 32;
+	return (unsigned int)(shard % shards->count);
+}
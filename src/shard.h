@@ -0,0 +1,72 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Sharded outputs.
+ *
+ * A sharded conversion has a complete set of outputs per shard, and writes
+ * every node and way, with its tags, geometry and deletion, to the outputs
+ * of the shard of its id. Each shard is a conversion of its own that can be
+ * loaded separately, or alongside the others: prolog files declare their
+ * predicates multifile, and the tag dictionaries are shared by all shards.
+ *
+ * The outputs of the shards are set up one by one through the output fields
+ * of the parseState, like those of a conversion without shards, and handed
+ * over with osm2prolog_addShard. While parsing, osm2prolog_selectShard puts
+ * the outputs of a shard back in those fields. */
+
+#include "output.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct osmShards osmShards;
+
+struct parseState;
+
+/* creates 'count' empty shards; ids are hashed to shards when 'range' is 0,
+ * otherwise every shard takes the next 'range' ids, starting at 0, with the
+ * negative ids in the first shard and the remaining ones in the last */
+osmShards * osm2prolog_createShards(unsigned int count, uint_least64_t range);
+
+/* creates empty shards that take the same ids as 'shards' */
+osmShards * osm2prolog_copyShards(const osmShards * shards);
+
+/* frees shards once their outputs are closed, NULL is ignored */
+void osm2prolog_freeShards(osmShards * shards);
+
+/* the number of shards */
+unsigned int osm2prolog_shardCount(const osmShards * shards);
+
+/* the index of the shard that osm2prolog_addShard adds next */
+unsigned int osm2prolog_nextShard(const osmShards * shards);
+
+/* takes the outputs of the parseState as those of the next shard, and
+ * clears them; once all shards are added, the first is selected */
+void osm2prolog_addShard(struct parseState * state);
+
+/* selects the outputs of the shard of 'id' */
+void osm2prolog_selectShard(struct parseState * state, int_least64_t id);
+
+/* selects the outputs of the shard with index 'shard' */
+void osm2prolog_useShard(struct parseState * state, unsigned int shard);
+
+/* flushes and closes the outputs of all shards, see
+ * osm2prolog_closeOutputs; returns false if any write failed */
+bool osm2prolog_closeShards(struct parseState * state);
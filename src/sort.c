@@ -0,0 +1,501 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sort.h"
+#include "output.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libxml/xmlmemory.h>
+
+/* a record is its key, its payload length and the payload, unaligned */
+#define KEY_SIZE sizeof(int_least64_t)
+#define LEN_SIZE sizeof(uint_least32_t)
+#define HEADER_SIZE (KEY_SIZE + LEN_SIZE)
+/* the record buffer starts this small and doubles up to the memory limit */
+#define INITIAL_BUFFER_SIZE ((size_t)1024 * 1024)
+/* read buffer per spilled run while merging, grows for larger records; the
+ * merge buffers share the memory limit, but never shrink below the minimum */
+#define RUN_BUFFER_SIZE ((size_t)256 * 1024)
+#define MIN_RUN_BUFFER_SIZE ((size_t)16 * 1024)
+/* the most runs merged at once; that many spilled runs are merged into one
+ * on the next level as soon as they exist, which bounds the open temporary
+ * files and the merge buffers, and keeps the number of passes logarithmic */
+#define MAX_FAN_IN 16
+
+/* a buffered record, sorted by key and then by position in the buffer */
+typedef
+struct sortEntry {
+	int_least64_t key;
+	size_t offset;
+}
+sortEntry;
+
+/* a sorted run being merged: a spilled file, or the records still in memory */
+typedef
+struct sortRun {
+	size_t order; /* runs are numbered in input order, for stability */
+	int fd; /* -1 for the run in memory */
+	unsigned char * buf;
+	size_t cap;
+	size_t pos;
+	size_t len;
+	size_t next; /* next entry of the run in memory */
+
+	/* the current record */
+	int_least64_t key;
+	const unsigned char * payload;
+	size_t paylen;
+}
+sortRun;
+
+/* a spilled run; runs are kept in input order, with the levels (the number of
+ * merges that made a run) never increasing */
+typedef
+struct spilledRun {
+	int fd;
+	unsigned level;
+}
+spilledRun;
+
+typedef
+struct osmSorter {
+	osmOutput * dest;
+	osmRecordPrinter print;
+	char * tmpprefix;
+	size_t memory;
+
+	unsigned char * buf;
+	size_t size;
+	size_t cap;
+	size_t scanned; /* end of the complete records counted in 'records' */
+	size_t records;
+	sortEntry * entries;
+	size_t numentries;
+	size_t maxentries;
+
+	spilledRun * runs;
+	size_t numruns;
+	size_t maxruns;
+	bool failed;
+}
+osmSorter;
+
+/************************/
+/* forward declarations */
+/************************/
+static bool sortWrite(void * arg, const char * data, size_t size);
+static bool sortClose(void * arg);
+static void countRecords(osmSorter * sorter);
+static size_t bufferLimit(const osmSorter * sorter);
+static size_t sortBuffer(osmSorter * sorter);
+static int compareEntries(const void * a, const void * b);
+static bool spillRun(osmSorter * sorter);
+static bool addRun(osmSorter * sorter, int fd, unsigned level);
+static void releaseBuffer(osmSorter * sorter);
+static bool collapseRuns(osmSorter * sorter, size_t count, unsigned level);
+static bool mergeRuns(osmSorter * sorter, size_t first, bool buffered, osmOutput * out, osmRecordPrinter print);
+static bool nextRecord(osmSorter * sorter, sortRun * run);
+static bool fillRun(osmSorter * sorter, sortRun * run, size_t need);
+static bool runBefore(const sortRun * a, const sortRun * b);
+static void siftDown(sortRun ** heap, size_t size, size_t i);
+
+/***********/
+/* records */
+/***********/
+osmOutput * osm2prolog_openSortedOutput(osmOutput * dest, osmRecordPrinter print, const char * tmpprefix, size_t memory) {
+	osmSorter * sorter = xmlMalloc(sizeof(osmSorter));
+	size_t prefixlen = strlen(tmpprefix);
+
+	memset(sorter, 0, sizeof(osmSorter));
+	sorter->dest = dest;
+	sorter->print = print;
+	sorter->tmpprefix = xmlMalloc(prefixlen + 1);
+	memcpy(sorter->tmpprefix, tmpprefix, prefixlen + 1);
+	sorter->memory = memory;
+	sorter->cap = (memory < INITIAL_BUFFER_SIZE) ? memory : INITIAL_BUFFER_SIZE;
+	sorter->buf = xmlMalloc(sorter->cap);
+	return osm2prolog_openSinkOutput(sortWrite, sortClose, sorter);
+}
+
+void osm2prolog_putRecord(osmOutput * out, int_least64_t key, size_t len) {
+	uint_least32_t paylen = (uint_least32_t)len;
+
+	osm2prolog_put(out, &key, KEY_SIZE);
+	osm2prolog_put(out, &paylen, LEN_SIZE);
+}
+
+void osm2prolog_copyRecord(osmOutput * out, int_least64_t key, const unsigned char * payload, size_t len) {
+	osm2prolog_putRecord(out, key, len);
+	osm2prolog_put(out, payload, len);
+}
+
+/* collects records, which may be split over several calls */
+static bool sortWrite(void * arg, const char * data, size_t size) {
+	osmSorter * sorter = arg;
+	size_t piece;
+	size_t limit;
+
+	while (size > 0 && !sorter->failed) {
+		if (sorter->size == sorter->cap) {
+			countRecords(sorter);
+			limit = bufferLimit(sorter);
+			if (sorter->cap < limit) {
+				sorter->cap = (sorter->cap > limit / 2) ? limit : 2 * sorter->cap;
+				sorter->buf = xmlRealloc(sorter->buf, sorter->cap);
+			}
+			else if (!spillRun(sorter))
+				sorter->failed = true;
+			continue;
+		}
+		piece = sorter->cap - sorter->size;
+		piece = (piece < size) ? piece : size;
+		memcpy(sorter->buf + sorter->size, data, piece);
+		sorter->size += piece;
+		data += piece;
+		size -= piece;
+	}
+	return !sorter->failed;
+}
+
+/* merges everything into the destination, which is closed in any case */
+static bool sortClose(void * arg) {
+	osmSorter * sorter = arg;
+	bool ok;
+	size_t excess;
+	size_t i;
+
+	countRecords(sorter);
+	if (!sorter->failed && sorter->scanned != sorter->size) {
+		fprintf(stderr, "INTERNAL ERROR: incomplete record in sorted output.\n");
+		sorter->failed = true;
+	}
+	/* the merge buffers need the memory of the records, so those are spilled
+	 * too, unless they are all there is */
+	if (!sorter->failed && sorter->numruns > 0 && sorter->size > 0 && !spillRun(sorter))
+		sorter->failed = true;
+	if (!sorter->failed && sorter->numruns > 0)
+		releaseBuffer(sorter);
+	/* merges the newest runs until a single pass remains */
+	while (!sorter->failed && sorter->numruns > MAX_FAN_IN) {
+		excess = sorter->numruns - MAX_FAN_IN + 1;
+		if (!collapseRuns(sorter, (excess < MAX_FAN_IN) ? excess : MAX_FAN_IN, 0))
+			sorter->failed = true;
+	}
+	if (!sorter->failed && 0 == sorter->numruns)
+		sortBuffer(sorter);
+	if (!sorter->failed && !mergeRuns(sorter, 0, 0 == sorter->numruns, sorter->dest, sorter->print))
+		sorter->failed = true;
+	ok = osm2prolog_closeOutput(sorter->dest) && !sorter->failed;
+
+	for (i = 0; i < sorter->numruns; ++i)
+		close(sorter->runs[i].fd);
+	xmlFree(sorter->runs);
+	xmlFree(sorter->entries);
+	xmlFree(sorter->buf);
+	xmlFree(sorter->tmpprefix);
+	xmlFree(sorter);
+	return ok;
+}
+
+/* counts the complete records added to the buffer since the last count */
+static void countRecords(osmSorter * sorter) {
+	uint_least32_t paylen;
+
+	while (sorter->scanned + HEADER_SIZE <= sorter->size) {
+		memcpy(&paylen, sorter->buf + sorter->scanned + KEY_SIZE, LEN_SIZE);
+		if (sorter->scanned + HEADER_SIZE + paylen > sorter->size)
+			break;
+		sorter->scanned += HEADER_SIZE + paylen;
+		++sorter->records;
+	}
+}
+
+/* the buffer size that leaves room within the memory limit for the entries
+ * that sort its records, judging by the records so far */
+static size_t bufferLimit(const osmSorter * sorter) {
+	double share;
+
+	if (0 == sorter->records)
+		return sorter->memory;
+	share = (double)sorter->scanned / (double)(sorter->scanned + sorter->records * sizeof(sortEntry));
+	return (size_t)(share * (double)sorter->memory);
+}
+
+/* indexes and sorts the complete records in the buffer, returns the number
+ * of bytes they take */
+static size_t sortBuffer(osmSorter * sorter) {
+	size_t pos = 0;
+	uint_least32_t paylen;
+
+	countRecords(sorter);
+	if (sorter->records > sorter->maxentries) {
+		sorter->maxentries = sorter->records;
+		sorter->entries = xmlRealloc(sorter->entries, sorter->maxentries * sizeof(sortEntry));
+	}
+	for (sorter->numentries = 0; sorter->numentries < sorter->records; ++sorter->numentries) {
+		memcpy(&paylen, sorter->buf + pos + KEY_SIZE, LEN_SIZE);
+		memcpy(&sorter->entries[sorter->numentries].key, sorter->buf + pos, KEY_SIZE);
+		sorter->entries[sorter->numentries].offset = pos;
+		pos += HEADER_SIZE + paylen;
+	}
+	if (sorter->numentries > 0)
+		qsort(sorter->entries, sorter->numentries, sizeof(sortEntry), compareEntries);
+	return pos;
+}
+
+static int compareEntries(const void * a, const void * b) {
+	const sortEntry * x = a;
+	const sortEntry * y = b;
+
+	if (x->key != y->key)
+		return (x->key < y->key) ? -1 : 1;
+	return (x->offset < y->offset) ? -1 : (x->offset > y->offset);
+}
+
+
+
+/**********/
+/* spills */
+/**********/
+/* writes the complete records in a full buffer to a new run, and keeps the
+ * incomplete one at the end; a buffer holding only part of a single record
+ * grows instead */
+static bool spillRun(osmSorter * sorter) {
+	size_t used = sortBuffer(sorter);
+	osmOutput * out;
+	const unsigned char * record;
+	uint_least32_t paylen;
+	size_t i;
+	int fd;
+
+	if (0 == used) {
+		sorter->cap *= 2;
+		sorter->buf = xmlRealloc(sorter->buf, sorter->cap);
+		return true;
+	}
+
+	fd = osm2prolog_createTempFile(sorter->tmpprefix);
+	if (fd < 0)
+		return false;
+	out = osm2prolog_openOutputFd(fd);
+	for (i = 0; i < sorter->numentries; ++i) {
+		record = sorter->buf + sorter->entries[i].offset;
+		memcpy(&paylen, record + KEY_SIZE, LEN_SIZE);
+		osm2prolog_put(out, record, HEADER_SIZE + paylen);
+	}
+	if (!osm2prolog_closeOutput(out) || 0 != lseek(fd, 0, SEEK_SET)) {
+		close(fd);
+		return false;
+	}
+
+	memmove(sorter->buf, sorter->buf + used, sorter->size - used);
+	sorter->size -= used;
+	sorter->scanned = 0;
+	sorter->records = 0;
+	sorter->numentries = 0;
+	return addRun(sorter, fd, 0);
+}
+
+/* adds the newest spilled run, and merges the runs on its level into one on
+ * the next level as soon as there are enough of them */
+static bool addRun(osmSorter * sorter, int fd, unsigned level) {
+	if (sorter->numruns == sorter->maxruns) {
+		sorter->maxruns = sorter->maxruns ? 2 * sorter->maxruns : MAX_FAN_IN;
+		sorter->runs = xmlRealloc(sorter->runs, sorter->maxruns * sizeof(spilledRun));
+	}
+	sorter->runs[sorter->numruns].fd = fd;
+	sorter->runs[sorter->numruns].level = level;
+	++sorter->numruns;
+
+	if (sorter->numruns >= MAX_FAN_IN && sorter->runs[sorter->numruns - MAX_FAN_IN].level == level)
+		return collapseRuns(sorter, MAX_FAN_IN, level + 1);
+	return true;
+}
+
+/* hands the memory of the record buffer to a merge of spilled runs: keeps
+ * just the incomplete record, and drops the sort entries */
+static void releaseBuffer(osmSorter * sorter) {
+	sorter->cap = (sorter->size > MIN_RUN_BUFFER_SIZE) ? sorter->size : MIN_RUN_BUFFER_SIZE;
+	sorter->buf = xmlRealloc(sorter->buf, sorter->cap);
+	xmlFree(sorter->entries);
+	sorter->entries = NULL;
+	sorter->numentries = 0;
+	sorter->maxentries = 0;
+}
+
+
+
+/*********/
+/* merge */
+/*********/
+/* merges the newest 'count' spilled runs into a new run on 'level' */
+static bool collapseRuns(osmSorter * sorter, size_t count, unsigned level) {
+	osmOutput * out;
+	bool ok;
+	int fd;
+
+	fd = osm2prolog_createTempFile(sorter->tmpprefix);
+	if (fd < 0)
+		return false;
+	releaseBuffer(sorter);
+	out = osm2prolog_openOutputFd(fd);
+	ok = mergeRuns(sorter, sorter->numruns - count, false, out, osm2prolog_copyRecord);
+	if (!osm2prolog_closeOutput(out) || !ok || 0 != lseek(fd, 0, SEEK_SET)) {
+		close(fd);
+		return false;
+	}
+	return addRun(sorter, fd, level);
+}
+
+/* merges the spilled runs from 'first' on, followed by the sorted buffer if
+ * 'buffered', into 'out'; the merged runs are closed and dropped */
+static bool mergeRuns(osmSorter * sorter, size_t first, bool buffered, osmOutput * out, osmRecordPrinter print) {
+	size_t numspilled = sorter->numruns - first;
+	size_t numruns = numspilled + (buffered ? 1 : 0);
+	sortRun * runs = xmlMalloc(numruns * sizeof(sortRun));
+	sortRun ** heap = xmlMalloc(numruns * sizeof(sortRun *));
+	size_t bufsize = sorter->memory / MAX_FAN_IN;
+	size_t heapsize = 0;
+	size_t i;
+
+	if (bufsize > RUN_BUFFER_SIZE)
+		bufsize = RUN_BUFFER_SIZE;
+	if (bufsize < MIN_RUN_BUFFER_SIZE)
+		bufsize = MIN_RUN_BUFFER_SIZE;
+
+	for (i = 0; i < numruns; ++i) {
+		memset(&runs[i], 0, sizeof(sortRun));
+		runs[i].order = i;
+		runs[i].fd = (i < numspilled) ? sorter->runs[first + i].fd : -1;
+		if (runs[i].fd >= 0) {
+			runs[i].cap = bufsize;
+			runs[i].buf = xmlMalloc(runs[i].cap);
+		}
+		if (nextRecord(sorter, &runs[i]))
+			heap[heapsize++] = &runs[i];
+	}
+	for (i = heapsize; i-- > 0;)
+		siftDown(heap, heapsize, i);
+
+	while (heapsize > 0) {
+		print(out, heap[0]->key, heap[0]->payload, heap[0]->paylen);
+		if (!nextRecord(sorter, heap[0]))
+			heap[0] = heap[--heapsize];
+		siftDown(heap, heapsize, 0);
+	}
+
+	for (i = 0; i < numruns; ++i) {
+		if (runs[i].fd >= 0)
+			close(runs[i].fd);
+		xmlFree(runs[i].buf);
+	}
+	sorter->numruns = first;
+	xmlFree(runs);
+	xmlFree(heap);
+	return !sorter->failed;
+}
+
+/* loads the next record of a run, returns false at its end or on failure */
+static bool nextRecord(osmSorter * sorter, sortRun * run) {
+	const unsigned char * record;
+	uint_least32_t paylen;
+
+	if (run->fd < 0) {
+		if (run->next == sorter->numentries)
+			return false;
+		record = sorter->buf + sorter->entries[run->next++].offset;
+	}
+	else {
+		if (!fillRun(sorter, run, HEADER_SIZE))
+			return false;
+		memcpy(&paylen, run->buf + run->pos + KEY_SIZE, LEN_SIZE);
+		if (!fillRun(sorter, run, HEADER_SIZE + paylen))
+			return false;
+		record = run->buf + run->pos;
+		run->pos += HEADER_SIZE + paylen;
+	}
+
+	memcpy(&run->key, record, KEY_SIZE);
+	memcpy(&paylen, record + KEY_SIZE, LEN_SIZE);
+	run->payload = record + HEADER_SIZE;
+	run->paylen = paylen;
+	return true;
+}
+
+/* makes sure 'need' bytes of a spilled run are buffered, returns false at
+ * the end of the run or on failure */
+static bool fillRun(osmSorter * sorter, sortRun * run, size_t need) {
+	ssize_t len;
+
+	if (run->len - run->pos >= need)
+		return true;
+
+	memmove(run->buf, run->buf + run->pos, run->len - run->pos);
+	run->len -= run->pos;
+	run->pos = 0;
+	if (need > run->cap) {
+		while (need > run->cap)
+			run->cap *= 2;
+		run->buf = xmlRealloc(run->buf, run->cap);
+	}
+
+	while (run->len < need) {
+		len = read(run->fd, run->buf + run->len, run->cap - run->len);
+		if (len < 0 && EINTR == errno)
+			continue;
+		if (len < 0) {
+			perror("read");
+			sorter->failed = true;
+			return false;
+		}
+		if (0 == len) {
+			if (run->len > 0) {
+				fprintf(stderr, "Error: truncated temporary sort file.\n");
+				sorter->failed = true;
+			}
+			return false;
+		}
+		run->len += (size_t)len;
+	}
+	return true;
+}
+
+static bool runBefore(const sortRun * a, const sortRun * b) {
+	return a->key < b->key || (a->key == b->key && a->order < b->order);
+}
+
+static void siftDown(sortRun ** heap, size_t size, size_t i) {
+	sortRun * run = heap[i];
+	size_t child;
+
+	while ((child = 2 * i + 1) < size) {
+		if (child + 1 < size && runBefore(heap[child + 1], heap[child]))
+			++child;
+		if (!runBefore(heap[child], run))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = run;
+}
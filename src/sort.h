@@ -0,0 +1,53 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* External merge sort of table records.
+ *
+ * A sorted output takes binary records (a key and an opaque payload, see
+ * osm2prolog_putRecord) instead of text. They are collected in memory up to
+ * a limit, sorted by key and spilled to a temporary file as one run when the
+ * limit is reached. A limited number of runs is merged at once: as soon as
+ * there are enough runs of the same size, they are merged into a larger one.
+ * Closing the output merges the remaining runs and formats every record into
+ * the destination output. The limit covers the records, the index that sorts
+ * them and the merge buffers. Records with equal keys keep their input order,
+ * like `sort -s -k1n,1` does. */
+
+#include "output.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* formats one record into the final output */
+typedef void (*osmRecordPrinter)(osmOutput * out, int_least64_t key, const unsigned char * payload, size_t len);
+
+/* returns an output that sorts the records written to it into 'dest', which
+ * it closes when it is closed itself; runs are spilled to unlinked files
+ * created as 'tmpprefix' followed by six random characters, and about
+ * 'memory' bytes are used in all */
+osmOutput * osm2prolog_openSortedOutput(osmOutput * dest, osmRecordPrinter print, const char * tmpprefix, size_t memory);
+
+/* starts a record, the caller appends exactly 'len' bytes of payload */
+void osm2prolog_putRecord(osmOutput * out, int_least64_t key, size_t len);
+
+/* a record printer that writes the record unchanged, for sorting records
+ * into another output that takes records */
+void osm2prolog_copyRecord(osmOutput * out, int_least64_t key, const unsigned char * payload, size_t len);
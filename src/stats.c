@@ -0,0 +1,256 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+#include "types.h"
+#include "util.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define NANOSECONDS 1000000000.0
+#define MIB (1024.0 * 1024.0)
+
+/* the osmCounters as they are named in the summaries */
+static const char * const counterNames[_OSM_COUNTER_SIZE_] = {
+	"nodes", "ways", "relations", "nds", "tags",
+	"nodes_written", "ways_written", "tags_written",
+	"bad_nodes", "bad_ways", "bad_nds", "bad_tags",
+	"filtered_tags", "ignored_tags", "outside_region", "untagged",
+	"deletions"
+};
+
+/* process wide, set up before any parser or writer thread starts */
+static struct {
+	bool enabled;
+	uint_least64_t inputsize;
+	uint_least64_t interval; /* in nanoseconds, 0 for no progress */
+	uint_least64_t start;
+
+	/* protected by lock */
+	uint_least64_t bytes;
+	uint_least64_t elements;
+	uint_least64_t lastreport;
+	uint_least64_t parsetime;
+	bool parserwrites;
+	uint_least64_t writetime;
+	uint_least64_t syncwritetime;
+	pthread_mutex_t lock;
+} stats = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static void printProgress(uint_least64_t now);
+static void formatDuration(char * buf, size_t size, double seconds);
+static void putJSONString(FILE * file, const char * str);
+
+/*****************/
+/* the interface */
+/*****************/
+void osm2prolog_startStats(uint_least64_t inputsize, unsigned int interval) {
+	stats.enabled = true;
+	stats.inputsize = inputsize;
+	stats.interval = (uint_least64_t)interval * 1000000000;
+	stats.start = osm2prolog_now();
+	stats.lastreport = stats.start;
+}
+
+bool osm2prolog_statsEnabled(void) {
+	return stats.enabled;
+}
+
+uint_least64_t osm2prolog_now(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint_least64_t)now.tv_sec * 1000000000 + (uint_least64_t)now.tv_nsec;
+}
+
+uint_least64_t osm2prolog_elementCount(const parseState * state) {
+	return state->counters[COUNT_NODES] + state->counters[COUNT_WAYS] + state->counters[COUNT_RELATIONS];
+}
+
+void osm2prolog_addProgress(uint_least64_t bytes, uint_least64_t elements) {
+	uint_least64_t now;
+
+	if (!stats.enabled)
+		return;
+
+	pthread_mutex_lock(&stats.lock);
+	stats.bytes += bytes;
+	stats.elements += elements;
+	if (stats.interval > 0) {
+		now = osm2prolog_now();
+		if (now - stats.lastreport >= stats.interval) {
+			stats.lastreport = now;
+			printProgress(now);
+		}
+	}
+	pthread_mutex_unlock(&stats.lock);
+}
+
+void osm2prolog_addParseTime(uint_least64_t nanoseconds, bool writes) {
+	if (!stats.enabled)
+		return;
+
+	pthread_mutex_lock(&stats.lock);
+	stats.parsetime += nanoseconds;
+	stats.parserwrites = stats.parserwrites || writes;
+	pthread_mutex_unlock(&stats.lock);
+}
+
+void osm2prolog_addWriteTime(uint_least64_t nanoseconds, bool sync) {
+	if (!stats.enabled)
+		return;
+
+	pthread_mutex_lock(&stats.lock);
+	stats.writetime += nanoseconds;
+	if (sync)
+		stats.syncwritetime += nanoseconds;
+	pthread_mutex_unlock(&stats.lock);
+}
+
+void osm2prolog_addCounters(parseState * dest, const parseState * src) {
+	size_t i;
+
+	for (i = 0; i < _OSM_COUNTER_SIZE_; ++i)
+		dest->counters[i] += src->counters[i];
+	dest->formattime += src->formattime;
+}
+
+bool osm2prolog_reportStats(const parseState * state, const char * input, const char * jsonfile) {
+	struct rusage usage;
+	double elapsed;
+	double parse;
+	double format;
+	double write;
+	uint_least64_t elements = osm2prolog_elementCount(state);
+	FILE * file;
+	size_t i;
+	bool ok = true;
+
+	if (!stats.enabled)
+		return true;
+
+	pthread_mutex_lock(&stats.lock);
+	elapsed = (double)(osm2prolog_now() - stats.start) / NANOSECONDS;
+	format = (double)state->formattime / NANOSECONDS;
+	write = (double)stats.writetime / NANOSECONDS;
+	/* parsing is what remains of the busy time of the parsers */
+	parse = ((double)stats.parsetime - (double)state->formattime
+			- (stats.parserwrites ? (double)stats.syncwritetime : 0.0)) / NANOSECONDS;
+	parse = (parse < 0.0) ? 0.0 : parse;
+	pthread_mutex_unlock(&stats.lock);
+	elapsed = (elapsed > 0.0) ? elapsed : 1.0 / NANOSECONDS;
+	if (0 != getrusage(RUSAGE_SELF, &usage))
+		usage.ru_maxrss = 0;
+
+	fprintf(stderr, "Statistics:\n");
+	for (i = 0; i < _OSM_COUNTER_SIZE_; ++i)
+		fprintf(stderr, "\t%-16s%" PRIuLEAST64 "\n", counterNames[i], state->counters[i]);
+	fprintf(stderr, "\tinput: %" PRIuLEAST64 " bytes in %.3f s, %.1f MiB/s, %.0f elements/s\n",
+			stats.bytes, elapsed, (double)stats.bytes / MIB / elapsed, (double)elements / elapsed);
+	fprintf(stderr, "\ttime: parsing %.3f s, filtering and formatting %.3f s, writing %.3f s\n",
+			parse, format, write);
+	fprintf(stderr, "\tpeak memory: %ld KiB\n", usage.ru_maxrss);
+
+	if (!jsonfile)
+		return true;
+	file = (0 == strcmp(jsonfile, "-")) ? stderr : fopen(jsonfile, "w");
+	if (!file) {
+		perror(jsonfile);
+		return false;
+	}
+	fprintf(file, "{\n\t\"input\": ");
+	putJSONString(file, input);
+	fprintf(file, ",\n\t\"input_bytes\": %" PRIuLEAST64 ",\n", stats.bytes);
+	fprintf(file, "\t\"elapsed_seconds\": %.6f,\n", elapsed);
+	fprintf(file, "\t\"mib_per_second\": %.3f,\n", (double)stats.bytes / MIB / elapsed);
+	fprintf(file, "\t\"elements_per_second\": %.1f,\n", (double)elements / elapsed);
+	fprintf(file, "\t\"counters\": {\n");
+	for (i = 0; i < _OSM_COUNTER_SIZE_; ++i)
+		fprintf(file, "\t\t\"%s\": %" PRIuLEAST64 "%s\n", counterNames[i], state->counters[i],
+				(i + 1 < _OSM_COUNTER_SIZE_) ? "," : "");
+	fprintf(file, "\t},\n");
+	fprintf(file, "\t\"phases\": {\n");
+	fprintf(file, "\t\t\"parse_seconds\": %.6f,\n", parse);
+	fprintf(file, "\t\t\"format_seconds\": %.6f,\n", format);
+	fprintf(file, "\t\t\"write_seconds\": %.6f\n", write);
+	fprintf(file, "\t},\n");
+	fprintf(file, "\t\"max_rss_kib\": %ld\n}\n", usage.ru_maxrss);
+
+	if (stderr != file && 0 != fclose(file)) {
+		perror(jsonfile);
+		ok = false;
+	}
+	return ok;
+}
+
+
+
+/************/
+/* printing */
+/************/
+/* called with the lock held */
+static void printProgress(uint_least64_t now) {
+	double elapsed = (double)(now - stats.start) / NANOSECONDS;
+	double rate = (double)stats.bytes / elapsed;
+	char eta[32];
+
+	fprintf(stderr, "Progress: %.1f MiB", (double)stats.bytes / MIB);
+	if (stats.inputsize > 0)
+		fprintf(stderr, " of %.1f MiB (%.1f%%)", (double)stats.inputsize / MIB,
+				100.0 * (double)stats.bytes / (double)stats.inputsize);
+	fprintf(stderr, ", %" PRIuLEAST64 " elements, %.1f MiB/s, %.0f elements/s",
+			stats.elements, rate / MIB, (double)stats.elements / elapsed);
+	if (stats.inputsize > stats.bytes && rate > 0.0) {
+		formatDuration(eta, sizeof(eta), (double)(stats.inputsize - stats.bytes) / rate);
+		fprintf(stderr, ", ETA %s", eta);
+	}
+	fprintf(stderr, "\n");
+}
+
+static void formatDuration(char * buf, size_t size, double seconds) {
+	unsigned long total = (unsigned long)(seconds + 0.5);
+
+	snprintf(buf, size, "%luh%02lum%02lus", total / 3600, total / 60 % 60, total % 60);
+}
+
+static void putJSONString(FILE * file, const char * str) {
+	const unsigned char * c;
+
+	fputc('"', file);
+	for (c = (const unsigned char *)str; *c; ++c) {
+		if ('"' == *c || '\\' == *c)
+			fprintf(file, "\\%c", *c);
+		else if (*c < 0x20)
+			fprintf(file, "\\u%04x", *c);
+		else
+			fputc(*c, file);
+	}
+	fputc('"', file);
+}
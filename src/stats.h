@@ -0,0 +1,74 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Runtime statistics: element counters, progress and phase timing.
+ *
+ * The element counters live in every parseState, so parsers count without
+ * locking; parallel parsing adds the counters of every chunk to the state
+ * that writes the output. The input consumed, the time spent per phase and
+ * the progress lines are process wide, and safe to update from any thread.
+ *
+ * The time of a run is split in three phases: writing is the time spent in
+ * write(2), filtering and formatting is estimated by timing a sample of the
+ * printed elements and tags, and parsing is the rest of the time the parser
+ * threads were busy. */
+
+#include "util.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* the input is consumed in slices of about this size, so progress is
+ * reported at least this often */
+#define OSM_PROGRESS_STEP ((size_t)16 * 1024 * 1024)
+
+/* starts measuring; 'inputsize' is used for the ETA and may be 0 when
+ * unknown, progress is printed to stderr every 'interval' seconds, or
+ * never when 'interval' is 0 */
+void osm2prolog_startStats(uint_least64_t inputsize, unsigned int interval);
+
+/* whether osm2prolog_startStats was called */
+bool osm2prolog_statsEnabled(void);
+
+/* monotonic time in nanoseconds */
+uint_least64_t osm2prolog_now(void);
+
+/* the number of nodes, ways and relations a state has read */
+uint_least64_t osm2prolog_elementCount(const parseState * state);
+
+/* reports 'bytes' more input read and 'elements' more elements parsed, and
+ * prints a progress line when one is due */
+void osm2prolog_addProgress(uint_least64_t bytes, uint_least64_t elements);
+
+/* adds the time a parser thread was busy; 'writes' when it wrote its
+ * output itself meanwhile, so that time is not counted twice */
+void osm2prolog_addParseTime(uint_least64_t nanoseconds, bool writes);
+
+/* adds time spent in write(2); 'sync' when it was the parser that waited */
+void osm2prolog_addWriteTime(uint_least64_t nanoseconds, bool sync);
+
+/* adds the counters and the sampled time of one state to another */
+void osm2prolog_addCounters(parseState * dest, const parseState * src);
+
+/* prints a summary of the run to stderr and, unless 'jsonfile' is NULL,
+ * writes it as a JSON object to 'jsonfile' ("-" for stderr); returns false
+ * when the JSON summary could not be written */
+bool osm2prolog_reportStats(const parseState * state, const char * input, const char * jsonfile);
@@ -0,0 +1,261 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tagdict.h"
+#include "dict.h"
+#include "output.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* record layout, as written by osm2prolog_putRecord */
+#define KEY_SIZE sizeof(int_least64_t)
+#define LEN_SIZE sizeof(uint_least32_t)
+#define HEADER_SIZE (KEY_SIZE + LEN_SIZE)
+
+struct osmTagDict {
+	osmPrintMode mode;
+	osmOutput * keyout;
+	osmOutput * valueout;
+	bool own;
+	osmDict * keys;
+	osmDict * values;
+	size_t * numvalues; /* distinct values interned per key id */
+	size_t maxkeys;
+	size_t maxvalues;
+	unsigned int users; /* references, closed when the last one goes */
+};
+
+/* the dictionary and the tag records it got so far, for one tag output */
+typedef
+struct tagEncoder {
+	osmTagDict * dict;
+	osmOutput * dest;
+	bool own;
+	const char * predicate;
+	unsigned char * pending; /* incomplete record data */
+	size_t size;
+	size_t cap;
+}
+tagEncoder;
+
+/************************/
+/* forward declarations */
+/************************/
+static uint_least32_t internKey(osmTagDict * dict, const unsigned char * str, size_t len);
+static bool internValue(osmTagDict * dict, uint_least32_t keyid, const unsigned char * str, size_t len, uint_least32_t * id);
+static void putEntry(osmPrintMode mode, osmOutput * out, const char * predicate, uint_least32_t id, const unsigned char * str, size_t len);
+static bool encoderWrite(void * arg, const char * data, size_t size);
+static bool encoderClose(void * arg);
+static void encodeRecord(tagEncoder * encoder, int_least64_t key, const unsigned char * payload, size_t len);
+
+/**************/
+/* dictionary */
+/**************/
+osmTagDict * osm2prolog_createTagDict(osmPrintMode mode, osmOutput * keys, osmOutput * values, bool own, size_t maxvalues) {
+	osmTagDict * dict = xmlMalloc(sizeof(osmTagDict));
+
+	dict->mode = mode;
+	dict->keyout = keys;
+	dict->valueout = values;
+	dict->own = own;
+	dict->keys = osm2prolog_createDict();
+	dict->values = osm2prolog_createDict();
+	dict->maxkeys = 1024;
+	dict->numvalues = xmlMalloc(dict->maxkeys * sizeof(size_t));
+	dict->maxvalues = maxvalues;
+	dict->users = 1;
+	return dict;
+}
+
+bool osm2prolog_releaseTagDict(osmTagDict * dict) {
+	bool ok = true;
+
+	if (0 != --dict->users)
+		return true;
+	if (dict->own) {
+		ok = osm2prolog_closeOutput(dict->keyout) && ok;
+		ok = osm2prolog_closeOutput(dict->valueout) && ok;
+	}
+	osm2prolog_freeDict(dict->keys);
+	osm2prolog_freeDict(dict->values);
+	xmlFree(dict->numvalues);
+	xmlFree(dict);
+	return ok;
+}
+
+static uint_least32_t internKey(osmTagDict * dict, const unsigned char * str, size_t len) {
+	bool added;
+	uint_least32_t id = osm2prolog_dictIntern(dict->keys, str, len, &added);
+
+	if (added) {
+		if (id == dict->maxkeys) {
+			dict->maxkeys *= 2;
+			dict->numvalues = xmlRealloc(dict->numvalues, dict->maxkeys * sizeof(size_t));
+		}
+		dict->numvalues[id] = 0;
+		putEntry(dict->mode, dict->keyout, "tagkey_dict", id, str, len);
+	}
+	return id;
+}
+
+/* returns false for values that are written as strings */
+static bool internValue(osmTagDict * dict, uint_least32_t keyid, const unsigned char * str, size_t len, uint_least32_t * id) {
+	if (osm2prolog_dictFind(dict->values, str, len, id))
+		return true;
+	if (dict->numvalues[keyid] >= dict->maxvalues)
+		return false;
+
+	dict->numvalues[keyid]++;
+	*id = osm2prolog_dictIntern(dict->values, str, len, NULL);
+	putEntry(dict->mode, dict->valueout, "tagvalue_dict", *id, str, len);
+	return true;
+}
+
+/* print: "predicate(id, 'string')." or "id <tab> string" */
+static void putEntry(osmPrintMode mode, osmOutput * out, const char * predicate, uint_least32_t id, const unsigned char * str, size_t len) {
+	if (PL == mode) {
+		osm2prolog_putString(out, predicate);
+		osm2prolog_putChar(out, '(');
+		osm2prolog_putInt(out, id);
+		osm2prolog_put(out, ", '", 3);
+		osm2prolog_putEscaped(out, str, len, ESCAPE_ATOM);
+		osm2prolog_put(out, "').\n", 4);
+	}
+	else {
+		osm2prolog_putInt(out, id);
+		osm2prolog_putChar(out, '\t');
+		osm2prolog_putEscaped(out, str, len, ESCAPE_FIELD);
+		osm2prolog_putChar(out, '\n');
+	}
+}
+
+
+
+/************/
+/* encoders */
+/************/
+osmOutput * osm2prolog_openTagEncoder(osmTagDict * dict, osmOutput * dest, bool own, const char * predicate) {
+	tagEncoder * encoder = xmlMalloc(sizeof(tagEncoder));
+
+	memset(encoder, 0, sizeof(tagEncoder));
+	encoder->dict = dict;
+	encoder->dest = dest;
+	encoder->own = own;
+	encoder->predicate = predicate;
+	dict->users++;
+	return osm2prolog_openSinkOutput(encoderWrite, encoderClose, encoder);
+}
+
+/* records may be split over several calls, the rest of one is kept */
+static bool encoderWrite(void * arg, const char * data, size_t size) {
+	tagEncoder * encoder = arg;
+	size_t pos = 0;
+	uint_least32_t paylen;
+	int_least64_t key;
+
+	if (encoder->size + size > encoder->cap) {
+		encoder->cap = encoder->cap ? encoder->cap : 64 * 1024;
+		while (encoder->size + size > encoder->cap)
+			encoder->cap *= 2;
+		encoder->pending = xmlRealloc(encoder->pending, encoder->cap);
+	}
+	memcpy(encoder->pending + encoder->size, data, size);
+	encoder->size += size;
+
+	while (pos + HEADER_SIZE <= encoder->size) {
+		memcpy(&paylen, encoder->pending + pos + KEY_SIZE, LEN_SIZE);
+		if (pos + HEADER_SIZE + paylen > encoder->size)
+			break;
+		memcpy(&key, encoder->pending + pos, KEY_SIZE);
+		encodeRecord(encoder, key, encoder->pending + pos + HEADER_SIZE, paylen);
+		pos += HEADER_SIZE + paylen;
+	}
+	memmove(encoder->pending, encoder->pending + pos, encoder->size - pos);
+	encoder->size -= pos;
+	return true;
+}
+
+static bool encoderClose(void * arg) {
+	tagEncoder * encoder = arg;
+	bool ok = true;
+
+	if (encoder->size > 0) {
+		fprintf(stderr, "INTERNAL ERROR: incomplete record in tag output.\n");
+		ok = false;
+	}
+	if (encoder->own)
+		ok = osm2prolog_closeOutput(encoder->dest) && ok;
+	ok = osm2prolog_releaseTagDict(encoder->dict) && ok;
+	xmlFree(encoder->pending);
+	xmlFree(encoder);
+	return ok;
+}
+
+/* payload: key length as uint32, key, value */
+static void encodeRecord(tagEncoder * encoder, int_least64_t key, const unsigned char * payload, size_t len) {
+	osmOutput * out = encoder->dest;
+	uint_least32_t keylen;
+	uint_least32_t keyid;
+	uint_least32_t valueid;
+	const unsigned char * value;
+	size_t valuelen;
+	bool interned;
+
+	memcpy(&keylen, payload, sizeof(keylen));
+	payload += sizeof(keylen);
+	value = payload + keylen;
+	valuelen = len - sizeof(keylen) - keylen;
+	keyid = internKey(encoder->dict, payload, keylen);
+	interned = internValue(encoder->dict, keyid, value, valuelen, &valueid);
+
+	if (PL == encoder->dict->mode) {
+		/* print: "predicate(parentid, keyid, valueid)." or "predicate(parentid, keyid, 'value')." */
+		osm2prolog_putString(out, encoder->predicate);
+		osm2prolog_putChar(out, '(');
+		osm2prolog_putInt(out, key);
+		osm2prolog_put(out, ", ", 2);
+		osm2prolog_putInt(out, keyid);
+		osm2prolog_put(out, ", ", 2);
+		if (interned)
+			osm2prolog_putInt(out, valueid);
+		else {
+			osm2prolog_putChar(out, '\'');
+			osm2prolog_putEscaped(out, value, valuelen, ESCAPE_ATOM);
+			osm2prolog_putChar(out, '\'');
+		}
+		osm2prolog_put(out, ").\n", 3);
+		return;
+	}
+
+	/* print: "parentid <tab> keyid <tab> valueid <tab>" or "parentid <tab> keyid <tab> <tab> value" */
+	osm2prolog_putInt(out, key);
+	osm2prolog_putChar(out, '\t');
+	osm2prolog_putInt(out, keyid);
+	osm2prolog_putChar(out, '\t');
+	if (interned)
+		osm2prolog_putInt(out, valueid);
+	osm2prolog_putChar(out, '\t');
+	if (!interned)
+		osm2prolog_putEscaped(out, value, valuelen, ESCAPE_FIELD);
+	osm2prolog_putChar(out, '\n');
+}
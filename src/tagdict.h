@@ -0,0 +1,60 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Dictionary encoded tags.
+ *
+ * Tag keys, and the values of keys with few distinct values, are replaced
+ * by integer ids, which are defined once in separate dictionary outputs:
+ *
+ *   PL      tagkey_dict(Id, 'key').  tagvalue_dict(Id, 'value').
+ *           node_tag(NodeId, KeyId, ValueId).  node_tag(NodeId, KeyId, 'value').
+ *   TABLE   dictionaries "id <tab> string"
+ *           tags "parentid <tab> keyid <tab> valueid <tab>" or
+ *           "parentid <tab> keyid <tab> <tab> value"
+ *
+ * Ids are assigned in order of first appearance, and every dictionary entry
+ * is written before the first tag that uses it when both go to the same
+ * output. The values of a key are interned until that key has 'maxvalues'
+ * distinct values, later new values are written as strings; values already
+ * in the dictionary are always written as ids.
+ *
+ * Encoders take the tag records of sort.h (see print.c), so that ids are
+ * assigned where the records come together, in the same order with -j. */
+
+#include "output.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct osmTagDict osmTagDict;
+
+/* creates a dictionary that writes its entries to 'keys' and 'values' in the
+ * format of 'mode', and closes them when it is closed itself if 'own' is set */
+osmTagDict * osm2prolog_createTagDict(osmPrintMode mode, osmOutput * keys, osmOutput * values, bool own, size_t maxvalues);
+
+/* returns an output that takes tag records and writes them encoded to
+ * 'dest', closing 'dest' when it is closed itself if 'own' is set; PL facts
+ * are named 'predicate' */
+osmOutput * osm2prolog_openTagEncoder(osmTagDict * dict, osmOutput * dest, bool own, const char * predicate);
+
+/* drops the reference of the creator, the dictionary is closed when its
+ * encoders are closed too; returns false if a write failed */
+bool osm2prolog_releaseTagDict(osmTagDict * dict);
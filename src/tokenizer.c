@@ -0,0 +1,936 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tokenizer.h"
+#include "elements.h"
+#include "stats.h"
+#include "types.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+
+/* bytes of a start tag that decide whether it is a boundary: "<relation"
+ * and the character after it */
+#define BOUNDARY_TAG_PREFIX 10
+
+/* names of elements, one after the other */
+typedef
+struct nameStack {
+	char * names;
+	size_t used;
+	size_t cap;
+	size_t * ends; /* of each name in names */
+	size_t count;
+	size_t maxcount;
+}
+nameStack;
+
+struct osmNesting {
+	bool document; /* a whole document, see tokenizer.h */
+	nameStack open; /* the open elements, innermost last */
+	nameStack unmatched; /* chunks: end tags of elements opened before the chunk, in order */
+	size_t toplevel; /* elements closed at depth 0 before any unmatched end tag: the root of a document */
+	bool trailing; /* chunks: an element started after an unmatched end tag */
+};
+
+/* state of one tokenizer run */
+typedef
+struct tokenizer {
+	parseState * state;
+	osmNesting * nesting;
+	const char * data;
+	const char * end;
+	size_t offset;	/* file offset of data */
+
+	/* decoded attribute values of the current start tag */
+	xmlChar * scratch;
+	size_t scratchsize;
+	size_t scratchused;
+}
+tokenizer;
+
+struct osmTokenFeed {
+	parseState * state;
+	char * pending; /* from the last element boundary on */
+	size_t pendingsize;
+	size_t pendingcap;
+	size_t scanned; /* pending is searched for boundaries from here on */
+	bool incomment; /* where it is inside a comment */
+	size_t boundary; /* the last boundary found in pending, 0 for none */
+	size_t offset; /* input offset of the data that is not tokenized yet */
+	osmNesting * nesting;
+	bool ok;
+};
+
+/************************/
+/* forward declarations */
+/************************/
+static inline bool isSpace(char c);
+static bool isBoundary(const char * pos, const char * end);
+static const char * commentEnd(const char * pos, const char * end);
+static const char * enclosingComment(const char * pos, const char * at, const char * end);
+static osmElement elementName(const char * name, size_t len);
+static osmElement attributeName(const char * name, size_t len);
+
+static const char * skipMarkup(tokenizer * tok, const char * pos);
+static const char * endTag(tokenizer * tok, const char * pos);
+static const char * startTag(tokenizer * tok, const char * pos);
+static const char * attributeValue(tokenizer * tok, const char * pos, osmSlice * values, osmSlice * value);
+static bool decodeValue(tokenizer * tok, const char * str, size_t len, osmSlice * values, osmSlice * value);
+static void growScratch(tokenizer * tok, size_t len, osmSlice * values);
+static size_t encodeUTF8(unsigned long codepoint, xmlChar * dest);
+
+static bool startNesting(tokenizer * tok, const char * name, size_t len, bool empty);
+static bool endNesting(tokenizer * tok, const char * name, size_t len);
+static void openRoot(osmNesting * nesting, const char * data, size_t size);
+static void pushName(nameStack * stack, const char * name, size_t len);
+static void popName(nameStack * stack);
+static const char * nameAt(const nameStack * stack, size_t i, size_t * len);
+static bool isTopName(const nameStack * stack, const char * name, size_t len);
+static void freeNames(nameStack * stack);
+
+static void syntaxError(const tokenizer * tok, const char * pos, const char * what);
+static void appendPending(osmTokenFeed * feed, const char * data, size_t size);
+static void scanPending(osmTokenFeed * feed);
+
+/*****************/
+/* the interface */
+/*****************/
+bool osm2prolog_tokenizerSupports(const char * data, size_t size) {
+	const char * const end = data + size;
+	const char * pos = data;
+	const char * declend;
+	const char * enc;
+
+	/* UTF-16 byte order marks */
+	if (size >= 2 && (('\xfe' == data[0] && '\xff' == data[1]) || ('\xff' == data[0] && '\xfe' == data[1])))
+		return false;
+
+	/* the encoding declaration, if any, must be UTF-8 */
+	if (size >= 5 && 0 == memcmp(data, "<?xml", 5)) {
+		declend = memchr(data, '>', size);
+		if (!declend)
+			return false;
+		for (enc = data; enc + 8 < declend; ++enc) {
+			if (0 == memcmp(enc, "encoding", 8)) {
+				enc += 8;
+				while (enc < declend && ('=' == *enc || '"' == *enc || '\'' == *enc || isSpace(*enc)))
+					++enc;
+				if ((size_t)(declend - enc) < 5 || 0 != xmlStrncasecmp((const xmlChar *)enc, BAD_CAST "utf-8", 5))
+					return false;
+				break;
+			}
+		}
+	}
+
+	/* no document type declarations before the root element */
+	while (pos < end && (pos = memchr(pos, '<', (size_t)(end - pos)))) {
+		if ((size_t)(end - pos) >= 4 && 0 == memcmp(pos, "<!--", 4)) {
+			pos = memmem(pos + 4, (size_t)(end - pos - 4), "-->", 3);
+			continue;
+		}
+		if ((size_t)(end - pos) >= 2 && '!' == pos[1])
+			return false;
+		if ((size_t)(end - pos) >= 2 && '?' != pos[1])
+			return true;
+		++pos;
+	}
+	return true;
+}
+
+size_t osm2prolog_findBoundary(const char * data, size_t size, size_t begin, size_t from) {
+	const char * const end = data + size;
+	const char * pos = data + from;
+	const char * comment = enclosingComment(data + begin, pos, end);
+
+	if (comment)
+		pos = commentEnd(comment, end);
+	while (pos < end && (pos = memchr(pos, '<', (size_t)(end - pos)))) {
+		if (isBoundary(pos, end))
+			return (size_t)(pos - data);
+		comment = commentEnd(pos, end);
+		pos = comment ? comment : pos + 1;
+	}
+	return size;
+}
+
+bool osm2prolog_tokenize(parseState * state, osmNesting * nesting, const char * data, size_t size, size_t offset) {
+	tokenizer tok = {state, nesting, data, data + size, offset, NULL, 0, 0};
+	const char * pos = data;
+	const char * next;
+
+	while (pos && pos < tok.end) {
+		/* character data between elements is not used by OSM */
+		next = memchr(pos, '<', (size_t)(tok.end - pos));
+		if (!next)
+			break;
+		pos = next;
+		if (pos + 1 >= tok.end) {
+			syntaxError(&tok, pos, "unexpected end of input");
+			pos = NULL;
+			break;
+		}
+
+		switch (pos[1]) {
+			case '/':
+				pos = endTag(&tok, pos + 2);
+				break;
+			case '?':
+			case '!':
+				pos = skipMarkup(&tok, pos);
+				break;
+			default:
+				pos = startTag(&tok, pos + 1);
+		}
+	}
+
+	xmlFree(tok.scratch);
+	return NULL != pos;
+}
+
+osmTokenFeed * osm2prolog_openTokenFeed(parseState * state) {
+	osmTokenFeed * feed = xmlMalloc(sizeof(osmTokenFeed));
+
+	memset(feed, 0, sizeof(osmTokenFeed));
+	feed->state = state;
+	feed->nesting = osm2prolog_createNesting(true);
+	feed->ok = true;
+	return feed;
+}
+
+bool osm2prolog_feedTokens(osmTokenFeed * feed, const char * data, size_t size) {
+	size_t split;
+
+	if (!feed->ok)
+		return false;
+
+	/* a piece may start inside a comment the pending data opened, so
+	 * boundaries are looked for in both together */
+	appendPending(feed, data, size);
+	scanPending(feed);
+	if (feed->boundary > 0) {
+		split = feed->boundary;
+		feed->ok = osm2prolog_tokenize(feed->state, feed->nesting, feed->pending, split, feed->offset);
+		feed->offset += split;
+		feed->pendingsize -= split;
+		memmove(feed->pending, feed->pending + split, feed->pendingsize);
+		feed->scanned = (feed->scanned > split) ? feed->scanned - split : 0;
+		feed->boundary = 0;
+	}
+	return feed->ok;
+}
+
+bool osm2prolog_closeTokenFeed(osmTokenFeed * feed, bool complete) {
+	bool ok = feed->ok && complete;
+
+	if (ok && feed->pendingsize > 0)
+		ok = osm2prolog_tokenize(feed->state, feed->nesting, feed->pending, feed->pendingsize, feed->offset);
+	ok = ok && osm2prolog_endNesting(feed->nesting);
+	osm2prolog_freeNesting(feed->nesting);
+	xmlFree(feed->pending);
+	xmlFree(feed);
+	return ok;
+}
+
+int osm2prolog_parseMappedFile(parseState * state, const char * filename) {
+	size_t size = 0;
+	const char * data = osm2prolog_mapFile(filename, &size);
+	osmNesting * nesting;
+	uint_least64_t elements;
+	uint_least64_t resume = 0;
+	size_t begin;
+	size_t end;
+	bool ok;
+
+	if (!data)
+		return 1;
+	if (!osm2prolog_tokenizerSupports(data, size)) {
+		if (!state->quiet)
+			fprintf(stderr, "Note: %s uses XML features the fast tokenizer does not support, using libxml2.\n", filename);
+		osm2prolog_unmapFile(data, size);
+		return 1;
+	}
+
+	/* in slices, so progress can be reported and checkpoints written */
+	osm2prolog_startDocument(state);
+	ok = !state->checkpoint || osm2prolog_resumeConversion(state, &resume);
+	nesting = osm2prolog_createNesting(true);
+	if (resume > 0)
+		openRoot(nesting, data, size);
+	for (begin = (size_t)resume; ok && begin < size; begin = end) {
+		end = (size - begin <= OSM_PROGRESS_STEP) ? size : osm2prolog_findBoundary(data, size, begin, begin + OSM_PROGRESS_STEP);
+		elements = osm2prolog_elementCount(state);
+		ok = osm2prolog_tokenize(state, nesting, data + begin, end - begin, begin);
+		osm2prolog_addProgress(end - begin, osm2prolog_elementCount(state) - elements);
+		if (ok && state->checkpoint)
+			osm2prolog_passCheckpoint(state, end);
+	}
+	ok = ok && osm2prolog_endNesting(nesting);
+	osm2prolog_freeNesting(nesting);
+	osm2prolog_endDocument(state);
+
+	osm2prolog_unmapFile(data, size);
+	return ok ? 0 : -1;
+}
+
+
+osmNesting * osm2prolog_createNesting(bool document) {
+	osmNesting * nesting = xmlMalloc(sizeof(osmNesting));
+
+	memset(nesting, 0, sizeof(osmNesting));
+	nesting->document = document;
+	return nesting;
+}
+
+void osm2prolog_freeNesting(osmNesting * nesting) {
+	if (!nesting)
+		return;
+	freeNames(&nesting->open);
+	freeNames(&nesting->unmatched);
+	xmlFree(nesting);
+}
+
+bool osm2prolog_joinNesting(osmNesting * document, const osmNesting * chunk) {
+	const char * name;
+	const char * open;
+	size_t len;
+	size_t openlen;
+	size_t i;
+
+	if (0 == document->open.count) {
+		if (document->toplevel > 0 && (chunk->toplevel > 0 || chunk->open.count > 0 || chunk->unmatched.count > 0)) {
+			fprintf(stderr, "Error: content after the root element.\n");
+			return false;
+		}
+		document->toplevel += chunk->toplevel;
+	}
+
+	for (i = 0; i < chunk->unmatched.count; ++i) {
+		name = nameAt(&chunk->unmatched, i, &len);
+		if (0 == document->open.count) {
+			fprintf(stderr, "Error: end tag </%.*s> without a start tag.\n", (int)len, name);
+			return false;
+		}
+		if (!isTopName(&document->open, name, len)) {
+			open = nameAt(&document->open, document->open.count - 1, &openlen);
+			fprintf(stderr, "Error: end tag </%.*s> does not match <%.*s>.\n", (int)len, name, (int)openlen, open);
+			return false;
+		}
+		popName(&document->open);
+		if (0 == document->open.count)
+			++document->toplevel;
+	}
+
+	if (chunk->trailing && 0 == document->open.count) {
+		fprintf(stderr, "Error: content after the root element.\n");
+		return false;
+	}
+	for (i = 0; i < chunk->open.count; ++i) {
+		name = nameAt(&chunk->open, i, &len);
+		pushName(&document->open, name, len);
+	}
+	return true;
+}
+
+bool osm2prolog_endNesting(const osmNesting * document) {
+	const char * name;
+	size_t len;
+
+	if (document->open.count > 0) {
+		name = nameAt(&document->open, document->open.count - 1, &len);
+		fprintf(stderr, "Error: the input ends inside <%.*s>.\n", (int)len, name);
+		return false;
+	}
+	if (0 == document->toplevel) {
+		fprintf(stderr, "Error: the input has no root element.\n");
+		return false;
+	}
+	if (document->toplevel > 1) {
+		fprintf(stderr, "Error: content after the root element.\n");
+		return false;
+	}
+	return true;
+}
+
+
+
+/********/
+/* tags */
+/********/
+/* skips comments and processing instructions, fails on anything else */
+static const char * skipMarkup(tokenizer * tok, const char * pos) {
+	const char * const end = tok->end;
+	const char * close;
+
+	if ((size_t)(end - pos) >= 4 && 0 == memcmp(pos, "<!--", 4)) {
+		for (close = pos + 4; close + 3 <= end; ++close) {
+			close = memchr(close, '-', (size_t)(end - close));
+			if (!close || close + 3 > end)
+				break;
+			if ('-' == close[1] && '>' == close[2])
+				return close + 3;
+		}
+		syntaxError(tok, pos, "unterminated comment");
+		return NULL;
+	}
+
+	if ('?' == pos[1]) {
+		for (close = pos + 2; close + 2 <= end; ++close) {
+			close = memchr(close, '?', (size_t)(end - close));
+			if (!close || close + 2 > end)
+				break;
+			if ('>' == close[1])
+				return close + 2;
+		}
+		syntaxError(tok, pos, "unterminated processing instruction");
+		return NULL;
+	}
+
+	syntaxError(tok, pos, "unsupported markup (DTD or CDATA), try --parser libxml");
+	return NULL;
+}
+
+/* pos points just after "</" */
+static const char * endTag(tokenizer * tok, const char * pos) {
+	const char * name = pos;
+	size_t namelen;
+	osmElement element;
+
+	while (pos < tok->end && '>' != *pos && !isSpace(*pos))
+		++pos;
+	element = elementName(name, (size_t)(pos - name));
+
+	namelen = (size_t)(pos - name);
+
+	while (pos < tok->end && isSpace(*pos))
+		++pos;
+	if (pos >= tok->end || '>' != *pos) {
+		syntaxError(tok, name, "malformed end tag");
+		return NULL;
+	}
+	if (!endNesting(tok, name, namelen))
+		return NULL;
+
+	if (_OSM_ELEMENT_UNSET_ != element)
+		osm2prolog_endElement(tok->state, element);
+	return pos + 1;
+}
+
+/* pos points just after "<" */
+static const char * startTag(tokenizer * tok, const char * pos) {
+	osmSlice values[_OSM_ELEMENT_SIZE_] = {{NULL, 0}};
+	const char * const end = tok->end;
+	const char * name = pos;
+	const char * attrname;
+	size_t namelen;
+	osmElement element;
+	osmElement attribute;
+	osmSlice value;
+	bool empty = false;
+
+	while (pos < end && '>' != *pos && '/' != *pos && !isSpace(*pos))
+		++pos;
+	namelen = (size_t)(pos - name);
+	element = elementName(name, namelen);
+	tok->scratchused = 0;
+
+	for (;;) {
+		while (pos < end && isSpace(*pos))
+			++pos;
+		if (pos >= end) {
+			syntaxError(tok, name, "unterminated start tag");
+			return NULL;
+		}
+		if ('>' == *pos) {
+			++pos;
+			break;
+		}
+		if ('/' == *pos) {
+			if (pos + 1 >= end || '>' != pos[1]) {
+				syntaxError(tok, pos, "malformed empty element tag");
+				return NULL;
+			}
+			empty = true;
+			pos += 2;
+			break;
+		}
+
+		/* name="value" */
+		attrname = pos;
+		while (pos < end && '=' != *pos && !isSpace(*pos))
+			++pos;
+		attribute = attributeName(attrname, (size_t)(pos - attrname));
+		while (pos < end && isSpace(*pos))
+			++pos;
+		if (pos >= end || '=' != *pos) {
+			syntaxError(tok, attrname, "attribute without value");
+			return NULL;
+		}
+		++pos;
+		while (pos < end && isSpace(*pos))
+			++pos;
+		pos = attributeValue(tok, pos, values, &value);
+		if (!pos)
+			return NULL;
+		if (_OSM_ELEMENT_UNSET_ != attribute)
+			values[attribute] = value;
+	}
+	if (!startNesting(tok, name, namelen, empty))
+		return NULL;
+
+	if (_OSM_ELEMENT_UNSET_ == element) {
+		if (!tok->state->quiet)
+			fprintf(stderr, "unknown element: %.*s\n", (int)namelen, name);
+		return pos;
+	}
+
+	osm2prolog_startElement(tok->state, element, values);
+	if (empty)
+		osm2prolog_endElement(tok->state, element);
+	return pos;
+}
+
+/* pos points at the opening quote, returns the position after the closing one */
+static const char * attributeValue(tokenizer * tok, const char * pos, osmSlice * values, osmSlice * value) {
+	const char * const end = tok->end;
+	const char * str;
+	char quote;
+	bool plain = true;
+
+	if (pos >= end || ('"' != *pos && '\'' != *pos)) {
+		syntaxError(tok, pos, "unquoted attribute value");
+		return NULL;
+	}
+	quote = *pos++;
+
+	for (str = pos; pos < end && quote != *pos; ++pos) {
+		if ('&' == *pos || '\t' == *pos || '\n' == *pos || '\r' == *pos)
+			plain = false;
+	}
+	if (pos >= end) {
+		syntaxError(tok, str, "unterminated attribute value");
+		return NULL;
+	}
+
+	if (plain) {
+		value->str = (const xmlChar *)str;
+		value->len = (size_t)(pos - str);
+	}
+	else if (!decodeValue(tok, str, (size_t)(pos - str), values, value))
+		return NULL;
+
+	return pos + 1;
+}
+
+/* Decodes entities and normalizes literal whitespace the way an XML parser
+ * does for attribute values. The result never exceeds the input length. */
+static bool decodeValue(tokenizer * tok, const char * str, size_t len, osmSlice * values, osmSlice * value) {
+	static const struct { const char * name; size_t len; xmlChar c; } entities[] = {
+		{"lt;", 3, '<'}, {"gt;", 3, '>'}, {"amp;", 4, '&'}, {"quot;", 5, '"'}, {"apos;", 5, '\''}
+	};
+	const char * const end = str + len;
+	const char * semicolon;
+	unsigned long codepoint;
+	xmlChar * dest;
+	char * numend;
+	size_t i;
+
+	if (tok->scratchused + len > tok->scratchsize)
+		growScratch(tok, len, values);
+	dest = tok->scratch + tok->scratchused;
+	value->str = dest;
+
+	while (str < end) {
+		switch (*str) {
+			case '\r':
+				*dest++ = ' ';
+				str += (str + 1 < end && '\n' == str[1]) ? 2 : 1;
+				break;
+			case '\t':
+			case '\n':
+				*dest++ = ' ';
+				++str;
+				break;
+			case '&':
+				++str;
+				semicolon = memchr(str, ';', (size_t)(end - str));
+				if (!semicolon) {
+					syntaxError(tok, str, "unterminated entity reference");
+					return false;
+				}
+				if ('#' == *str) {
+					codepoint = ('x' == str[1])
+						? strtoul(str + 2, &numend, 16)
+						: strtoul(str + 1, &numend, 10);
+					if (numend != semicolon || 0 == codepoint || codepoint > 0x10FFFF) {
+						syntaxError(tok, str, "invalid character reference");
+						return false;
+					}
+					dest += encodeUTF8(codepoint, dest);
+				}
+				else {
+					for (i = 0; i < sizeof(entities) / sizeof(entities[0]); ++i) {
+						if ((size_t)(semicolon + 1 - str) == entities[i].len
+								&& 0 == memcmp(str, entities[i].name, entities[i].len))
+							break;
+					}
+					if (i == sizeof(entities) / sizeof(entities[0])) {
+						syntaxError(tok, str, "unknown entity");
+						return false;
+					}
+					*dest++ = entities[i].c;
+				}
+				str = semicolon + 1;
+				break;
+			default:
+				*dest++ = (xmlChar)*str++;
+		}
+	}
+
+	value->len = (size_t)(dest - value->str);
+	tok->scratchused += value->len;
+	return true;
+}
+
+/* makes room for len more bytes; earlier decoded values of the current tag
+ * point into the scratch buffer, so they are moved along */
+static void growScratch(tokenizer * tok, size_t len, osmSlice * values) {
+	size_t offsets[_OSM_ELEMENT_SIZE_];
+	bool inscratch[_OSM_ELEMENT_SIZE_];
+	size_t i;
+
+	for (i = 0; i < _OSM_ELEMENT_SIZE_; ++i) {
+		inscratch[i] = tok->scratchused > 0 && values[i].str
+			&& values[i].str >= tok->scratch && values[i].str < tok->scratch + tok->scratchused;
+		offsets[i] = inscratch[i] ? (size_t)(values[i].str - tok->scratch) : 0;
+	}
+
+	tok->scratchsize = 2 * (tok->scratchused + len) + 256;
+	tok->scratch = xmlRealloc(tok->scratch, tok->scratchsize);
+
+	for (i = 0; i < _OSM_ELEMENT_SIZE_; ++i) {
+		if (inscratch[i])
+			values[i].str = tok->scratch + offsets[i];
+	}
+}
+
+/* a character reference is at least 4 bytes ("&#N;"), which is enough for
+ * any UTF-8 sequence, so decoding never grows the value */
+static size_t encodeUTF8(unsigned long codepoint, xmlChar * dest) {
+	if (codepoint < 0x80) {
+		dest[0] = (xmlChar)codepoint;
+		return 1;
+	}
+	if (codepoint < 0x800) {
+		dest[0] = (xmlChar)(0xC0 | (codepoint >> 6));
+		dest[1] = (xmlChar)(0x80 | (codepoint & 0x3F));
+		return 2;
+	}
+	if (codepoint < 0x10000) {
+		dest[0] = (xmlChar)(0xE0 | (codepoint >> 12));
+		dest[1] = (xmlChar)(0x80 | ((codepoint >> 6) & 0x3F));
+		dest[2] = (xmlChar)(0x80 | (codepoint & 0x3F));
+		return 3;
+	}
+	dest[0] = (xmlChar)(0xF0 | (codepoint >> 18));
+	dest[1] = (xmlChar)(0x80 | ((codepoint >> 12) & 0x3F));
+	dest[2] = (xmlChar)(0x80 | ((codepoint >> 6) & 0x3F));
+	dest[3] = (xmlChar)(0x80 | (codepoint & 0x3F));
+	return 4;
+}
+
+
+
+/***********/
+/* nesting */
+/***********/
+static bool startNesting(tokenizer * tok, const char * name, size_t len, bool empty) {
+	osmNesting * nesting = tok->nesting;
+
+	if (0 == nesting->open.count) {
+		if (nesting->document && nesting->toplevel > 0) {
+			syntaxError(tok, name, "content after the root element");
+			return false;
+		}
+		if (nesting->unmatched.count > 0)
+			nesting->trailing = true;
+		else if (empty)
+			++nesting->toplevel;
+	}
+	if (!empty)
+		pushName(&nesting->open, name, len);
+	return true;
+}
+
+static bool endNesting(tokenizer * tok, const char * name, size_t len) {
+	osmNesting * nesting = tok->nesting;
+	nameStack * open = &nesting->open;
+	const char * expected;
+	size_t expectedlen;
+
+	if (0 == open->count) {
+		if (nesting->document) {
+			syntaxError(tok, name, "end tag without a start tag");
+			return false;
+		}
+		pushName(&nesting->unmatched, name, len);
+		return true;
+	}
+	if (!isTopName(open, name, len)) {
+		expected = nameAt(open, open->count - 1, &expectedlen);
+		fprintf(stderr, "Error: end tag </%.*s> does not match <%.*s> at offset %zu.\n",
+				(int)len, name, (int)expectedlen, expected, tok->offset + (size_t)(name - tok->data));
+		return false;
+	}
+
+	popName(open);
+	if (0 == open->count && 0 == nesting->unmatched.count)
+		++nesting->toplevel;
+	return true;
+}
+
+/* a conversion resumed from a checkpoint starts inside the root element,
+ * the first start tag after the document prolog */
+static void openRoot(osmNesting * nesting, const char * data, size_t size) {
+	const char * const end = data + size;
+	const char * pos = data;
+	const char * name;
+	const char * close;
+
+	while (pos < end && (pos = memchr(pos, '<', (size_t)(end - pos)))) {
+		if ((close = commentEnd(pos, end))) {
+			pos = close;
+			continue;
+		}
+		if (pos + 1 < end && '?' == pos[1]) {
+			close = memmem(pos, (size_t)(end - pos), "?>", 2);
+			pos = close ? close + 2 : end;
+			continue;
+		}
+		name = ++pos;
+		while (pos < end && '>' != *pos && '/' != *pos && !isSpace(*pos))
+			++pos;
+		pushName(&nesting->open, name, (size_t)(pos - name));
+		return;
+	}
+}
+
+static void pushName(nameStack * stack, const char * name, size_t len) {
+	if (stack->used + len > stack->cap) {
+		stack->cap = 2 * (stack->used + len) + 64;
+		stack->names = xmlRealloc(stack->names, stack->cap);
+	}
+	if (stack->count == stack->maxcount) {
+		stack->maxcount = 2 * stack->maxcount + 8;
+		stack->ends = xmlRealloc(stack->ends, stack->maxcount * sizeof(size_t));
+	}
+	memcpy(stack->names + stack->used, name, len);
+	stack->used += len;
+	stack->ends[stack->count++] = stack->used;
+}
+
+static void popName(nameStack * stack) {
+	--stack->count;
+	stack->used = (stack->count > 0) ? stack->ends[stack->count - 1] : 0;
+}
+
+static const char * nameAt(const nameStack * stack, size_t i, size_t * len) {
+	size_t begin = (i > 0) ? stack->ends[i - 1] : 0;
+
+	*len = stack->ends[i] - begin;
+	return stack->names + begin;
+}
+
+static bool isTopName(const nameStack * stack, const char * name, size_t len) {
+	size_t toplen;
+	const char * top = nameAt(stack, stack->count - 1, &toplen);
+
+	return toplen == len && 0 == memcmp(top, name, len);
+}
+
+static void freeNames(nameStack * stack) {
+	xmlFree(stack->names);
+	xmlFree(stack->ends);
+}
+
+
+
+/********/
+/* UTIL */
+/********/
+static inline bool isSpace(char c) {
+	return ' ' == c || '\n' == c || '\t' == c || '\r' == c;
+}
+
+/* pos points at a '<' */
+static bool isBoundary(const char * pos, const char * end) {
+	static const char * const names[] = {"node", "way", "relation"};
+	const size_t numnames = sizeof(names) / sizeof(names[0]);
+	size_t i;
+	size_t len;
+	char next;
+
+	for (i = 0; i < numnames; ++i) {
+		len = strlen(names[i]);
+		if ((size_t)(end - pos) > len + 1 && 0 == memcmp(pos + 1, names[i], len)) {
+			next = pos[len + 1];
+			if (isSpace(next) || '/' == next || '>' == next)
+				return true;
+		}
+	}
+	return false;
+}
+
+/* pos points at a '<'; returns the end of the comment it starts, the end of
+ * the data if the comment is unterminated, or NULL if it starts none */
+static const char * commentEnd(const char * pos, const char * end) {
+	const char * close;
+
+	if ((size_t)(end - pos) < 4 || 0 != memcmp(pos, "<!--", 4))
+		return NULL;
+	close = memmem(pos + 4, (size_t)(end - pos - 4), "-->", 3);
+	return close ? close + 3 : end;
+}
+
+/* returns the start of the comment 'at' is in, or NULL; 'pos' <= 'at' must
+ * be outside comments. Only comments are searched for, not every tag. */
+static const char * enclosingComment(const char * pos, const char * at, const char * end) {
+	const char * limit = ((size_t)(end - at) > 3) ? at + 3 : end;
+	const char * open;
+	const char * close;
+
+	while (pos < at) {
+		open = memmem(pos, (size_t)(limit - pos), "<!--", 4);
+		if (!open)
+			return NULL;
+		close = commentEnd(open, end);
+		if (close > at)
+			return open;
+		pos = close;
+	}
+	return NULL;
+}
+
+static osmElement elementName(const char * name, size_t len) {
+	switch (len) {
+		case 2:
+			return (0 == memcmp(name, "nd", 2)) ? ND : _OSM_ELEMENT_UNSET_;
+		case 3:
+			if (0 == memcmp(name, "tag", 3))
+				return TAG;
+			if (0 == memcmp(name, "way", 3))
+				return WAY;
+			return (0 == memcmp(name, "osm", 3)) ? OSM : _OSM_ELEMENT_UNSET_;
+		case 4:
+			return (0 == memcmp(name, "node", 4)) ? NODE : _OSM_ELEMENT_UNSET_;
+		case 6:
+			if (0 == memcmp(name, "member", 6))
+				return MEMBER;
+			if (0 == memcmp(name, "create", 6))
+				return CREATE;
+			if (0 == memcmp(name, "modify", 6))
+				return MODIFY;
+			return (0 == memcmp(name, "delete", 6)) ? DELETE : _OSM_ELEMENT_UNSET_;
+		case 8:
+			return (0 == memcmp(name, "relation", 8)) ? RELATION : _OSM_ELEMENT_UNSET_;
+		case 9:
+			return (0 == memcmp(name, "osmChange", 9)) ? OSMCHANGE : _OSM_ELEMENT_UNSET_;
+		default:
+			return _OSM_ELEMENT_UNSET_;
+	}
+}
+
+static osmElement attributeName(const char * name, size_t len) {
+	switch (len) {
+		case 1:
+			if ('k' == *name)
+				return K;
+			return ('v' == *name) ? V : _OSM_ELEMENT_UNSET_;
+		case 2:
+			return (0 == memcmp(name, "id", 2)) ? ID : _OSM_ELEMENT_UNSET_;
+		case 3:
+			if (0 == memcmp(name, "ref", 3))
+				return REF;
+			if (0 == memcmp(name, "lat", 3))
+				return LAT;
+			return (0 == memcmp(name, "lon", 3)) ? LON : _OSM_ELEMENT_UNSET_;
+		case 7:
+			return (0 == memcmp(name, "version", 7)) ? VERSION : _OSM_ELEMENT_UNSET_;
+		default:
+			return _OSM_ELEMENT_UNSET_;
+	}
+}
+
+static void syntaxError(const tokenizer * tok, const char * pos, const char * what) {
+	fprintf(stderr, "Error: %s at offset %zu.\n", what, tok->offset + (size_t)(pos - tok->data));
+}
+
+static void appendPending(osmTokenFeed * feed, const char * data, size_t size) {
+	if (0 == size)
+		return;
+	if (feed->pendingsize + size > feed->pendingcap) {
+		feed->pendingcap = 2 * (feed->pendingsize + size);
+		feed->pending = xmlRealloc(feed->pending, feed->pendingcap);
+	}
+	memcpy(feed->pending + feed->pendingsize, data, size);
+	feed->pendingsize += size;
+}
+
+/* finds the last boundary in the data added to pending since the last
+ * search, stepping over comments with memmem; a start tag or comment cut
+ * off at the end is looked at again once more data arrives */
+static void scanPending(osmTokenFeed * feed) {
+	const char * const data = feed->pending;
+	const char * const end = data + feed->pendingsize;
+	const char * pos = data + feed->scanned;
+	const char * open;
+	const char * close;
+	const char * tag;
+
+	while (pos < end) {
+		if (feed->incomment) {
+			close = memmem(pos, (size_t)(end - pos), "-->", 3);
+			if (!close) {
+				pos = ((size_t)(end - pos) > 2) ? end - 2 : pos;
+				break;
+			}
+			feed->incomment = false;
+			pos = close + 3;
+			continue;
+		}
+
+		open = memmem(pos, (size_t)(end - pos), "<!--", 4);
+		for (tag = open ? open : end; tag > pos && (tag = memrchr(pos, '<', (size_t)(tag - pos)));) {
+			if (isBoundary(tag, end)) {
+				feed->boundary = (size_t)(tag - data);
+				break;
+			}
+		}
+		if (!open) {
+			pos = ((size_t)(end - pos) > BOUNDARY_TAG_PREFIX) ? end - BOUNDARY_TAG_PREFIX : pos;
+			break;
+		}
+		feed->incomment = true;
+		pos = open + 4;
+	}
+	feed->scanned = (size_t)(pos - data);
+}
@@ -0,0 +1,91 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* A tokenizer for OSM XML that works directly on a memory mapped file.
+ *
+ * It only understands what OSM XML files actually contain: UTF-8 elements
+ * and attributes, the predefined entities and character references,
+ * comments and processing instructions. Element and attribute values are
+ * handed to the element handlers as slices into the mapping; only values
+ * containing entities or literal whitespace are decoded, into a reused
+ * scratch buffer. Anything else (a DTD, CDATA sections, other encodings)
+ * is left to the libxml2 SAX parser. */
+
+#include "util.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* checks whether the document prolog (everything before the root element)
+ * only uses features the tokenizer supports */
+bool osm2prolog_tokenizerSupports(const char * data, size_t size);
+
+/* returns the offset of the first top level element (node, way or
+ * relation) start tag at or after 'from', or 'size' if there is none.
+ * Tags in comments are no boundaries; 'begin' <= 'from' is a position
+ * outside comments, such as the start of the document or an earlier
+ * boundary, from which the comments are skipped. */
+size_t osm2prolog_findBoundary(const char * data, size_t size, size_t begin, size_t from);
+
+/* the nesting of the elements in tokenized input. A document's nesting
+ * is shared by the runs over its slices, and rejects an end tag without a
+ * start tag or a second root element right away. A -j chunk, which starts
+ * inside the root element, gets a nesting of its own, which keeps those
+ * for osm2prolog_joinNesting. */
+typedef struct osmNesting osmNesting;
+
+osmNesting * osm2prolog_createNesting(bool document);
+void osm2prolog_freeNesting(osmNesting * nesting);
+
+/* continues the nesting of a document with that of its next chunk; returns
+ * false, with a message, if the chunk's end tags do not match */
+bool osm2prolog_joinNesting(osmNesting * document, const osmNesting * chunk);
+
+/* checks that the whole document was tokenized: one root element, closed;
+ * returns false, with a message, otherwise */
+bool osm2prolog_endNesting(const osmNesting * document);
+
+/* calls the element handlers for all elements in [data, data + size), which
+ * must start and end at element boundaries, and checks that they nest.
+ * 'offset' is the position of 'data' in the input, used in messages.
+ * Returns false on malformed input. */
+bool osm2prolog_tokenize(parseState * state, osmNesting * nesting, const char * data, size_t size, size_t offset);
+
+/* tokenizes input that arrives in pieces of any size: the part after the
+ * last element boundary of a piece is kept until the next piece completes
+ * it. The document callbacks are left to the caller. */
+typedef struct osmTokenFeed osmTokenFeed;
+
+osmTokenFeed * osm2prolog_openTokenFeed(parseState * state);
+
+/* calls the element handlers for the elements completed by the next piece
+ * of input; returns false on malformed input, and from then on */
+bool osm2prolog_feedTokens(osmTokenFeed * feed, const char * data, size_t size);
+
+/* tokenizes what is left once the input is 'complete', and frees the feed;
+ * returns false if the input is not complete, its root element is not
+ * closed, or any of it was malformed */
+bool osm2prolog_closeTokenFeed(osmTokenFeed * feed, bool complete);
+
+/* maps and parses a whole file, including the document callbacks.
+ * Returns 0 on success, -1 on failure, including a document whose root
+ * element is not closed, or 1 without producing any output if the file
+ * should be parsed with libxml2 instead. */
+int osm2prolog_parseMappedFile(parseState * state, const char * filename);
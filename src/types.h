@@ -19,12 +19,14 @@
 #pragma once
 
 #include <stdlib.h>
+#include <libxml/xmlstring.h>
 
 typedef
 enum osmElement {
 	_OSM_ELEMENT_UNSET_ = 0,
-	OSM, NODE, WAY, TAG, ND, RELATION, MEMBER, ID, LAT, LON, REF, K, V, VERSION,
-	CREATEDBY, NOTE,
+	OSM, NODE, WAY, TAG, ND, RELATION, MEMBER,
+	OSMCHANGE, CREATE, MODIFY, DELETE, /* osmChange files */
+	ID, LAT, LON, REF, K, V, VERSION,
 	_OSM_ELEMENT_SIZE_
 }
 osmElement;
@@ -34,13 +36,59 @@ enum osmPrintMode {
 	_OSM_PRINT_MODE_UNSET_ = 0,
 	PL,
 	TABLE,
+	BINARY, /* columnar tables, see binary.h */
+	PGCOPY, /* PostgreSQL binary COPY tables, see pgcopy.h */
+	CALLBACK, /* records passed to the callbacks of a library reader, see osm2prolog.h */
 	_OSM_PRINT_MODE_SIZE_
 }
 osmPrintMode;
 
+typedef
+enum osmParser {
+	_OSM_PARSER_UNSET_ = 0,
+	LIBXML, /* libxml2 SAX parser */
+	MMAP, /* tokenizer working on the memory mapped input */
+	PBF, /* OSM PBF reader, chosen automatically for PBF input */
+	_OSM_PARSER_SIZE_
+}
+osmParser;
+
+/* element statistics, counted by every parseState (see stats.h) */
+typedef
+enum osmCounter {
+	COUNT_NODES, /* elements read */
+	COUNT_WAYS,
+	COUNT_RELATIONS,
+	COUNT_NDS,
+	COUNT_TAGS,
+	COUNT_NODES_WRITTEN,
+	COUNT_WAYS_WRITTEN,
+	COUNT_TAGS_WRITTEN,
+	COUNT_BAD_NODES, /* missing or malformed attributes */
+	COUNT_BAD_WAYS, /* also ways without nodes */
+	COUNT_BAD_NDS,
+	COUNT_BAD_TAGS,
+	COUNT_FILTERED_TAGS, /* dropped by the tag filter */
+	COUNT_IGNORED_TAGS, /* of relations, or of nodes and ways that were dropped */
+	COUNT_OUTSIDE_REGION, /* nodes and ways */
+	COUNT_UNTAGGED, /* nodes and ways dropped by -dropuntagged */
+	COUNT_DELETIONS, /* nodes and ways deleted or modified by an osmChange file */
+	_OSM_COUNTER_SIZE_
+}
+osmCounter;
+
 typedef
 struct osm_config {
 	osmPrintMode printMode;
 	char * tableprefix;
 }
 osm_config;
+
+/* a string that is not necessarily nul-terminated, usually pointing into a
+ * parser buffer or a memory mapped input file */
+typedef
+struct osmSlice {
+	const xmlChar * str;
+	size_t len;
+}
+osmSlice;
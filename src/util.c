@@ -17,48 +17,213 @@
  */
 
 #include "util.h"
+#include "shard.h"
 #include "types.h"
 
-#include <ctype.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <libxml/xmlmemory.h>
 #include <libxml/xmlstring.h>
 
 xmlChar ** strConstants;
 
-static bool prolog_is_nasty_char(const xmlChar c);
+static const xmlChar * skipSpace(const xmlChar * pos, const xmlChar * end);
 
-static inline bool prolog_is_nasty_char(const xmlChar c) {
-	return isspace(c)
-		|| '\'' == c;
+/* Numbers are parsed by hand: strtoimax and strtod depend on the locale,
+ * and need a nul-terminated copy of the attribute value. Like those, the
+ * parsers skip leading whitespace. */
+
+static const xmlChar * skipSpace(const xmlChar * pos, const xmlChar * end) {
+	while (pos < end && (' ' == *pos || '\t' == *pos || '\n' == *pos || '\r' == *pos))
+		++pos;
+	return pos;
+}
+
+bool osm2prolog_parseId(osmSlice str, int_least64_t * id) {
+	const xmlChar * const end = str.str + str.len;
+	const xmlChar * pos = skipSpace(str.str, end);
+	const bool negative = (pos < end && '-' == *pos);
+	/* the magnitude of INT64_MIN does not fit an int64 */
+	const uint_least64_t limit = negative ? (uint_least64_t)INT64_MAX + 1 : (uint_least64_t)INT64_MAX;
+	uint_least64_t magnitude = 0;
+	unsigned int digit;
+
+	if (pos < end && ('-' == *pos || '+' == *pos))
+		++pos;
+	if (pos == end)
+		return false;
+	for (; pos < end; ++pos) {
+		digit = (unsigned int)(*pos - '0');
+		if (digit > 9 || magnitude > (limit - digit) / 10)
+			return false;
+		magnitude = magnitude * 10 + digit;
+	}
+	*id = negative ? (int_least64_t)(0 - magnitude) : (int_least64_t)magnitude;
+	return true;
 }
 
-/* TODO check for other nasty things in values like newlines and single quotes */
-/* TODO we could also escape single quotes instead of overwriting them, but it would matter what format we print to */
-xmlChar * prolog_filter_str(const xmlChar * str) {
-	xmlChar * retval = NULL;
-	xmlChar * dest = NULL;
-
-	retval = dest = xmlMalloc(xmlStrlen(str) + 1);
-	/* sequence point after '?' which is a sub expression, so I don't think it's
-	 * defined behaviour to post increment dest in line. */
-	while('\0' != (*dest = (prolog_is_nasty_char(*str) ? ' ' : *str))) {
-		++dest;
-		++str;
+bool osm2prolog_parseDegrees(osmSlice str, int32_t * fixed, bool * plain) {
+	static const uint_least64_t powers[] = {
+		UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000),
+		UINT64_C(100000), UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000),
+		UINT64_C(1000000000), UINT64_C(10000000000), UINT64_C(100000000000),
+		UINT64_C(1000000000000), UINT64_C(10000000000000), UINT64_C(100000000000000),
+		UINT64_C(1000000000000000), UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+		UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+	};
+	const xmlChar * const end = str.str + str.len;
+	const xmlChar * pos = skipSpace(str.str, end);
+	const bool negative = (pos < end && '-' == *pos);
+	uint_least64_t mantissa = 0;
+	uint_least64_t quotient;
+	uint_least64_t remainder;
+	int significant = 0; /* digits in the mantissa, at most 18 */
+	int intdigits = 0;
+	int fracdigits = 0;
+	long exponent = 0; /* of the mantissa, so the value is mantissa * 10^exponent */
+	long written = 0; /* the exponent as written */
+	bool expnegative;
+	int expdigits = 0;
+
+	*plain = (pos == str.str && pos < end && '+' != *pos);
+	if (pos < end && ('-' == *pos || '+' == *pos))
+		++pos;
+
+	/* digits, the ones beyond 18 significant digits only change the
+	 * magnitude, they can't change the value at 10^-7 degrees */
+	for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos, ++intdigits) {
+		if (significant < 18) {
+			mantissa = mantissa * 10 + (uint_least64_t)(*pos - '0');
+			significant += (mantissa > 0);
+		}
+		else
+			++exponent;
 	}
+	if (pos < end && '.' == *pos) {
+		for (++pos; pos < end && *pos >= '0' && *pos <= '9'; ++pos, ++fracdigits) {
+			if (significant < 18) {
+				mantissa = mantissa * 10 + (uint_least64_t)(*pos - '0');
+				significant += (mantissa > 0);
+				--exponent;
+			}
+		}
+		*plain = *plain && intdigits > 0 && fracdigits > 0;
+	}
+	if (0 == intdigits + fracdigits)
+		return false;
+	if (pos < end && ('e' == *pos || 'E' == *pos)) {
+		*plain = false;
+		++pos;
+		expnegative = (pos < end && '-' == *pos);
+		if (pos < end && ('-' == *pos || '+' == *pos))
+			++pos;
+		for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos, ++expdigits)
+			written = (written < 100000) ? written * 10 + (*pos - '0') : written;
+		if (0 == expdigits)
+			return false;
+		exponent += expnegative ? -written : written;
+	}
+	if (pos != end)
+		return false;
 
-	return retval;
+	/* scale to 10^-7 degrees, rounding half away from zero */
+	exponent += 7;
+	if (0 == mantissa)
+		quotient = 0;
+	else if (exponent >= 0) {
+		if (exponent > 9 || mantissa > (uint_least64_t)INT32_MAX / powers[exponent]) {
+			*fixed = OSM_COORD_UNUSABLE;
+			return true;
+		}
+		quotient = mantissa * powers[exponent];
+	}
+	else if (exponent < -19)
+		quotient = 0;
+	else {
+		quotient = mantissa / powers[-exponent];
+		remainder = mantissa % powers[-exponent];
+		quotient += (remainder >= powers[-exponent] - remainder);
+	}
+	if (quotient > (uint_least64_t)INT32_MAX) {
+		*fixed = OSM_COORD_UNUSABLE;
+		return true;
+	}
+	*fixed = negative ? -(int32_t)quotient : (int32_t)quotient;
+	return true;
 }
 
+size_t osm2prolog_formatDegrees(int32_t fixed, unsigned int decimals, char * buf) {
+	static const uint_least32_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
+	uint_least32_t magnitude = (fixed < 0) ? (uint_least32_t)0 - (uint_least32_t)fixed : (uint_least32_t)fixed;
+	uint_least32_t divisor = powers[7 - decimals];
+	uint_least32_t whole;
+	uint_least32_t fraction;
+	char digits[16];
+	size_t len = 0;
+	int i = 0;
 
+	/* drop the decimals, rounding half away from zero */
+	magnitude = magnitude / divisor + (magnitude % divisor >= divisor - magnitude % divisor);
+	whole = magnitude / powers[decimals];
+	fraction = magnitude % powers[decimals];
 
-/* TODO don't hardcode the tags being ignored */
-bool osmIgnoreKey(const xmlChar * keyname) {
-	return (!keyname)
-		|| 0 == xmlStrcmp(keyname, strConstants[CREATEDBY])
-		|| 0 == xmlStrcmp(keyname, strConstants[NOTE])
-		;
+	if (fixed < 0 && magnitude > 0)
+		buf[len++] = '-';
+	do {
+		digits[i++] = (char)('0' + whole % 10);
+		whole /= 10;
+	} while (whole > 0);
+	while (i > 0)
+		buf[len++] = digits[--i];
+	if (decimals > 0) {
+		buf[len++] = '.';
+		for (i = (int)decimals - 1; i >= 0; --i) {
+			buf[len + (size_t)i] = (char)('0' + fraction % 10);
+			fraction /= 10;
+		}
+		len += decimals;
+	}
+	return len;
+}
+
+int32_t osm2prolog_roundDegrees(int32_t fixed, unsigned int decimals) {
+	static const uint_least32_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
+	uint_least32_t magnitude = (fixed < 0) ? (uint_least32_t)0 - (uint_least32_t)fixed : (uint_least32_t)fixed;
+	uint_least32_t divisor = powers[7 - decimals];
+
+	/* rounding half away from zero, which keeps valid coordinates in range */
+	magnitude = (magnitude / divisor + (magnitude % divisor >= divisor - magnitude % divisor)) * divisor;
+	return (fixed < 0) ? -(int32_t)magnitude : (int32_t)magnitude;
+}
+
+const char * osm2prolog_mapFile(const char * filename, size_t * size) {
+	struct stat st;
+	void * data;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || 0 == st.st_size) {
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == data)
+		return NULL;
+
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+	*size = (size_t)st.st_size;
+	return data;
+}
+
+void osm2prolog_unmapFile(const char * data, size_t size) {
+	munmap((void *)data, size);
 }
 
 
@@ -75,6 +240,10 @@ void osm2prolog_init(void) {
 	strConstants[ND] = xmlCharStrdup("nd");
 	strConstants[RELATION] = xmlCharStrdup("relation");
 	strConstants[MEMBER] = xmlCharStrdup("member");
+	strConstants[OSMCHANGE] = xmlCharStrdup("osmChange");
+	strConstants[CREATE] = xmlCharStrdup("create");
+	strConstants[MODIFY] = xmlCharStrdup("modify");
+	strConstants[DELETE] = xmlCharStrdup("delete");
 	strConstants[ID] = xmlCharStrdup("id");
 	strConstants[LAT] = xmlCharStrdup("lat");
 	strConstants[LON] = xmlCharStrdup("lon");
@@ -82,8 +251,6 @@ void osm2prolog_init(void) {
 	strConstants[K] = xmlCharStrdup("k");
 	strConstants[V] = xmlCharStrdup("v");
 	strConstants[VERSION] = xmlCharStrdup("version");
-	strConstants[CREATEDBY] = xmlCharStrdup("created_by");
-	strConstants[NOTE] = xmlCharStrdup("note");
 }
 
 void osm2prolog_cleanup(void) {
@@ -96,35 +263,53 @@ void osm2prolog_cleanup(void) {
 }
 
 parseState * osm2prolog_createParseState (void) {
-	/* "way is an ordered interconnection of at least 2 and at most 2,000[1] (API v0.6) nodes"
-	 * from: http://wiki.openstreetmap.org/wiki/Ways
-	 * TODO: dynamically manage memory for ways */
-	const size_t maxways = 2000;
 	parseState * state = xmlMalloc(sizeof(parseState));
+	/* members not named here start out 0, NULL or false */
 	parseState src_state = {
-		_OSM_ELEMENT_UNSET_,
-		0,
-		true,
-		NULL,
-		NULL,
-		0,
-		maxways,
-		xmlMalloc(maxways * sizeof(int_least64_t)),
-		true,
-		NULL,
-		NULL,
-		NULL,
-		_OSM_PRINT_MODE_UNSET_,
-		NULL,
-		NULL,
-		NULL,
-		NULL
+		.parent = _OSM_ELEMENT_UNSET_,
+		.action = _OSM_ELEMENT_UNSET_,
+		.arena = osm2prolog_createArena(64 * 1024),
+		.badnode = true,
+		.badtag = true,
+		.printMode = _OSM_PRINT_MODE_UNSET_,
+		.readThread = true
 	};
 	memcpy(state, &src_state, sizeof(src_state));
 	return state;
 }
 
+void osm2prolog_outputSlots(parseState * state, osmOutput ** slots[OSM_OUTPUT_SLOTS]) {
+	slots[0] = &state->node_file;
+	slots[1] = &state->way_file;
+	slots[2] = &state->nodetag_file;
+	slots[3] = &state->waytag_file;
+	slots[4] = &state->waygeom_file;
+	slots[5] = &state->nodedelete_file;
+	slots[6] = &state->waydelete_file;
+	slots[7] = &state->prolog_file;
+}
+
+bool osm2prolog_closeOutputs(parseState * state) {
+	osmOutput ** outputs[OSM_OUTPUT_SLOTS];
+	size_t i;
+	bool ok = true;
+
+	if (state->pipeline)
+		return osm2prolog_stopPipeline(state);
+	if (state->shards)
+		return osm2prolog_closeShards(state);
+	osm2prolog_outputSlots(state, outputs);
+	for (i = 0; i < OSM_OUTPUT_SLOTS; ++i) {
+		if (*outputs[i])
+			ok = osm2prolog_closeOutput(*outputs[i]) && ok;
+		*outputs[i] = NULL;
+	}
+	return ok;
+}
+
 void osm2prolog_freeParseState(parseState * state) {
-	xmlFree(state->waynodeids);
+	osm2prolog_closeOutputs(state);
+	osm2prolog_freeShards(state->shards);
+	osm2prolog_freeArena(state->arena);
 	xmlFree(state);
 }
@@ -18,49 +18,104 @@
 
 #pragma once
 
+#include "arena.h"
+#include "checkpoint.h"
+#include "filter.h"
+#include "idset.h"
+#include "locations.h"
+#include "osm2prolog.h"
+#include "output.h"
+#include "pipeline.h"
+#include "region.h"
+#include "shard.h"
 #include "types.h"
 
 #include <stdbool.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <libxml/xmlstring.h>
 
+/* longest lat or lon attribute value we accept, in characters */
+#define OSM_COORD_MAXLEN 31
+/* fixed point coordinates are degrees times this */
+#define OSM_COORD_SCALE 10000000
+/* the fixed point value of coordinates that do not fit */
+#define OSM_COORD_UNUSABLE INT32_MIN
+
 /* represents state while parsing OSM XML data */
 typedef
 struct parseState {
 	/* general */
 	osmElement parent;	
 	int_least64_t parentid;
+	osmElement action; /* CREATE, MODIFY or DELETE inside those blocks of an osmChange file */
+	osmArena * arena; /* reset at the end of every node, way and relation */
+
+	/* region details, see region.h */
+	const osmRegion * region; /* NULL to keep everything */
+	osmIdSet * regionnodes; /* the nodes kept so far */
+	bool wayinregion; /* the current way refers to one of them */
 
 	/* node details */
 	bool badnode;
-	xmlChar * lat;
-	xmlChar * lon;
+	xmlChar lat[OSM_COORD_MAXLEN + 1];
+	xmlChar lon[OSM_COORD_MAXLEN + 1];
+	int32_t latfixed; /* the same in fixed point, for BINARY, PGCOPY and CALLBACK */
+	int32_t lonfixed;
 
 	/* way details */
 	size_t numways;
-	const size_t maxways;
-	int_least64_t * waynodeids;
+	size_t maxways;
+	int_least64_t * waynodeids; /* in the arena, grown as needed */
+	osmLocationStore * locations; /* NULL unless way geometries are written */
+	const int32_t * waycoords; /* the locations of the nodes, looked up by the parser for a pipeline, or NULL */
 
 	/* tag details */
 	bool badtag;
 	const xmlChar * tagprefix; /* will just point to string constants */
-	xmlChar * tagkey;
-	xmlChar * tagvalue;
+	osmSlice tagkey; /* only valid while handling the tag element */
+	osmSlice tagvalue;
+	const osmTagFilter * tagfilter; /* NULL for the default rules, shared by parallel parsers */
+	bool dropUntagged; /* drop nodes and ways without tags that pass the filter */
+	size_t numtags; /* tags of the current node or way that passed the filter */
 
 	/* printing details */
 	osmPrintMode printMode;
-	FILE * node_file;
-	FILE * way_file;
-	FILE * nodetag_file;
-	FILE * waytag_file;
+	bool tableRecords; /* table outputs take binary records (see sort.h) instead of text */
+	bool splitPredicates; /* PL: ways and tags go to way_file, nodetag_file and waytag_file */
+	bool tagRecords; /* tag outputs take binary records, for the tag dictionary (see tagdict.h) */
+	unsigned int precision; /* decimals of the node coordinates, 0 to keep them as they were read */
+	bool changes; /* the input is an osmChange file: deletions first, PL facts as assertz directives */
+	bool quiet; /* only warnings and errors go to stderr, not the document progress (the library) */
+	osmOutput * node_file;
+	osmOutput * way_file;
+	osmOutput * nodetag_file;
+	osmOutput * waytag_file;
+	osmOutput * waygeom_file; /* PL: way_geom facts, when split */
+	osmOutput * nodedelete_file; /* TABLE: ids of deleted and modified nodes, for -change */
+	osmOutput * waydelete_file;
+	osmOutput * prolog_file;
+	bool outputfailed; /* a write failed, set when the outputs are closed */
+	osmCheckpoint * checkpoint; /* NULL unless the conversion is checkpointed */
+	osmShards * shards; /* NULL unless the outputs are sharded, see shard.h */
+	const osmCallbacks * callbacks; /* CALLBACK: where the records go */
+	void * callbackarg;
+	bool stopped; /* CALLBACK: a callback returned false, the rest is ignored */
+	osmPipeline * pipeline; /* NULL unless a format thread prints, see pipeline.h */
+	bool formatThread; /* start a pipeline with the document */
+	bool readThread; /* read streams ahead on a thread of their own (see input.h) */
+
+	/* statistics, see stats.h */
+	uint_least64_t counters[_OSM_COUNTER_SIZE_];
+	bool timePhases; /* sample the time spent filtering and formatting */
+	uint_least64_t formattime; /* estimated from the samples, in nanoseconds */
 }
 parseState;
 
 /* maps osmElements to strings */
 extern xmlChar ** strConstants;
 
-/* initializes osm2prolog structures */
+/* initializes osm2prolog structures
+ * (call once, before any parsing starts; parsers share these read-only) */
 void osm2prolog_init(void);
 
 /* frees osm2prolog structures */
@@ -69,13 +124,44 @@ void osm2prolog_cleanup(void);
 /* creates a parseState object */
 parseState * osm2prolog_createParseState(void);
 
-/* free a parseState object */
+/* the number of outputs of a parseState */
+#define OSM_OUTPUT_SLOTS 8
+
+/* stores the addresses of the output fields of a parseState, prolog_file
+ * last */
+void osm2prolog_outputSlots(parseState * state, osmOutput ** slots[OSM_OUTPUT_SLOTS]);
+
+/* flushes and closes all outputs of a parseState, the prolog file last as
+ * spool outputs append to it, or those of all its shards; returns false if
+ * any write failed */
+bool osm2prolog_closeOutputs(parseState * state);
+
+/* free a parseState object, closing any outputs that are still open */
 void osm2prolog_freeParseState(parseState * state);
 
-/* (This comment might be out of sync.)
- * currently changes all whitespace to space */
-xmlChar * prolog_filter_str(const xmlChar * str);
+/* parses an optionally signed decimal integer, false if it is malformed or
+ * does not fit */
+bool osm2prolog_parseId(osmSlice str, int_least64_t * id);
+
+/* parses decimal degrees, with an optional exponent, to fixed point,
+ * rounding half away from zero; false if it is malformed, OSM_COORD_UNUSABLE
+ * if it does not fit; 'plain' tells whether it was written as digits with
+ * an optional sign and fraction, which is a valid float or integer as is */
+bool osm2prolog_parseDegrees(osmSlice str, int32_t * fixed, bool * plain);
+
+/* longest osm2prolog_formatDegrees result */
+#define OSM_DEGREES_MAXLEN 13
+
+/* writes fixed point degrees with 'decimals' (at most 7) digits in the
+ * fraction, rounding half away from zero; returns the length */
+size_t osm2prolog_formatDegrees(int32_t fixed, unsigned int decimals, char * buf);
+
+/* rounds fixed point degrees to 'decimals' (at most 7) digits in the
+ * fraction, like osm2prolog_formatDegrees */
+int32_t osm2prolog_roundDegrees(int32_t fixed, unsigned int decimals);
+
+/* maps a whole file read-only into memory, returns NULL on failure */
+const char * osm2prolog_mapFile(const char * filename, size_t * size);
 
-/* (This comment might be out of sync.)
- * currently ignores 'created_by' and 'note' tags */
-bool osmIgnoreKey(const xmlChar * keyname);
+/* unmaps a file mapped by osm2prolog_mapFile */
+void osm2prolog_unmapFile(const char * data, size_t size);
@@ -0,0 +1,95 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+:- module(osm,
+	  [ osm_load/2			% +File, +Options
+	  ]).
+:- use_module(library(option)).
+:- use_module(library(error)).
+
+/** <module> Loading OpenStreetMap data without the Prolog reader
+
+osm_load/2 reads an OSM XML, PBF or compressed XML file with the
+osm2prolog parser and asserts the predicates of a conversion to prolog
+terms:
+
+    node(Id, Lat, Lon).
+    way(Id, NodeIds).
+    node_tag(Id, Key, Value).
+    way_tag(Id, Key, Value).
+
+Ids are integers, keys and values atoms, as in a conversion. Coordinates
+are not: a conversion copies them as the input has them, so lat="1"
+gives node(1, 1, 2), while osm_load/2 always asserts floats in degrees,
+node(1, 1.0, 2.0), or with coordinates(fixed) integers. Compare them
+with =:=/2 rather than unification when mixing the two.
+The facts are asserted as they are parsed, so load time follows the
+parser instead of the reader and compiler of consult/1. All four are
+dynamic predicates; SWI-Prolog indexes them on their first argument, the
+id, when they are first called with it bound.
+*/
+
+:- prolog_load_context(directory, Dir),
+   asserta(user:file_search_path(osm4pl, Dir)).
+:- use_foreign_library(osm4pl(osm4pl)).
+
+%!	osm_load(+File, +Options) is det.
+%
+%	Asserts the nodes, ways and tags in File. Options:
+%
+%	  - module(+Module)
+%	    Module the facts are asserted in, default `user`.
+%	  - tags(+Rules)
+%	    Only keep tags matching Rules, in the syntax of the -tags
+%	    option of osm2prolog.
+%	  - drop_untagged(+Bool)
+%	    Leave out nodes and ways without (kept) tags, default `false`.
+%	  - coordinates(+Type)
+%	    `float` (default) for degrees, or `fixed` for integers of
+%	    degrees times 10^7, as stored in OSM.
+%	  - compile(+Bool)
+%	    Make the predicates static once loaded, as if they were
+%	    consulted, default `false`.
+%
+%	@error osm_load_error(File) if File is malformed.
+
+osm_load(File, Options) :-
+	option(module(Module), Options, user),
+	option(tags(Rules), Options, ''),
+	option(drop_untagged(Drop), Options, false),
+	option(coordinates(Coords), Options, float),
+	option(compile(Compile), Options, false),
+	must_be(atom, Module),
+	must_be(oneof([float, fixed]), Coords),
+	must_be(boolean, Compile),
+	Preds = [Module:node/3, Module:way/2, Module:node_tag/3, Module:way_tag/3],
+	dynamic(Preds),
+	(   Coords == fixed
+	->  Fixed = true
+	;   Fixed = false
+	),
+	osm_load_(File, Module, Rules, Drop, Fixed),
+	(   Compile == true
+	->  compile_predicates(Preds)
+	;   true
+	).
+
+:- multifile prolog:error_message//1.
+
+prolog:error_message(osm_load_error(File)) -->
+	[ 'Failed to load OSM data from ~w, see the messages above'-[File] ].
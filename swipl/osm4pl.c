@@ -0,0 +1,216 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The foreign half of the osm module, see osm.pl: osm_load_/5 reads an OSM
+ * file with libosm2prolog and asserts the facts a conversion to prolog
+ * terms would write, without the text in between. */
+
+#include "osm2prolog.h"
+
+#include <stdbool.h>
+#include <SWI-Prolog.h>
+
+/* the global stack is reclaimed, and signals are handled, after this many
+ * facts */
+#define LOAD_BATCH 4096
+
+typedef
+struct loadContext {
+	module_t module;
+	bool fixed; /* coordinates as fixed point integers instead of floats */
+	fid_t frame;
+	unsigned int batched;
+	term_t args; /* three, reused for every fact; created in the frame */
+	term_t cell;
+	term_t clause;
+}
+loadContext;
+
+static functor_t FUNCTOR_node3;
+static functor_t FUNCTOR_way2;
+static functor_t FUNCTOR_node_tag3;
+static functor_t FUNCTOR_way_tag3;
+
+/************************/
+/* forward declarations */
+/************************/
+install_t install_osm4pl(void);
+
+static foreign_t osmLoad(term_t file, term_t module, term_t tags, term_t dropuntagged, term_t fixed);
+
+static bool loadNode(void * arg, const osmNode * node);
+static bool loadWay(void * arg, const osmWay * way);
+static bool loadNodeTag(void * arg, const osmTag * tag);
+static bool loadWayTag(void * arg, const osmTag * tag);
+static bool loadTag(loadContext * context, functor_t functor, const osmTag * tag);
+static bool assertFact(loadContext * context, functor_t functor);
+static void newTerms(loadContext * context);
+
+static bool putCoordinate(const loadContext * context, term_t t, int32_t fixed);
+static int raiseLoadError(term_t file);
+
+/*****************/
+/* the interface */
+/*****************/
+install_t install_osm4pl(void) {
+	FUNCTOR_node3 = PL_new_functor(PL_new_atom("node"), 3);
+	FUNCTOR_way2 = PL_new_functor(PL_new_atom("way"), 2);
+	FUNCTOR_node_tag3 = PL_new_functor(PL_new_atom("node_tag"), 3);
+	FUNCTOR_way_tag3 = PL_new_functor(PL_new_atom("way_tag"), 3);
+
+	PL_register_foreign("osm_load_", 5, osmLoad, 0);
+}
+
+/* osm_load_(+File, +Module, +TagRules, +DropUntagged, +Fixed) */
+static foreign_t osmLoad(term_t file, term_t module, term_t tags, term_t dropuntagged, term_t fixed) {
+	osmCallbacks callbacks = { loadNode, loadWay, loadNodeTag, loadWayTag };
+	loadContext context;
+	osmReader * reader;
+	char * filename;
+	char * rules;
+	atom_t name;
+	int drop;
+	int usefixed;
+	bool ok;
+
+	if (!PL_get_file_name(file, &filename, PL_FILE_OSPATH | PL_FILE_SEARCH | PL_FILE_EXIST | PL_FILE_READ)
+			|| !PL_get_atom_ex(module, &name)
+			|| !PL_get_chars(tags, &rules, CVT_ATOM | CVT_STRING | CVT_EXCEPTION | REP_UTF8)
+			|| !PL_get_bool_ex(dropuntagged, &drop)
+			|| !PL_get_bool_ex(fixed, &usefixed))
+		return FALSE;
+
+	context.module = PL_new_module(name);
+	context.fixed = usefixed;
+	context.batched = 0;
+
+	reader = osm2prolog_openReader(&callbacks, &context);
+	if ('\0' != rules[0] && !osm2prolog_readerTags(reader, rules)) {
+		osm2prolog_closeReader(reader);
+		return PL_domain_error("osm_tag_rules", tags);
+	}
+	if (drop)
+		osm2prolog_readerDropUntagged(reader);
+
+	context.frame = PL_open_foreign_frame();
+	newTerms(&context);
+	ok = osm2prolog_readFile(reader, filename);
+	ok = osm2prolog_closeReader(reader) && ok;
+	PL_close_foreign_frame(context.frame);
+
+	/* a callback stopped the reader on an exception, which is passed on */
+	if (PL_exception(0))
+		return FALSE;
+	return ok ? TRUE : raiseLoadError(file);
+}
+
+
+
+/*************/
+/* callbacks */
+/*************/
+/* nodes with coordinates that do not fit are left out, they would not
+ * load from a conversion either */
+static bool loadNode(void * arg, const osmNode * node) {
+	loadContext * context = arg;
+
+	if (OSM2PROLOG_COORD_UNUSABLE == node->lat || OSM2PROLOG_COORD_UNUSABLE == node->lon)
+		return true;
+	return PL_put_int64(context->args, node->id)
+		&& putCoordinate(context, context->args + 1, node->lat)
+		&& putCoordinate(context, context->args + 2, node->lon)
+		&& assertFact(context, FUNCTOR_node3);
+}
+
+static bool loadWay(void * arg, const osmWay * way) {
+	loadContext * context = arg;
+	term_t list = context->args + 1;
+	size_t i;
+
+	if (!PL_put_int64(context->args, way->id))
+		return false;
+	PL_put_nil(list);
+	for (i = way->numnodes; i > 0; --i) {
+		if (!PL_put_int64(context->cell, way->nodes[i - 1]) || !PL_cons_list(list, context->cell, list))
+			return false;
+	}
+	return assertFact(context, FUNCTOR_way2);
+}
+
+static bool loadNodeTag(void * arg, const osmTag * tag) {
+	return loadTag(arg, FUNCTOR_node_tag3, tag);
+}
+
+static bool loadWayTag(void * arg, const osmTag * tag) {
+	return loadTag(arg, FUNCTOR_way_tag3, tag);
+}
+
+static bool loadTag(loadContext * context, functor_t functor, const osmTag * tag) {
+	return PL_put_int64(context->args, tag->id)
+		&& PL_put_chars(context->args + 1, PL_ATOM | REP_UTF8, tag->keylen, (const char *)tag->key)
+		&& PL_put_chars(context->args + 2, PL_ATOM | REP_UTF8, tag->valuelen, (const char *)tag->value)
+		&& assertFact(context, functor);
+}
+
+/* the clause is copied by PL_assert, so the terms built for it are
+ * garbage right away; rewinding the frame every batch reclaims them
+ * without collecting the stacks, along with the term references, which
+ * are created again */
+static bool assertFact(loadContext * context, functor_t functor) {
+	if (!PL_cons_functor_v(context->clause, functor, context->args)
+			|| !PL_assert(context->clause, context->module, PL_ASSERTZ))
+		return false;
+	if (++context->batched == LOAD_BATCH) {
+		context->batched = 0;
+		PL_rewind_foreign_frame(context->frame);
+		newTerms(context);
+		if (PL_handle_signals() < 0)
+			return false;
+	}
+	return true;
+}
+
+
+
+/***********/
+/* helpers */
+/***********/
+static void newTerms(loadContext * context) {
+	context->args = PL_new_term_refs(3);
+	context->cell = PL_new_term_ref();
+	context->clause = PL_new_term_ref();
+}
+
+static bool putCoordinate(const loadContext * context, term_t t, int32_t fixed) {
+	if (context->fixed)
+		return PL_put_integer(t, fixed);
+	return PL_put_float(t, (double)fixed / OSM2PROLOG_COORD_SCALE);
+}
+
+/* error(osm_load_error(File), _), see the message in osm.pl */
+static int raiseLoadError(term_t file) {
+	term_t ex = PL_new_term_ref();
+
+	if (!PL_unify_term(ex,
+			PL_FUNCTOR_CHARS, "error", 2,
+				PL_FUNCTOR_CHARS, "osm_load_error", 1,
+					PL_TERM, file,
+				PL_VARIABLE))
+		return FALSE;
+	return PL_raise_exception(ex);
+}
@@ -0,0 +1,110 @@
+/* Copyright (C) 2010, 2011 Robrecht Dewaele
+ *
+ * This file is part of osm2prolog.
+ *
+ * osm2prolog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * osm2prolog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with osm2prolog.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Tests of osm_load/2, run with 'make check' in this directory. Each test
+ * loads into a module of its own: test.osm for the facts and options, and
+ * a generated file of more facts than osm4pl.c asserts per batch. */
+
+:- use_module(library(plunit)).
+:- use_module(library(lists)).
+:- use_module(library(aggregate)).
+:- use_module(osm).
+
+:- dynamic fixture/1.
+
+:- prolog_load_context(directory, Dir),
+   directory_file_path(Dir, 'test.osm', File),
+   asserta(fixture(File)).
+
+% more than the 4096 facts of a batch, so the frame is rewound while loading
+batch_nodes(5000).
+
+load(Module, Options) :-
+	fixture(File),
+	osm_load(File, [module(Module)|Options]).
+
+facts(Module, Head, Facts) :-
+	findall(Head, Module:Head, Facts).
+
+% a node every degree of latitude, and a way through all of them
+write_batch_fixture(File) :-
+	batch_nodes(N),
+	tmp_file_stream(text, File, Out),
+	format(Out, '<osm version="0.6">~n', []),
+	forall(between(1, N, Id),
+	       ( Lat is Id mod 90,
+		 format(Out, '<node id="~d" lat="~d" lon="-~d.5"/>~n', [Id, Lat, Lat])
+	       )),
+	format(Out, '<way id="1">~n', []),
+	forall(between(1, N, Id), format(Out, '<nd ref="~d"/>~n', [Id])),
+	format(Out, '</way>~n</osm>~n', []),
+	close(Out).
+
+:- begin_tests(osm_load).
+
+test(facts, [setup(load(osm_test_facts, []))]) :-
+	facts(osm_test_facts, node(_, _, _), Nodes),
+	assertion(Nodes == [node(1, 50.5, 4.25), node(-2, -0.125, 10.0)]),
+	facts(osm_test_facts, way(_, _), Ways),
+	assertion(Ways == [way(10, [1, -2, 3])]),
+	facts(osm_test_facts, node_tag(_, _, _), NodeTags),
+	assertion(NodeTags == [node_tag(1, name, 'A')]),
+	facts(osm_test_facts, way_tag(_, _, _), WayTags),
+	assertion(WayTags == [way_tag(10, highway, '\u00E9'), way_tag(10, name, 'B')]),
+	assertion(predicate_property(osm_test_facts:node(_, _, _), dynamic)).
+
+test(fixed, [setup(load(osm_test_fixed, [coordinates(fixed)]))]) :-
+	facts(osm_test_fixed, node(_, _, _), Nodes),
+	assertion(Nodes == [node(1, 505000000, 42500000), node(-2, -1250000, 100000000)]).
+
+test(tags, [setup(load(osm_test_tags, [tags(name), drop_untagged(true)]))]) :-
+	facts(osm_test_tags, node(_, _, _), Nodes),
+	assertion(Nodes == [node(1, 50.5, 4.25)]),
+	facts(osm_test_tags, node_tag(_, _, _), NodeTags),
+	assertion(NodeTags == [node_tag(1, name, 'A')]),
+	facts(osm_test_tags, way_tag(_, _, _), WayTags),
+	assertion(WayTags == [way_tag(10, name, 'B')]).
+
+test(compile, [setup(load(osm_test_compile, [compile(true)]))]) :-
+	assertion(\+ predicate_property(osm_test_compile:node(_, _, _), dynamic)),
+	assertion(osm_test_compile:way(10, [1, -2, 3])),
+	assertion(osm_test_compile:way_tag(10, highway, _)).
+
+test(batch, [ setup(write_batch_fixture(File)),
+	      cleanup(delete_file(File))
+	    ]) :-
+	osm_load(File, [module(osm_test_batch), coordinates(fixed)]),
+	batch_nodes(N),
+	aggregate_all(count, osm_test_batch:node(_, _, _), Count),
+	assertion(Count == N),
+	assertion(osm_test_batch:node(4096, 460000000, -465000000)),
+	assertion(osm_test_batch:node(4097, 470000000, -475000000)),
+	assertion(osm_test_batch:node(N, 500000000, -505000000)),
+	osm_test_batch:way(1, Refs),
+	numlist(1, N, Expected),
+	assertion(Refs == Expected).
+
+test(malformed, [ setup(tmp_file_stream(text, File, Out)),
+		  cleanup(delete_file(File)),
+		  error(osm_load_error(File))
+		]) :-
+	format(Out, '<osm version="0.6"><node id="1"', []),
+	close(Out),
+	osm_load(File, [module(osm_test_malformed)]).
+
+:- end_tests(osm_load).